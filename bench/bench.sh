@@ -0,0 +1,116 @@
+#!/bin/sh
+#
+# Runs every tool in out/ against a synthetic corpus and compares the
+# results with a saved baseline. Called by `make bench', see the README.
+#
+#   bench/bench.sh [--save-baseline]
+#
+# BENCH_PAGES      pages per corpus document (default: 40)
+# BENCH_PROFILES   corpus profiles, see out/bench/jkpdf-gencorpus --help
+#                  (default: text vector image mixed)
+# BENCH_BASELINE   baseline file (default: bench/baseline.json)
+# BENCH_THRESHOLD  allowed slowdown and memory growth in percent (default: 10)
+
+set -u
+
+pages=${BENCH_PAGES:-40}
+profiles=${BENCH_PROFILES:-text vector image mixed}
+baseline=${BENCH_BASELINE:-bench/baseline.json}
+threshold=${BENCH_THRESHOLD:-10}
+
+dir=out/bench
+results=$dir/results.json
+
+mkdir -p "$dir/corpus"
+: >"$results"
+failures=0
+
+# The C tools print their --stats report, which has the peak RSS; for a
+# pipe, the largest of its stages counts. Shell tools report no RSS.
+# Throughput counts output pages: pdfinfo if installed, otherwise the
+# --stats report of the last stage.
+run() {
+    name=$1
+    input=$2
+    shift 2
+
+    start=$(date +%s%N)
+    if ! JKPDF_STATS=1 sh -c "$*" <"$input" >"$dir/output.pdf" 2>"$dir/stderr"; then
+        printf 'ERROR: %s failed:\n' "$name" 1>&2
+        sed 's/^/    /' "$dir/stderr" 1>&2
+        printf '{"name": "%s", "failed": true}\n' "$name" | tee -a "$results"
+        failures=$((failures + 1))
+        return
+    fi
+    end=$(date +%s%N)
+
+    rss=$(sed -n 's/.*"peak_rss_bytes": \([0-9]*\).*/\1/p' "$dir/stderr" | sort -n | tail -n 1)
+    size=$(wc -c <"$dir/output.pdf")
+    out_pages=$(pdfinfo "$dir/output.pdf" 2>/dev/null | sed -n 's/^Pages: *//p')
+    if [ -z "$out_pages" ]; then
+        out_pages=$(sed -n 's/.*"pages": \([0-9]*\).*/\1/p' "$dir/stderr" | tail -n 1)
+    fi
+
+    awk -v name="$name" -v ns="$((end - start))" -v pages="${out_pages:-0}" -v rss="${rss:-0}" -v size="$size" 'BEGIN {
+        wall = ns / 1e9
+        printf "{\"name\": \"%s\", \"wall_s\": %.3f, \"pages\": %d, \"pages_per_s\": %.2f, \"peak_rss_bytes\": %d, \"output_bytes\": %d}\n", name, wall, pages, wall > 0 ? pages / wall : 0, rss, size
+    }' | tee -a "$results"
+}
+
+for profile in $profiles; do
+    corpus=$dir/corpus/$profile-$pages.pdf
+    if [ ! -s "$corpus" ]; then
+        printf 'INFO: generating %s\n' "$corpus" 1>&2
+        out/bench/jkpdf-gencorpus --profile "$profile" --pages "$pages" >"$corpus" || exit 1
+    fi
+
+    for exe in out/jkpdftool-*; do
+        tool=${exe#out/jkpdftool-}
+        case $tool in
+            pagefit)            args='-s A5' ;;
+            rotate)             args='90' ;;
+            nup)                args='2x1' ;;
+            splice)             args="$corpus $corpus" ;;
+            crop)               args='' ;;
+            ndown)              args='2x2' ;;
+            overlay)            args="$corpus" ;;
+            rasterize)          args='-r 150' ;;
+            pasta)              args='c,1,0,0,100,100 v,1,200,200' ;;
+            booklet)            args='' ;;
+            cut)                args='-p 1 -w 200 -h 200' ;;
+            glue)               args='' ;;
+            mirror)             args='' ;;
+            duplexify-margins)  args='-x 1cm' ;;
+            reencode|color2black|splice-qpdf) args='' ;;
+            *)                  continue ;; # services, not tools
+        esac
+
+        run "$tool/$profile-$pages" "$corpus" "$exe $args"
+    done
+
+    run "pipe/$profile-$pages" "$corpus" \
+        "out/jkpdftool-crop | out/jkpdftool-pagefit -s A5 | out/jkpdftool-nup 2x1"
+    run "pipeline/$profile-$pages" "$corpus" \
+        "out/jkpdftool crop ! pagefit -s A5 ! nup 2x1"
+done
+
+rm -f "$dir/output.pdf" "$dir/stderr"
+
+if [ "$failures" -gt 0 ] && [ "${1:-}" = "--save-baseline" ]; then
+    printf 'ERROR: %d benchmark(s) failed, not saving a baseline\n' "$failures" 1>&2
+    exit 1
+fi
+
+if [ "${1:-}" = "--save-baseline" ]; then
+    cp "$results" "$baseline"
+    printf 'INFO: saved %s\n' "$baseline" 1>&2
+    exit 0
+fi
+
+if [ ! -f "$baseline" ]; then
+    printf 'INFO: no baseline yet, save one with `make bench-baseline'"'"'\n' 1>&2
+    [ "$failures" -eq 0 ]
+    exit
+fi
+
+out/bench/jkpdf-benchcompare --threshold "$threshold" "$baseline" "$results"
@@ -0,0 +1,181 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Compares two `make bench' result files, see bench/bench.sh
+//
+// Both files have one JSON object per line, with the benchmark name and
+// its measurements, or "failed": true. Exits with status 1 if any benchmark
+// failed, is missing from the results, or got slower or needed more memory
+// than the threshold allows.
+
+static double
+get_number(JsonObject *obj, const char *name)
+{
+    JsonNode *node = json_object_get_member(obj, name);
+    if (!node || !JSON_NODE_HOLDS_VALUE(node))
+        return 0.0;
+
+    return json_node_get_double(node);
+}
+
+static gboolean
+get_failed(JsonObject *obj)
+{
+    JsonNode *node = json_object_get_member(obj, "failed");
+
+    return node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_BOOLEAN && json_node_get_boolean(node);
+}
+
+// Returns name -> JsonObject for every line of the file
+static GHashTable *
+load_results(const char *path, GPtrArray *names, GError **error)
+{
+    g_autofree gchar *contents = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, error))
+        return NULL;
+
+    g_autoptr(GHashTable) results = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)json_object_unref);
+
+    g_auto(GStrv) lines = g_strsplit(contents, "\n", -1);
+    for (guint i = 0; lines[i]; ++i) {
+        if (!*g_strstrip(lines[i]))
+            continue;
+
+        g_autoptr(JsonParser) parser = json_parser_new();
+        if (!json_parser_load_from_data(parser, lines[i], -1, error)) {
+            g_prefix_error(error, "%s:%u: ", path, i + 1);
+            return NULL;
+        }
+
+        JsonNode *root = json_parser_get_root(parser);
+        JsonNode *name = root && JSON_NODE_HOLDS_OBJECT(root) ? json_object_get_member(json_node_get_object(root), "name") : NULL;
+        if (!name || !JSON_NODE_HOLDS_VALUE(name) || json_node_get_value_type(name) != G_TYPE_STRING) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s:%u: expected an object with a \"name\"", path, i + 1);
+            return NULL;
+        }
+
+        if (names)
+            g_ptr_array_add(names, g_strdup(json_node_get_string(name)));
+
+        g_hash_table_replace(results, g_strdup(json_node_get_string(name)), json_object_ref(json_node_get_object(root)));
+    }
+
+    return g_steal_pointer(&results);
+}
+
+static double
+percent_change(double before, double after)
+{
+    return before > 0.0 ? (after - before) / before * 100.0 : 0.0;
+}
+
+int
+main(int argc, char **argv)
+{
+    gdouble arg_threshold = 10.0;
+
+    GOptionEntry option_entries[] = {
+        { "threshold", 't', 0, G_OPTION_ARG_DOUBLE, &arg_threshold, "Allowed slowdown and memory growth in percent (default: 10)", "PERCENT" },
+        { NULL }
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) context = g_option_context_new("BASELINE RESULTS");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    g_option_context_set_description(context, "Compare benchmark results against a baseline.");
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "ERROR: option parsing failed: %s\n", error->message);
+        return 1;
+    }
+
+    if (argc != 3) {
+        fprintf(stderr, "ERROR: expected a baseline and a results file\n");
+        return 1;
+    }
+
+    g_autoptr(GPtrArray) baseline_names = g_ptr_array_new_with_free_func(g_free);
+    g_autoptr(GHashTable) baseline = load_results(argv[1], baseline_names, &error);
+    if (!baseline) {
+        fprintf(stderr, "ERROR: %s\n", error->message);
+        return 1;
+    }
+
+    g_autoptr(GPtrArray) names = g_ptr_array_new_with_free_func(g_free);
+    g_autoptr(GHashTable) results = load_results(argv[2], names, &error);
+    if (!results) {
+        fprintf(stderr, "ERROR: %s\n", error->message);
+        return 1;
+    }
+
+    int n_regressions = 0;
+    int n_failed = 0;
+
+    printf("%-32s %10s %8s %10s %8s %10s %8s\n", "benchmark", "wall s", "change", "pages/s", "change", "RSS MiB", "change");
+
+    for (guint i = 0; i < names->len; ++i) {
+        const char *name = g_ptr_array_index(names, i);
+        JsonObject *now = g_hash_table_lookup(results, name);
+        JsonObject *before = g_hash_table_lookup(baseline, name);
+
+        if (get_failed(now)) {
+            printf("%-32s %10s\n", name, "FAILED");
+            n_failed++;
+            continue;
+        }
+
+        double wall = get_number(now, "wall_s");
+        double pps = get_number(now, "pages_per_s");
+        double rss = get_number(now, "peak_rss_bytes");
+
+        if (!before || get_failed(before)) {
+            printf("%-32s %10.3f %8s %10.1f %8s %10.1f %8s\n", name, wall, "new", pps, "", rss / (1024 * 1024), "");
+            continue;
+        }
+
+        double wall_change = percent_change(get_number(before, "wall_s"), wall);
+        double pps_change = percent_change(get_number(before, "pages_per_s"), pps);
+        double rss_change = percent_change(get_number(before, "peak_rss_bytes"), rss);
+
+        gboolean regression = wall_change > arg_threshold || rss_change > arg_threshold;
+        if (regression)
+            n_regressions++;
+
+        printf("%-32s %10.3f %+7.1f%% %10.1f %+7.1f%% %10.1f %+7.1f%%%s\n", name,
+               wall, wall_change, pps, pps_change, rss / (1024 * 1024), rss_change,
+               regression ? "  REGRESSION" : "");
+    }
+
+    for (guint i = 0; i < baseline_names->len; ++i) {
+        const char *name = g_ptr_array_index(baseline_names, i);
+        if (!g_hash_table_contains(results, name)) {
+            printf("%-32s %10s\n", name, "MISSING");
+            n_failed++;
+        }
+    }
+
+    if (n_failed)
+        fprintf(stderr, "ERROR: %d benchmark(s) failed or are missing from the results\n", n_failed);
+
+    if (n_regressions)
+        fprintf(stderr, "WARN: %d benchmark(s) regressed by more than %g%%\n", n_regressions, arg_threshold);
+
+    return n_failed || n_regressions ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "jkpdf-io.h"
+
+// Synthetic input for `make bench', see bench/bench.sh
+//
+// Writes a PDF with the given number of A4 pages to stdout. The content is
+// pseudo-random but the same for the same seed, so a corpus can be
+// regenerated instead of being kept around.
+
+#define A4_WIDTH  595.0
+#define A4_HEIGHT 842.0
+
+// pages of a scanned document: 150 dpi, so a few MiB per page
+#define IMAGE_WIDTH  1240
+#define IMAGE_HEIGHT 1754
+
+static const char *words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+    "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+    "et", "dolore", "magna", "aliqua", "enim", "ad", "minim", "veniam",
+    "quis", "nostrud", "exercitation", "ullamco", "laboris", "nisi",
+};
+
+static void
+draw_text_page(cairo_t *cr, GRand *rand)
+{
+    static const char *families[] = { "Serif", "Sans", "Monospace" };
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+
+    double y = 60;
+    while (y < A4_HEIGHT - 60) {
+        double size = g_rand_int_range(rand, 0, 8) ? 10.0 : 16.0;
+        cairo_select_font_face(cr, families[g_rand_int_range(rand, 0, G_N_ELEMENTS(families))],
+                               CAIRO_FONT_SLANT_NORMAL,
+                               g_rand_boolean(rand) ? CAIRO_FONT_WEIGHT_NORMAL : CAIRO_FONT_WEIGHT_BOLD);
+        cairo_set_font_size(cr, size);
+
+        g_autoptr(GString) line = g_string_new(NULL);
+        for (int i = 0; i < 12; ++i) {
+            if (i)
+                g_string_append_c(line, ' ');
+            g_string_append(line, words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))]);
+        }
+
+        cairo_move_to(cr, 60, y);
+        cairo_show_text(cr, line->str);
+
+        y += size * 1.4;
+    }
+}
+
+// Like a CAD drawing: lots of short strokes and some filled shapes
+static void
+draw_vector_page(cairo_t *cr, GRand *rand)
+{
+    cairo_set_line_width(cr, 0.3);
+
+    for (int i = 0; i < 20000; ++i) {
+        double x = g_rand_double_range(rand, 20, A4_WIDTH - 20);
+        double y = g_rand_double_range(rand, 20, A4_HEIGHT - 20);
+
+        cairo_move_to(cr, x, y);
+        cairo_curve_to(cr,
+                       x + g_rand_double_range(rand, -10, 10), y + g_rand_double_range(rand, -10, 10),
+                       x + g_rand_double_range(rand, -10, 10), y + g_rand_double_range(rand, -10, 10),
+                       x + g_rand_double_range(rand, -10, 10), y + g_rand_double_range(rand, -10, 10));
+    }
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_stroke(cr);
+
+    for (int i = 0; i < 300; ++i) {
+        cairo_new_path(cr);
+        cairo_move_to(cr, g_rand_double_range(rand, 0, A4_WIDTH), g_rand_double_range(rand, 0, A4_HEIGHT));
+        for (int j = 0; j < 6; ++j)
+            cairo_line_to(cr, g_rand_double_range(rand, 0, A4_WIDTH), g_rand_double_range(rand, 0, A4_HEIGHT));
+        cairo_close_path(cr);
+
+        cairo_set_source_rgba(cr, g_rand_double(rand), g_rand_double(rand), g_rand_double(rand), 0.3);
+        cairo_fill(cr);
+    }
+}
+
+// A page-sized photo-like image: smooth gradients plus noise, which does
+// not compress well, just like a real scan
+static void
+draw_image_page(cairo_t *cr, GRand *rand)
+{
+    g_autoptr(JKPdfCairoSurfaceT) img = cairo_image_surface_create(CAIRO_FORMAT_RGB24, IMAGE_WIDTH, IMAGE_HEIGHT);
+
+    int stride = cairo_image_surface_get_stride(img);
+    unsigned char *data = cairo_image_surface_get_data(img);
+
+    guint32 phase = g_rand_int(rand);
+    for (int y = 0; y < IMAGE_HEIGHT; ++y) {
+        guint32 *row = (guint32 *)(void *)(data + y * stride);
+        for (int x = 0; x < IMAGE_WIDTH; ++x) {
+            guint32 noise = g_rand_int(rand);
+            guint32 r = ((guint32)x + phase) % 256;
+            guint32 g = ((guint32)y + (phase >> 8)) % 256;
+            guint32 b = (((guint32)(x + y)) / 2 + (phase >> 16)) % 256;
+
+            r = MIN(255u, r + (noise & 0x1f));
+            g = MIN(255u, g + ((noise >> 8) & 0x1f));
+            b = MIN(255u, b + ((noise >> 16) & 0x1f));
+
+            row[x] = (r << 16) | (g << 8) | b;
+        }
+    }
+    cairo_surface_mark_dirty(img);
+
+    cairo_scale(cr, A4_WIDTH / IMAGE_WIDTH, A4_HEIGHT / IMAGE_HEIGHT);
+    cairo_set_source_surface(cr, img, 0, 0);
+    cairo_paint(cr);
+}
+
+// Glyphs of a user font, which ends up as a Type 3 font in the PDF: a
+// box with a diagonal, slanted by the character code
+static cairo_status_t
+render_type3_glyph(cairo_scaled_font_t *scaled_font, unsigned long glyph, cairo_t *cr, cairo_text_extents_t *extents)
+{
+    (void)scaled_font;
+
+    double slant = (double)(glyph % 7) / 20.0;
+
+    cairo_set_line_width(cr, 0.08);
+    cairo_move_to(cr, 0.05, 0);
+    cairo_line_to(cr, 0.05 + slant, -0.7);
+    cairo_line_to(cr, 0.55 + slant, -0.7);
+    cairo_line_to(cr, 0.55, 0);
+    cairo_close_path(cr);
+    cairo_line_to(cr, 0.55 + slant, -0.7);
+    cairo_stroke(cr);
+
+    extents->x_advance = 0.7;
+    return CAIRO_STATUS_SUCCESS;
+}
+
+// Pages of text in a Type 3 font. Its glyphs are only written when the
+// output is finished, which is what makes them worth testing.
+static void
+draw_type3_page(cairo_t *cr, GRand *rand)
+{
+    static cairo_font_face_t *face = NULL;
+    if (!face) {
+        face = cairo_user_font_face_create();
+        cairo_user_font_face_set_render_glyph_func(face, render_type3_glyph);
+    }
+
+    cairo_set_font_face(cr, face);
+    cairo_set_font_size(cr, 12);
+    cairo_set_source_rgb(cr, 0, 0, 0);
+
+    for (double y = 60; y < A4_HEIGHT - 60; y += 12 * 1.4) {
+        g_autoptr(GString) line = g_string_new(NULL);
+        for (int i = 0; i < 10; ++i) {
+            if (i)
+                g_string_append_c(line, ' ');
+            g_string_append(line, words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))]);
+        }
+
+        cairo_move_to(cr, 60, y);
+        cairo_show_text(cr, line->str);
+    }
+}
+
+typedef void (*DrawPageFunc)(cairo_t *cr, GRand *rand);
+
+int
+main(int argc, char **argv)
+{
+    g_autofree gchar *arg_profile = NULL;
+    gint arg_pages = 10;
+    gint arg_seed = 1;
+
+    GOptionEntry option_entries[] = {
+        { "profile", 'p', 0, G_OPTION_ARG_STRING, &arg_profile, "Kind of content (default: mixed)", "text|vector|image|mixed|type3" },
+        { "pages",   'n', 0, G_OPTION_ARG_INT,    &arg_pages, "Number of pages, 1 to 50000 (default: 10)", "N" },
+        { "seed",    0,   0, G_OPTION_ARG_INT,    &arg_seed, "Random seed (default: 1)", "SEED" },
+        { NULL }
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) context = g_option_context_new(">OUTPUT");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    g_option_context_set_description(context, "Generate a synthetic PDF for benchmarks.\n"
+        "\n"
+        "Profiles:\n"
+        "  text    pages full of text in several fonts\n"
+        "  vector  20000 curves and 300 transparent polygons per page\n"
+        "  image   one page-sized 150 dpi image per page\n"
+        "  mixed   all of the above, taking turns\n"
+        "  type3   text in a Type 3 font, not part of mixed\n");
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "ERROR: option parsing failed: %s\n", error->message);
+        return 1;
+    }
+
+    if (arg_pages < 1 || arg_pages > 50000) {
+        fprintf(stderr, "ERROR: --pages must be between 1 and 50000\n");
+        return 1;
+    }
+
+    static const DrawPageFunc all_funcs[] = { draw_text_page, draw_vector_page, draw_image_page, draw_type3_page };
+    const DrawPageFunc *funcs = all_funcs;
+    int n_funcs = 1;
+
+    if (!arg_profile || !strcmp(arg_profile, "mixed"))
+        n_funcs = 3;
+    else if (!strcmp(arg_profile, "text"))
+        funcs = &all_funcs[0];
+    else if (!strcmp(arg_profile, "vector"))
+        funcs = &all_funcs[1];
+    else if (!strcmp(arg_profile, "image"))
+        funcs = &all_funcs[2];
+    else if (!strcmp(arg_profile, "type3"))
+        funcs = &all_funcs[3];
+    else {
+        fprintf(stderr, "ERROR: unknown profile '%s'\n", arg_profile);
+        return 1;
+    }
+
+    if (isatty(1)) {
+        fprintf(stderr, "ERROR: refusing to write PDF to terminal\n");
+        return 1;
+    }
+
+    g_autoptr(GRand) rand = g_rand_new_with_seed((guint32)arg_seed);
+
+    JkPdfWriter *writer = jkpdf_writer_new(1, NULL);
+    g_autoptr(JKPdfCairoSurfaceT) surf = cairo_pdf_surface_create_for_stream(_jkpdf_cairo_write_to_stdout, writer, A4_WIDTH, A4_HEIGHT);
+    cairo_surface_set_user_data(surf, &jkpdf_writer_key, writer, jkpdf_writer_close);
+
+    for (int i = 0; i < arg_pages; ++i) {
+        g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
+        funcs[i % n_funcs](cr, rand);
+        cairo_show_page(cr);
+    }
+
+    cairo_surface_finish(surf);
+
+    int write_error = jkpdf_writer_finish(writer);
+    if (write_error) {
+        fprintf(stderr, "ERROR: while writing output: %s\n", g_strerror(write_error));
+        return 1;
+    }
+
+    cairo_status_t status = cairo_surface_status(surf);
+    if (status) {
+        fprintf(stderr, "ERROR: cairo status: %s\n", cairo_status_to_string(status));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,268 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "jkpdf-io.h"
+#include "jkpdf-crop.h"
+#include "jkpdf-rasterize.h"
+
+// Microbenchmarks for the pixel loops of crop and rasterize
+//
+// Runs every kernel on fixed synthetic A4 bitmaps at several resolutions,
+// without poppler, and prints ns/pixel and GB/s (of ARGB32 data passed
+// over once). Every kernel gets a fresh copy of the bitmap for every run;
+// copying is not timed. The best of the runs counts.
+
+#define A4_WIDTH  595.0
+#define A4_HEIGHT 842.0
+
+typedef void (*DrawBitmapFunc)(cairo_t *cr, unsigned char *data, int width, int height, int stride, double dpi, GRand *rand);
+
+static void
+draw_blank(cairo_t *cr, unsigned char *data, int width, int height, int stride, double dpi, GRand *rand)
+{
+    (void)cr; (void)data; (void)width; (void)height; (void)stride; (void)dpi; (void)rand;
+}
+
+static void
+draw_text(cairo_t *cr, unsigned char *data, int width, int height, int stride, double dpi, GRand *rand)
+{
+    (void)data; (void)width; (void)height; (void)stride;
+
+    static const char *words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit" };
+
+    cairo_scale(cr, dpi / 72.0, dpi / 72.0);
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_select_font_face(cr, "Serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 10);
+
+    for (double y = 60; y < A4_HEIGHT - 60; y += 14) {
+        g_autoptr(GString) line = g_string_new(NULL);
+        for (int i = 0; i < 12; ++i) {
+            if (i)
+                g_string_append_c(line, ' ');
+            g_string_append(line, words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))]);
+        }
+
+        cairo_move_to(cr, 60, y);
+        cairo_show_text(cr, line->str);
+    }
+}
+
+static void
+draw_photo(cairo_t *cr, unsigned char *data, int width, int height, int stride, double dpi, GRand *rand)
+{
+    (void)cr; (void)dpi;
+
+    for (int y = 0; y < height; ++y) {
+        uint32_t *row = (uint32_t *)(void *)(data + y * stride);
+        for (int x = 0; x < width; ++x) {
+            uint32_t noise = g_rand_int(rand);
+            uint32_t r = MIN(255u, (uint32_t)x % 256 + (noise & 0x1f));
+            uint32_t g = MIN(255u, (uint32_t)y % 256 + ((noise >> 8) & 0x1f));
+            uint32_t b = MIN(255u, (uint32_t)(x + y) / 2 % 256 + ((noise >> 16) & 0x1f));
+
+            row[x] = 0xff000000u | (r << 16) | (g << 8) | b;
+        }
+    }
+}
+
+// text plus dust: gray specks of a few pixels all over the page
+static void
+draw_scan(cairo_t *cr, unsigned char *data, int width, int height, int stride, double dpi, GRand *rand)
+{
+    draw_text(cr, data, width, height, stride, dpi, rand);
+
+    cairo_surface_flush(cairo_get_target(cr));
+
+    int n_specks = width * height / 5000;
+    int speck_size = MAX(1, (int)(dpi / 150.0));
+
+    for (int i = 0; i < n_specks; ++i) {
+        int x0 = g_rand_int_range(rand, 0, width - speck_size);
+        int y0 = g_rand_int_range(rand, 0, height - speck_size);
+        uint32_t gray = (uint32_t)g_rand_int_range(rand, 0x40, 0xc0);
+
+        for (int y = y0; y < y0 + speck_size; ++y) {
+            uint32_t *row = (uint32_t *)(void *)(data + y * stride);
+            for (int x = x0; x < x0 + speck_size; ++x)
+                row[x] = 0xff000000u | (gray << 16) | (gray << 8) | gray;
+        }
+    }
+}
+
+static cairo_surface_t *
+create_bitmap(DrawBitmapFunc draw, double dpi)
+{
+    int width = (int)round(A4_WIDTH * dpi / 72.0);
+    int height = (int)round(A4_HEIGHT * dpi / 72.0);
+
+    cairo_surface_t *img = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    if (cairo_surface_status(img)) {
+        fprintf(stderr, "ERROR: could not allocate a %dx%d bitmap\n", width, height);
+        exit(1);
+    }
+
+    g_autoptr(GRand) rand = g_rand_new_with_seed(42);
+
+    {
+        g_autoptr(JKPdfCairoT) cr = cairo_create(img);
+        cairo_set_source_rgb(cr, 1, 1, 1);
+        cairo_paint(cr);
+        cairo_surface_flush(img);
+
+        draw(cr, cairo_image_surface_get_data(img), width, height, cairo_image_surface_get_stride(img), dpi, rand);
+    }
+
+    cairo_surface_mark_dirty(img);
+
+    return img;
+}
+
+static void
+copy_bitmap(cairo_surface_t *dest, cairo_surface_t *source)
+{
+    cairo_surface_flush(source);
+    cairo_surface_flush(dest);
+
+    memcpy(cairo_image_surface_get_data(dest), cairo_image_surface_get_data(source),
+           (size_t)cairo_image_surface_get_stride(source) * (size_t)cairo_image_surface_get_height(source));
+
+    cairo_surface_mark_dirty(dest);
+}
+
+typedef enum {
+    KERNEL_CROP,
+    KERNEL_GRAYSCALE,
+    KERNEL_TRANSPARENTIZE,
+    KERNEL_CHOP,
+} Kernel;
+
+static const char *kernel_names[] = { "crop", "grayscale", "transparentize", "chop" };
+
+// Returns the time taken by one run, in seconds
+static double
+run_kernel(Kernel kernel, cairo_surface_t *work, cairo_surface_t *bitmap)
+{
+    copy_bitmap(work, bitmap);
+
+    // chop works on what transparentize left behind, see jkpdftool-rasterize
+    if (kernel == KERNEL_CHOP)
+        jkpdf_transparentize(work);
+
+    g_autoptr(JKPdfCairoSurfaceT) recording = NULL;
+    g_autoptr(JKPdfCairoT) cr = NULL;
+    if (kernel == KERNEL_CHOP) {
+        recording = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, NULL);
+        cr = cairo_create(recording);
+    }
+
+    gint64 start = g_get_monotonic_time();
+
+    switch (kernel) {
+    case KERNEL_CROP:
+        (void)jkpdf_scan_crop_bounds(work, 0, 0, 0xffffffffu);
+        break;
+    case KERNEL_GRAYSCALE:
+        jkpdf_make_grayscale(work);
+        break;
+    case KERNEL_TRANSPARENTIZE:
+        jkpdf_transparentize(work);
+        break;
+    case KERNEL_CHOP:
+        jkpdf_paint_chopped(work, false, cr);
+        break;
+    }
+
+    return (double)(g_get_monotonic_time() - start) / G_USEC_PER_SEC;
+}
+
+int
+main(int argc, char **argv)
+{
+    g_autofree gchar *arg_dpi = NULL;
+    gdouble arg_min_time = 0.5;
+
+    GOptionEntry option_entries[] = {
+        { "dpi",      'r', 0, G_OPTION_ARG_STRING, &arg_dpi, "Resolutions, comma separated (default: 150,300,600,1200)", "DPI,..." },
+        { "min-time", 't', 0, G_OPTION_ARG_DOUBLE, &arg_min_time, "Minimum time per kernel and bitmap in seconds (default: 0.5)", "SECONDS" },
+        { NULL }
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) context = g_option_context_new(NULL);
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    g_option_context_set_description(context, "Time the pixel loops of crop and rasterize on synthetic bitmaps.\n"
+        "\n"
+        "Bitmaps (A4, ARGB32):\n"
+        "  blank   white\n"
+        "  text    dense black text\n"
+        "  photo   gradients and noise covering the page\n"
+        "  scan    text and dust\n"
+        "\n"
+        "ns/pixel counts every pixel of the bitmap, whether the kernel looked at it\n"
+        "or not: crop stops at the first row and column with content.\n"
+        "The chop kernel (rasterize --chop) includes emitting its pieces onto a\n"
+        "recording surface, like the tool does. A bitmap at 1200 dpi takes 530 MiB,\n"
+        "and two of them are needed at a time.\n");
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "ERROR: option parsing failed: %s\n", error->message);
+        return 1;
+    }
+
+    g_auto(GStrv) dpis = g_strsplit(arg_dpi ? arg_dpi : "150,300,600,1200", ",", -1);
+
+    static const char *bitmap_names[] = { "blank", "text", "photo", "scan" };
+    static const DrawBitmapFunc bitmap_funcs[] = { draw_blank, draw_text, draw_photo, draw_scan };
+
+    printf("%-8s %5s %-15s %12s %10s %8s\n", "bitmap", "dpi", "kernel", "pixels", "ns/pixel", "GB/s");
+
+    for (guint d = 0; dpis[d]; ++d) {
+        char *end = NULL;
+        double dpi = strtod(dpis[d], &end);
+        if (*end || end == dpis[d] || dpi < 1 || dpi > 2400) {
+            fprintf(stderr, "ERROR: invalid resolution '%s'\n", dpis[d]);
+            return 1;
+        }
+
+        for (guint b = 0; b < G_N_ELEMENTS(bitmap_funcs); ++b) {
+            g_autoptr(JKPdfCairoSurfaceT) bitmap = create_bitmap(bitmap_funcs[b], dpi);
+            g_autoptr(JKPdfCairoSurfaceT) work = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                                            cairo_image_surface_get_width(bitmap),
+                                                                            cairo_image_surface_get_height(bitmap));
+
+            double pixels = (double)cairo_image_surface_get_width(bitmap) * cairo_image_surface_get_height(bitmap);
+
+            for (guint k = 0; k < G_N_ELEMENTS(kernel_names); ++k) {
+                double best = INFINITY;
+                double total = 0;
+                int runs = 0;
+
+                while (runs < 3 || total < arg_min_time) {
+                    double t = run_kernel((Kernel)k, work, bitmap);
+                    best = MIN(best, t);
+                    total += t;
+                    runs++;
+                }
+
+                printf("%-8s %5g %-15s %12.0f %10.3f %8.2f\n", bitmap_names[b], dpi, kernel_names[k], pixels,
+                       best / pixels * 1e9, best > 0 ? pixels * 4 / best / 1e9 : 0.0);
+                fflush(stdout);
+            }
+        }
+    }
+
+    return 0;
+}
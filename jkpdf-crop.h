@@ -0,0 +1,397 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include "jkpdf.h"
+#include "jkpdf-pool.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Removing empty borders, used by jkpdftool-crop and libjkpdf
+
+struct jkpdf_crop_bounds {
+    double left;
+    double right;
+    double top;
+    double bottom;
+};
+
+static inline bool
+_jkpdf_color_equal_with_fuzz(const void *a, const void *b, int fuzz)
+{
+    unsigned char rgba[4];
+    unsigned char rgbb[4];
+
+    memcpy(rgba, a, 4);
+    memcpy(rgbb, b, 4);
+
+    for (int i = 0; i < 4; ++i) {
+        if (abs((int)rgba[i] - (int)rgbb[i]) > fuzz)
+            return false;
+    }
+
+    return true;
+}
+
+// Returns the borders of an ARGB32 image which have no more than pxl_limit
+// pixels per row or column differing from bgcolor, in pixels. The pixel
+// loops are kept apart from rendering, see bench/jkpdf-microbench.c.
+static inline struct jkpdf_crop_bounds
+jkpdf_scan_crop_bounds(cairo_surface_t *img, int pxl_limit, int color_fuzz, uint32_t bgcolor)
+{
+    struct jkpdf_crop_bounds retval = { 0.0, 0.0, 0.0, 0.0 };
+
+    int surfwidth  = cairo_image_surface_get_width(img);
+    int surfheight = cairo_image_surface_get_height(img);
+    int stride = cairo_image_surface_get_stride(img);
+    unsigned char *data = cairo_image_surface_get_data(img);
+
+    JKPDF_PROBE2(crop_scan_start, surfwidth, surfheight);
+
+    // top
+    int min_top = 0;
+    for (int y = 0; y < surfheight; ++y) {
+        unsigned char *row = data + y * stride;
+
+        int num_mismatch = 0;
+        for (int x = 0; x < surfwidth; ++x) {
+            if (!_jkpdf_color_equal_with_fuzz(&row[4*x], &bgcolor, color_fuzz))
+                num_mismatch++;
+        }
+
+        if (num_mismatch > pxl_limit)
+            break;
+
+        min_top++;
+    }
+
+    // bottom
+    int min_bottom = 0;
+    for (int y = surfheight-1; y >= min_top; --y) {
+        unsigned char *row = data + y * stride;
+
+        int num_mismatch = 0;
+        for (int x = 0; x < surfwidth; ++x) {
+            if (!_jkpdf_color_equal_with_fuzz(&row[4*x], &bgcolor, color_fuzz))
+                num_mismatch++;
+        }
+
+        if (num_mismatch > pxl_limit)
+            break;
+
+        min_bottom++;
+    }
+
+    // left
+    int min_left = 0;
+    for (int x = 0; x < surfwidth; ++x) {
+        int num_mismatch = 0;
+
+        for (int y = 0; y < surfheight; ++y) {
+            unsigned char *row = data + y * stride;
+            if (!_jkpdf_color_equal_with_fuzz(&row[4*x], &bgcolor, color_fuzz))
+                num_mismatch++;
+        }
+
+        if (num_mismatch > pxl_limit)
+            break;
+
+        min_left++;
+    }
+
+    // right
+    int min_right = 0;
+    for (int x = surfwidth-1; x > min_left; --x) {
+        int num_mismatch = 0;
+
+        for (int y = 0; y < surfheight; ++y) {
+            unsigned char *row = data + y * stride;
+            if (!_jkpdf_color_equal_with_fuzz(&row[4*x], &bgcolor, color_fuzz))
+                num_mismatch++;
+        }
+
+        if (num_mismatch > pxl_limit)
+            break;
+
+        min_right++;
+    }
+
+    JKPDF_PROBE4(crop_scan_done, min_left, min_right, min_top, min_bottom);
+
+    retval.left   = min_left;
+    retval.right  = min_right;
+    retval.top    = min_top;
+    retval.bottom = min_bottom;
+
+    return retval;
+}
+
+static inline struct jkpdf_crop_bounds
+jkpdf_calc_crop_bounds(JkPdfPage *page, double dpi, int pxl_limit, int color_fuzz, float bg_r, float bg_g, float bg_b)
+{
+    double pagewidth, pageheight;
+    jkpdf_page_get_size(page, &pagewidth, &pageheight);
+
+    int surfwidth  = (int)(pagewidth / 72.0 * dpi);
+    int surfheight = (int)(pageheight / 72.0 * dpi);
+
+    uint32_t bgcolor = (0xffu << 24) | (uint32_t)(bg_r * 0xff) << 16 | (uint32_t)(bg_g * 0xff) << 8 | (uint32_t)(bg_b * 0xff);
+
+    g_autoptr(JKPdfCairoSurfaceT) img = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, surfwidth, surfheight);
+
+    g_autoptr(JKPdfCairoT) cr = cairo_create(img);
+    cairo_set_source_rgb(cr, bg_r, bg_g, bg_b);
+    cairo_rectangle(cr, 0, 0, surfwidth, surfheight);
+    cairo_fill(cr);
+
+    cairo_scale(cr, surfwidth / pagewidth, surfheight / pageheight);
+    jkpdf_page_render(page, cr);
+
+    cairo_surface_flush(img);
+
+    struct jkpdf_crop_bounds retval = jkpdf_scan_crop_bounds(img, pxl_limit, color_fuzz, bgcolor);
+
+    retval.left   *= pagewidth / surfwidth;
+    retval.right  *= pagewidth / surfwidth;
+    retval.top    *= pageheight / surfheight;
+    retval.bottom *= pageheight / surfheight;
+
+    return retval;
+}
+
+static inline struct jkpdf_crop_bounds
+jkpdf_calc_crop_bounds_for_all(JkPdfDocument *doc, const JkPdfPageSelection *selection, double dpi, int pxl_limit, int color_fuzz, float bg_r, float bg_g, float bg_b)
+{
+    struct jkpdf_crop_bounds retval = { INFINITY, INFINITY, INFINITY, INFINITY };
+
+    for (int i = 0; i < jkpdf_document_get_n_pages(doc); ++i) {
+        if (!jkpdf_page_selection_contains(selection, i))
+            continue;
+
+        g_autoptr(JkPdfPage) page = jkpdf_document_get_page(doc, i);
+
+        struct jkpdf_crop_bounds b = jkpdf_calc_crop_bounds(page, dpi, pxl_limit, color_fuzz, bg_r, bg_b, bg_g);
+
+        retval.left   = MIN(retval.left, b.left);
+        retval.right  = MIN(retval.right, b.right);
+        retval.top    = MIN(retval.top, b.top);
+        retval.bottom = MIN(retval.bottom, b.bottom);
+    }
+
+    return retval;
+}
+
+
+struct _jkpdf_crop_params {
+    struct jkpdf_crop_bounds *bounds; // per page
+    const JkPdfCropOptions *options;
+};
+
+// Calculates output page size and the transformation from input to output
+static inline void
+_jkpdf_crop_page_layout(JkPdfDocument *doc, int pageno, const struct _jkpdf_crop_params *params, double *width, double *height, cairo_matrix_t *m)
+{
+    double pagewidth, pageheight;
+    jkpdf_document_get_page_size(doc, pageno, &pagewidth, &pageheight);
+
+    struct jkpdf_crop_bounds bounds = params->bounds[pageno];
+    const double *margins = params->options->margins;
+    double target_w = params->options->target_width;
+    double target_h = params->options->target_height;
+
+    cairo_matrix_init_identity(m);
+
+    if (target_w > 0.0 || target_h > 0.0) {
+        // scaled version
+
+        double cropped_w = pagewidth - bounds.left - bounds.right;
+        double cropped_h = pageheight - bounds.top - bounds.bottom;
+        double zoom_w = 0.0;
+        double zoom_h = 0.0;
+        double zoom = 0.0;
+
+        if (target_w > 0.0)
+            zoom_w = (target_w - margins[1] - margins[3]) / cropped_w;
+        if (target_h > 0.0)
+            zoom_h = (target_h - margins[0] - margins[2]) / cropped_h;
+
+        if (zoom_w > 0.0 && zoom_h > 0.0)
+            zoom = MIN(zoom_w, zoom_h);
+        else
+            zoom = MAX(zoom_w, zoom_h);
+
+        *width = cropped_w * zoom + margins[1] + margins[3];
+        *height = cropped_h * zoom + margins[0] + margins[2];
+
+        cairo_matrix_translate(m, margins[3], margins[0]);
+        cairo_matrix_scale(m, zoom, zoom);
+        cairo_matrix_translate(m, -bounds.left, -bounds.top);
+    } else {
+        // classic non-scaled version
+
+        bounds.top    = MAX(0.0, bounds.top - margins[0]);
+        bounds.right  = MAX(0.0, bounds.right - margins[1]);
+        bounds.bottom = MAX(0.0, bounds.bottom - margins[2]);
+        bounds.left   = MAX(0.0, bounds.left - margins[3]);
+
+        *width = pagewidth - bounds.left - bounds.right;
+        *height = pageheight - bounds.top - bounds.bottom;
+
+        cairo_matrix_translate(m, -bounds.left, -bounds.top);
+    }
+}
+
+static inline void
+_jkpdf_crop_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    cairo_matrix_t m;
+    _jkpdf_crop_page_layout(docs[0], pageno, user_data, width, height, &m);
+}
+
+static inline void
+_jkpdf_crop_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    double w, h;
+    cairo_matrix_t m;
+    _jkpdf_crop_page_layout(docs[0], pageno, user_data, &w, &h, &m);
+
+    cairo_transform(cr, &m);
+
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], pageno);
+    jkpdf_page_render(page, cr);
+}
+
+// The raster used to find the borders of a page, see jkpdf_calc_crop_bounds()
+static inline guint64
+_jkpdf_crop_page_raster(JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const struct _jkpdf_crop_params *params = user_data;
+
+    double pagewidth, pageheight;
+    jkpdf_document_get_page_size(docs[0], pageno, &pagewidth, &pageheight);
+
+    guint64 surfwidth = (guint64)(pagewidth / 72.0 * params->options->resolution);
+    guint64 surfheight = (guint64)(pageheight / 72.0 * params->options->resolution);
+
+    return surfwidth * surfheight * 4;
+}
+
+// Detects the borders to remove from the selected pages (NULL for all).
+// Returns NULL for invalid options.
+static inline struct jkpdf_crop_bounds *
+jkpdf_crop_find_bounds(JkPdfDocument *doc, const JkPdfCropOptions *options, const JkPdfPageSelection *selection, GError **error)
+{
+    const double *margins = options->margins;
+
+    if ((options->target_width > 0.0) && (margins[1] + margins[3] >= options->target_width)) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_OPTIONS, "margins greater than target width");
+        return NULL;
+    }
+
+    if ((options->target_height > 0.0) && (margins[0] + margins[2] >= options->target_height)) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_OPTIONS, "margins greater than target height");
+        return NULL;
+    }
+
+    if (options->resolution <= 0.0) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_OPTIONS, "resolution must be greater than zero");
+        return NULL;
+    }
+
+    float r = (float)options->background[0];
+    float g = (float)options->background[1];
+    float b = (float)options->background[2];
+
+    struct jkpdf_crop_bounds global_bounds = { 0.0, 0.0, 0.0, 0.0 };
+    if (!options->per_page) {
+        global_bounds = jkpdf_calc_crop_bounds_for_all(doc, selection, options->resolution, options->allow_mismatch, options->fuzz, r, g, b);
+    }
+
+    int n_pages = jkpdf_document_get_n_pages(doc);
+    g_autofree struct jkpdf_crop_bounds *page_bounds = g_new0(struct jkpdf_crop_bounds, n_pages);
+
+    // a preview shows one page, whose bounds are all that matter per page
+    int preview_page = jkpdf_preview.page - 1;
+
+    for (int pageno = 0; pageno < n_pages; ++pageno) {
+        if (!jkpdf_page_selection_contains(selection, pageno))
+            continue; // copied as it is, its bounds stay zero
+        if (options->per_page && preview_page >= 0 && pageno != preview_page)
+            continue;
+
+        struct jkpdf_crop_bounds bounds;
+        if (options->per_page) {
+            g_autoptr(JkPdfPage) page = jkpdf_document_get_page(doc, pageno);
+            bounds = jkpdf_calc_crop_bounds(page, options->resolution, options->allow_mismatch, options->fuzz, r, g, b);
+        } else {
+            bounds = global_bounds;
+        }
+
+        if (options->no_left)
+            bounds.left = 0.0;
+        if (options->no_top)
+            bounds.top = 0.0;
+        if (options->no_right)
+            bounds.right = 0.0;
+        if (options->no_bottom)
+            bounds.bottom = 0.0;
+
+        page_bounds[pageno] = bounds;
+    }
+
+    return g_steal_pointer(&page_bounds);
+}
+
+// Whether cropping would leave every page as it is, i.e. there is no border
+static inline gboolean
+jkpdf_crop_is_identity(JkPdfDocument *doc, const JkPdfCropOptions *options, struct jkpdf_crop_bounds *bounds)
+{
+    struct _jkpdf_crop_params params = { bounds, options };
+
+    for (int pageno = 0; pageno < jkpdf_document_get_n_pages(doc); ++pageno) {
+        double pagewidth, pageheight, w, h;
+        cairo_matrix_t m;
+        jkpdf_document_get_page_size(doc, pageno, &pagewidth, &pageheight);
+        _jkpdf_crop_page_layout(doc, pageno, &params, &w, &h, &m);
+
+        if (w != pagewidth || h != pageheight || !jkpdf_matrix_is_identity(&m))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static inline gboolean
+jkpdf_crop_render_document(JkPdfDocument *doc, const JkPdfCropOptions *options, struct jkpdf_crop_bounds *bounds, cairo_surface_t *surf, GError **error)
+{
+    struct _jkpdf_crop_params params = { bounds, options };
+
+    static const JkPdfPageFuncs funcs = { _jkpdf_crop_page_size, _jkpdf_crop_render_page, _jkpdf_crop_page_raster };
+    jkpdf_render_pages(surf, &doc, 1, jkpdf_document_get_n_pages(doc), &funcs, &params);
+
+    return jkpdf_check_surface_status(surf, error);
+}
+
+static inline gboolean
+jkpdf_crop_document(JkPdfDocument *doc, const JkPdfCropOptions *options, cairo_surface_t *surf, GError **error)
+{
+    g_autofree struct jkpdf_crop_bounds *bounds = jkpdf_crop_find_bounds(doc, options, NULL, error);
+    if (!bounds)
+        return FALSE;
+
+    return jkpdf_crop_render_document(doc, options, bounds, surf, error);
+}
@@ -14,7 +14,7 @@
 
 #pragma once
 
-#include "jkpdf-io.h"
+#include "jkpdf-document.h"
 
 #include <stdbool.h>
 #include <stdlib.h>
@@ -36,8 +36,13 @@ jkpdf_page_has_image(PopplerPage *page)
 }
 
 static inline bool
-jkpdf_document_has_image(PopplerDocument *doc)
+jkpdf_document_has_image(JkPdfDocument *jkdoc)
 {
+    // recorded pages are checked through their sources, see below
+    PopplerDocument *doc = jkpdf_document_get_poppler(jkdoc);
+    if (!doc)
+        return false;
+
     int n = poppler_document_get_n_pages(doc);
     for (int i = 0; i < n; ++i) {
         g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, i);
@@ -48,12 +53,33 @@ jkpdf_document_has_image(PopplerDocument *doc)
     return false;
 }
 
+// Pages recorded by an earlier stage of a pipeline keep the ids poppler gave
+// their images, so the documents they were rendered from count just as if
+// they had been opened by this tool.
+static inline void
+_jkpdf_collect_source_documents(JkPdfDocument *doc, GPtrArray *seen)
+{
+    for (guint i = 0; i < seen->len; ++i) {
+        if (g_ptr_array_index(seen, i) == doc)
+            return;
+    }
+
+    g_ptr_array_add(seen, doc);
+
+    for (guint i = 0; doc->keep_alive && i < doc->keep_alive->len; ++i)
+        _jkpdf_collect_source_documents(g_ptr_array_index(doc->keep_alive, i), seen);
+}
+
 static inline bool
-jkpdf_is_affected_by_bug104864(size_t doc_length, PopplerDocument **doc_list)
+jkpdf_is_affected_by_bug104864(size_t doc_length, JkPdfDocument **doc_list)
 {
+    g_autoptr(GPtrArray) seen = g_ptr_array_new();
+    for (size_t i = 0; i < doc_length; ++i)
+        _jkpdf_collect_source_documents(doc_list[i], seen);
+
     size_t count = 0;
-    for (size_t i = 0; i < doc_length; ++i) {
-        count += jkpdf_document_has_image(doc_list[i]);
+    for (guint i = 0; i < seen->len; ++i) {
+        count += jkpdf_document_has_image(g_ptr_array_index(seen, i));
         if (count > 1) {
             return true;
         }
@@ -63,7 +89,7 @@ jkpdf_is_affected_by_bug104864(size_t doc_length, PopplerDocument **doc_list)
 }
 
 static inline void
-jkpdf_warn_bug104864(size_t doc_length, PopplerDocument **doc_list)
+jkpdf_warn_bug104864(size_t doc_length, JkPdfDocument **doc_list)
 {
     // TODO: version-guard this once it is fixed in poppler
 
@@ -72,4 +98,5 @@ jkpdf_warn_bug104864(size_t doc_length, PopplerDocument **doc_list)
 
     fprintf(stderr, "WARN: you are affected by poppler bug 104864. The output may be incorrect.\n");
     fprintf(stderr, "WARN: see https://gitlab.freedesktop.org/poppler/poppler/issues/371\n");
+    fprintf(stderr, "WARN: use --isolate to render every input in a separate process\n");
 }
@@ -0,0 +1,1010 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include "jkpdf-io.h"
+#include "jkpdf-geometry.h"
+#include "jkpdf-image.h"
+
+#include <cairo-script-interpreter.h>
+#include <math.h>
+
+// Input documents
+//
+// A document is either a PDF file parsed by poppler, an image file (see
+// jkpdf-image.h), or a list of pages recorded by a previous tool running in
+// the same process (see jkpdftool.c) or read from CairoScript written by a
+// previous tool.
+// Tools only get to see page sizes and can render pages onto a cairo context,
+// which works the same for all of them. Page sizes come from an index (see
+// jkpdf-geometry.h), poppler pages are only created for rendering.
+
+typedef struct {
+    cairo_surface_t *recording;
+    double width;
+    double height;
+    GMutex lock; // replaying a recording surface is not thread safe
+} JkPdfRecordedPage;
+
+typedef struct _JkPdfDocument JkPdfDocument;
+
+// CairoScript read from a pipe, see jkpdf_document_new_for_script_stream().
+// The interpreter thread and the thread using the document take turns:
+// pages are only added while the other one waits for them.
+typedef struct {
+    GMutex lock;
+    GCond cond;
+    GThread *thread;
+
+    int fd;
+    guint8 peek[16]; // read before we knew it was CairoScript
+    gsize peek_len;
+    gsize peek_pos;
+
+    int wanted;         // pages to read before pausing
+    gboolean cancelled; // document is gone, stop reading
+    gboolean done;
+    cairo_status_t status;
+} JkPdfScriptStream;
+
+struct _JkPdfDocument {
+    gint ref_count;
+
+    PopplerDocument *poppler; // NULL for recorded documents, or while closed
+    GPtrArray *recorded_pages; // NULL for PDF documents
+    int n_pages;
+    JkPdfScriptStream *stream; // NULL unless still reading recorded pages
+    JkPdfImage *image;         // NULL unless an image file, the only page
+    GError *render_error;      // first page that could not be drawn
+
+    // Objects which must outlive the recorded pages, e.g. the documents
+    // they were rendered from (cairo fonts are owned by poppler)
+    GPtrArray *keep_alive;
+
+    // To close and reopen PDF documents, see JKPDF_MAX_DOCUMENTS
+    GBytes *bytes;        // NULL if the document cannot be reopened
+    int has_type3_fonts;  // -1 if not checked yet
+    double image_pixels;  // per page on average, -1 if not scanned yet
+    GQueue *resident;     // open documents of the thread using this one
+    GList *resident_link;
+
+    // Page sizes of PDF documents, see jkpdf-geometry.h
+    GBytes *geometry;       // NULL until first needed
+};
+
+typedef struct {
+    JkPdfDocument *doc;
+    int index;
+    PopplerPage *poppler; // NULL for recorded pages, or until rendered
+} JkPdfPage;
+
+static inline void
+_jkpdf_recorded_page_free(gpointer data)
+{
+    JkPdfRecordedPage *page = data;
+
+    cairo_surface_destroy(page->recording);
+    g_mutex_clear(&page->lock);
+    g_free(page);
+}
+
+// Open documents, most recently used first, per thread
+static inline void
+_jkpdf_resident_documents_free(gpointer data)
+{
+    GQueue *queue = data;
+
+    for (GList *l = queue->head; l; l = l->next) {
+        JkPdfDocument *doc = l->data;
+        doc->resident = NULL;
+        doc->resident_link = NULL;
+    }
+
+    g_queue_free(queue);
+}
+
+static GPrivate _jkpdf_resident_documents = G_PRIVATE_INIT(_jkpdf_resident_documents_free);
+
+static inline JkPdfDocument *
+jkpdf_document_ref(JkPdfDocument *doc)
+{
+    g_atomic_int_inc(&doc->ref_count);
+    return doc;
+}
+
+static inline void
+jkpdf_document_unref(JkPdfDocument *doc)
+{
+    if (!doc || !g_atomic_int_dec_and_test(&doc->ref_count))
+        return;
+
+    if (doc->resident_link)
+        g_queue_delete_link(doc->resident, doc->resident_link);
+
+    if (doc->stream) {
+        g_mutex_lock(&doc->stream->lock);
+        doc->stream->cancelled = TRUE;
+        doc->stream->wanted = G_MAXINT;
+        g_cond_broadcast(&doc->stream->cond);
+        g_mutex_unlock(&doc->stream->lock);
+
+        g_thread_join(doc->stream->thread);
+        g_mutex_clear(&doc->stream->lock);
+        g_cond_clear(&doc->stream->cond);
+        g_clear_pointer(&doc->stream, g_free);
+    }
+
+    // pages first, they might reference the documents kept alive
+    g_clear_pointer(&doc->recorded_pages, g_ptr_array_unref);
+    g_clear_pointer(&doc->keep_alive, g_ptr_array_unref);
+    g_clear_pointer(&doc->image, jkpdf_image_free);
+    g_clear_error(&doc->render_error);
+    g_clear_object(&doc->poppler);
+    g_clear_pointer(&doc->bytes, g_bytes_unref);
+    g_clear_pointer(&doc->geometry, g_bytes_unref);
+    g_free(doc);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(JkPdfDocument, jkpdf_document_unref)
+
+static inline JkPdfDocument *
+jkpdf_document_new_for_poppler(PopplerDocument *poppler)
+{
+    JkPdfDocument *doc = g_new0(JkPdfDocument, 1);
+    doc->ref_count = 1;
+    doc->poppler = poppler;
+    doc->n_pages = poppler_document_get_n_pages(poppler);
+    doc->keep_alive = g_ptr_array_new_with_free_func((GDestroyNotify)jkpdf_document_unref);
+    doc->has_type3_fonts = -1;
+    doc->image_pixels = -1;
+
+    GBytes *bytes = g_object_get_data(G_OBJECT(poppler), "jkpdf-bytes");
+    if (bytes)
+        doc->bytes = g_bytes_ref(bytes);
+
+    return doc;
+}
+
+static inline JkPdfDocument *
+jkpdf_document_new_recorded(void)
+{
+    JkPdfDocument *doc = g_new0(JkPdfDocument, 1);
+    doc->ref_count = 1;
+    doc->recorded_pages = g_ptr_array_new_with_free_func(_jkpdf_recorded_page_free);
+    doc->keep_alive = g_ptr_array_new_with_free_func((GDestroyNotify)jkpdf_document_unref);
+
+    return doc;
+}
+
+// Takes ownership of the recording surface
+static inline void
+jkpdf_document_add_recorded_page(JkPdfDocument *doc, cairo_surface_t *recording, double width, double height)
+{
+    g_return_if_fail(doc->recorded_pages != NULL);
+
+    JkPdfRecordedPage *page = g_new0(JkPdfRecordedPage, 1);
+    page->recording = recording;
+    page->width = width;
+    page->height = height;
+    g_mutex_init(&page->lock);
+
+    g_ptr_array_add(doc->recorded_pages, page);
+}
+
+static inline void
+jkpdf_document_keep_alive(JkPdfDocument *doc, JkPdfDocument *other)
+{
+    if (doc != other)
+        g_ptr_array_add(doc->keep_alive, jkpdf_document_ref(other));
+}
+
+// Waits until page index has been read from a CairoScript stream, or the
+// stream has ended. Returns whether the page exists.
+static inline gboolean
+jkpdf_document_wait_for_page(JkPdfDocument *doc, int index)
+{
+    if (!doc->stream)
+        return index < (doc->recorded_pages ? (int)doc->recorded_pages->len : doc->n_pages);
+
+    JkPdfScriptStream *stream = doc->stream;
+
+    g_mutex_lock(&stream->lock);
+    if ((int)doc->recorded_pages->len <= index && !stream->done) {
+        stream->wanted = MAX(stream->wanted, index == G_MAXINT ? G_MAXINT : index + 1);
+        g_cond_broadcast(&stream->cond);
+
+        while ((int)doc->recorded_pages->len <= index && !stream->done)
+            g_cond_wait(&stream->cond, &stream->lock);
+    }
+    gboolean done = stream->done;
+    cairo_status_t status = stream->status;
+    int len = (int)doc->recorded_pages->len;
+    g_mutex_unlock(&stream->lock);
+
+    if (done && status) {
+        g_autoptr(GError) error = g_error_new(JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "could not read CairoScript: %s", cairo_status_to_string(status));
+        jkpdf_exit_with_error(error);
+    }
+
+    if (done && len < 1) {
+        g_autoptr(GError) error = g_error_new(JKPDF_ERROR, JKPDF_ERROR_NO_PAGES, "input CairoScript has no pages");
+        jkpdf_exit_with_error(error);
+    }
+
+    return index < len;
+}
+
+// Whether pages are still being read, see jkpdf_document_wait_for_page()
+static inline gboolean
+jkpdf_document_is_streaming(JkPdfDocument *doc)
+{
+    if (!doc->stream)
+        return FALSE;
+
+    g_mutex_lock(&doc->stream->lock);
+    gboolean done = doc->stream->done;
+    g_mutex_unlock(&doc->stream->lock);
+
+    return !done;
+}
+
+// Reads all of a CairoScript stream
+static inline int
+jkpdf_document_get_n_pages(JkPdfDocument *doc)
+{
+    if (doc->stream)
+        jkpdf_document_wait_for_page(doc, G_MAXINT);
+
+    if (doc->recorded_pages)
+        return (int)doc->recorded_pages->len;
+    else
+        return doc->n_pages;
+}
+
+// Whether the page exists, without waiting for the rest of a stream
+static inline gboolean
+_jkpdf_document_has_page(JkPdfDocument *doc, int index)
+{
+    if (!doc->stream)
+        return index >= 0 && index < jkpdf_document_get_n_pages(doc);
+
+    g_mutex_lock(&doc->stream->lock);
+    gboolean has_page = index >= 0 && index < (int)doc->recorded_pages->len;
+    g_mutex_unlock(&doc->stream->lock);
+
+    return has_page;
+}
+
+// The stream thread may be adding pages meanwhile, which moves the array
+static inline JkPdfRecordedPage *
+_jkpdf_document_get_recorded_page(JkPdfDocument *doc, int index)
+{
+    if (doc->stream)
+        g_mutex_lock(&doc->stream->lock);
+
+    JkPdfRecordedPage *rec = g_ptr_array_index(doc->recorded_pages, (guint)index);
+
+    if (doc->stream)
+        g_mutex_unlock(&doc->stream->lock);
+
+    return rec;
+}
+
+// Whether the document is backed by poppler
+static inline gboolean
+jkpdf_document_is_pdf(JkPdfDocument *doc)
+{
+    return !doc->recorded_pages && !doc->image;
+}
+
+static inline gboolean
+jkpdf_document_can_duplicate(JkPdfDocument *doc)
+{
+    return doc->recorded_pages || doc->image || doc->bytes;
+}
+
+// Type 3 glyphs are drawn by poppler whenever cairo needs them, which may be
+// long after the page has been rendered (PDF output embeds the fonts when
+// the surface is finished). Documents using them must stay open.
+static inline gboolean
+_jkpdf_poppler_has_type3_fonts(PopplerDocument *poppler)
+{
+    PopplerFontInfo *info = poppler_font_info_new(poppler);
+    PopplerFontsIter *iter = NULL;
+    gboolean found = FALSE;
+
+    while (!found && poppler_font_info_scan(info, 64, &iter)) {
+        if (!iter)
+            continue; // no fonts on these pages
+
+        do {
+            if (poppler_fonts_iter_get_font_type(iter) == POPPLER_FONT_TYPE_TYPE3)
+                found = TRUE;
+        } while (!found && poppler_fonts_iter_next(iter));
+
+        g_clear_pointer(&iter, poppler_fonts_iter_free);
+    }
+
+    g_clear_pointer(&iter, poppler_fonts_iter_free);
+    poppler_font_info_free(info);
+
+    return found;
+}
+
+// Marks the document as most recently used and closes the least recently
+// used ones beyond JKPDF_MAX_DOCUMENTS
+static inline void
+_jkpdf_document_touch(JkPdfDocument *doc)
+{
+    int max_docs = jkpdf_max_resident_documents();
+    if (max_docs <= 0 || !doc->bytes || doc->has_type3_fonts > 0)
+        return;
+
+    GQueue *queue = g_private_get(&_jkpdf_resident_documents);
+    if (!queue) {
+        queue = g_queue_new();
+        g_private_set(&_jkpdf_resident_documents, queue);
+    }
+
+    if (doc->resident_link) {
+        // documents are used by one thread at a time, but stay in the
+        // queue of the first one
+        if (doc->resident == queue) {
+            g_queue_unlink(queue, doc->resident_link);
+            g_queue_push_head_link(queue, doc->resident_link);
+        }
+    } else {
+        g_queue_push_head(queue, doc);
+        doc->resident = queue;
+        doc->resident_link = queue->head;
+    }
+
+    while (g_queue_get_length(queue) > (guint)max_docs) {
+        JkPdfDocument *old = g_queue_pop_tail(queue);
+        old->resident = NULL;
+        old->resident_link = NULL;
+
+        if (old->has_type3_fonts < 0)
+            old->has_type3_fonts = _jkpdf_poppler_has_type3_fonts(old->poppler);
+
+        if (old->has_type3_fonts)
+            continue; // never closed, and no longer counted either
+
+        if (jkpdf_verbose())
+            fprintf(stderr, "INFO: closing document %p until it is needed again\n", (void *)old);
+
+        g_clear_object(&old->poppler);
+    }
+}
+
+// Returns the poppler document, reopening it if necessary, or NULL for
+// recorded documents and images
+static inline PopplerDocument *
+jkpdf_document_get_poppler(JkPdfDocument *doc)
+{
+    if (!jkpdf_document_is_pdf(doc))
+        return NULL;
+
+    if (!doc->poppler) {
+        g_autoptr(GError) error = NULL;
+        doc->poppler = jkpdf_poppler_document_new_from_bytes(doc->bytes, &error);
+        if (!doc->poppler) {
+            fprintf(stderr, "WTF: could not reopen document: %s\n", error->message);
+            exit(1);
+        }
+    }
+
+    _jkpdf_document_touch(doc);
+
+    return doc->poppler;
+}
+
+// Returns a copy of the document which can be used on another thread
+static inline JkPdfDocument *
+jkpdf_document_duplicate(JkPdfDocument *doc)
+{
+    if (doc->recorded_pages) {
+        // recorded pages are locked while replaying, but a stream must not
+        // add any in the meantime
+        jkpdf_document_get_n_pages(doc);
+        return jkpdf_document_ref(doc);
+    }
+
+    if (doc->image)
+        return jkpdf_document_ref(doc); // decoded anew for every rendering
+
+    // opened on first use, see jkpdf_document_get_poppler()
+    JkPdfDocument *copy = g_new0(JkPdfDocument, 1);
+    copy->ref_count = 1;
+    copy->n_pages = doc->n_pages;
+    copy->keep_alive = g_ptr_array_new_with_free_func((GDestroyNotify)jkpdf_document_unref);
+    copy->bytes = g_bytes_ref(doc->bytes);
+    copy->has_type3_fonts = doc->has_type3_fonts;
+    copy->image_pixels = doc->image_pixels;
+    if (doc->geometry)
+        copy->geometry = g_bytes_ref(doc->geometry);
+
+    return copy;
+}
+
+// Returns the geometry index of a PDF document, building it if necessary.
+// Not thread safe: copies share the index only if it exists when they are
+// made, so build it before handing copies to other threads.
+static inline const JkPdfPageGeometry *
+jkpdf_document_get_geometry(JkPdfDocument *doc)
+{
+    g_return_val_if_fail(jkpdf_document_is_pdf(doc), NULL);
+
+    if (doc->geometry)
+        return g_bytes_get_data(doc->geometry, NULL);
+
+    PopplerDocument *poppler = jkpdf_document_get_poppler(doc);
+    g_autofree gchar *cache = doc->bytes ? jkpdf_geometry_cache_path(poppler, doc->bytes) : NULL;
+
+    if (cache)
+        doc->geometry = jkpdf_geometry_load(cache, doc->n_pages);
+
+    if (!doc->geometry) {
+        doc->geometry = jkpdf_geometry_build(poppler);
+
+        if (cache)
+            jkpdf_geometry_save(cache, doc->geometry);
+    }
+
+    return g_bytes_get_data(doc->geometry, NULL);
+}
+
+static inline void
+jkpdf_document_get_page_size(JkPdfDocument *doc, int index, double *width, double *height)
+{
+    g_return_if_fail(_jkpdf_document_has_page(doc, index));
+
+    if (doc->recorded_pages) {
+        JkPdfRecordedPage *rec = _jkpdf_document_get_recorded_page(doc, index);
+        *width = rec->width;
+        *height = rec->height;
+    } else if (doc->image) {
+        *width = doc->image->page_width;
+        *height = doc->image->page_height;
+    } else {
+        const JkPdfPageGeometry *geometry = jkpdf_document_get_geometry(doc);
+        *width = geometry[index].width;
+        *height = geometry[index].height;
+    }
+}
+
+#define JKPDF_IMAGE_COST_FACTOR 4.0 // a page covered by images, relative to an empty one
+#define JKPDF_IMAGE_COST_DPI    150.0 // resolution of "covered"
+
+// Returns the value of the integer entry key in the PDF dictionary text
+// [start, end), or -1 if it is missing or an indirect reference
+static inline gint64
+_jkpdf_pdf_dict_int(const char *start, const char *end, const char *key)
+{
+    gsize key_len = strlen(key);
+
+    for (const char *p = start; (p = memmem(p, (gsize)(end - p), key, key_len)); p += key_len) {
+        const char *v = p + key_len;
+        if (v < end && (g_ascii_isalnum(*v) || *v == '_'))
+            continue; // a longer name
+
+        while (v < end && g_ascii_isspace(*v))
+            v++;
+
+        gint64 n = 0;
+        const char *digits = v;
+        while (v < end && g_ascii_isdigit(*v) && n < G_MAXINT32)
+            n = n * 10 + (*v++ - '0');
+
+        while (v < end && g_ascii_isspace(*v))
+            v++;
+
+        if (v == digits || (v < end && g_ascii_isdigit(*v)))
+            return -1; // "/Width 12 0 R"
+        return n;
+    }
+
+    return -1;
+}
+
+// Returns the pixels of all images in a PDF file, without parsing it.
+// Images are streams, and streams never live in object streams, so their
+// dictionaries can be found as plain text in the file: between the "obj"
+// before "/Subtype /Image" and the "stream" after it. Images whose size is
+// an indirect reference are not counted.
+static inline double
+_jkpdf_pdf_scan_image_pixels(GBytes *bytes)
+{
+    gsize size = 0;
+    const char *data = g_bytes_get_data(bytes, &size);
+    const char *end = data + size;
+
+    double pixels = 0;
+    for (const char *p = data; (p = memmem(p, (gsize)(end - p), "/Image", 6)); p += 6) {
+        if (p + 6 < end && g_ascii_isalnum(p[6]))
+            continue; // e.g. /ImageC in a /ProcSet
+
+        const char *key = p;
+        while (key > data && g_ascii_isspace(key[-1]))
+            key--;
+        if (key - data < 8 || memcmp(key - 8, "/Subtype", 8))
+            continue;
+
+        const char *dict_start = p - MIN(4096, p - data);
+        for (const char *o = dict_start; (o = memmem(o, (gsize)(p - o), "obj", 3)); o += 3)
+            dict_start = o;
+
+        const char *dict_end = memmem(p, (gsize)MIN(4096, end - p), "stream", 6);
+        if (!dict_end)
+            continue;
+
+        gint64 width = _jkpdf_pdf_dict_int(dict_start, dict_end, "/Width");
+        gint64 height = _jkpdf_pdf_dict_int(dict_start, dict_end, "/Height");
+        if (width > 0 && height > 0)
+            pixels += (double)width * (double)height;
+    }
+
+    return pixels;
+}
+
+// Relative cost of rendering a page: 1 for the page itself, plus the image
+// pixels in multiples of the page at JKPDF_IMAGE_COST_DPI. Which page shows
+// which image is only known after interpreting the pages, so the pixels of
+// all images are spread over all pages evenly. Costs a single pass over
+// the file for the first page, and nothing for the others.
+static inline double
+jkpdf_document_estimate_page_cost(JkPdfDocument *doc, int index)
+{
+    if (doc->recorded_pages)
+        return 1.0; // no idea
+
+    if (doc->image)
+        return 1.0 + JKPDF_IMAGE_COST_FACTOR;
+
+    double w = 0, h = 0;
+    jkpdf_document_get_page_size(doc, index, &w, &h);
+
+    double cost = 1.0;
+    if (w <= 0 || h <= 0 || !doc->bytes)
+        return cost;
+
+    if (doc->image_pixels < 0)
+        doc->image_pixels = _jkpdf_pdf_scan_image_pixels(doc->bytes) / MAX(1, doc->n_pages);
+
+    double page_pixels = w * h * (JKPDF_IMAGE_COST_DPI / 72.0) * (JKPDF_IMAGE_COST_DPI / 72.0);
+    return cost + JKPDF_IMAGE_COST_FACTOR * doc->image_pixels / page_pixels;
+}
+
+static inline JkPdfPage *
+jkpdf_document_get_page(JkPdfDocument *doc, int index)
+{
+    if (!_jkpdf_document_has_page(doc, index))
+        return NULL;
+
+    JkPdfPage *page = g_new0(JkPdfPage, 1);
+    page->doc = jkpdf_document_ref(doc);
+    page->index = index;
+
+    return page;
+}
+
+static inline void
+jkpdf_page_free(JkPdfPage *page)
+{
+    g_clear_object(&page->poppler);
+    jkpdf_document_unref(page->doc);
+    g_free(page);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(JkPdfPage, jkpdf_page_free)
+
+static inline void
+jkpdf_page_get_size(JkPdfPage *page, double *width, double *height)
+{
+    jkpdf_document_get_page_size(page->doc, page->index, width, height);
+}
+
+// Errors are kept on the document for jkpdf_render_pages() to report
+static inline void
+jkpdf_page_render(JkPdfPage *page, cairo_t *cr)
+{
+    if (page->doc->image) {
+        // image documents are shared between threads, the first error wins
+        GError *error = NULL;
+        if (!jkpdf_image_render(page->doc->image, cr, &error) && !g_atomic_pointer_compare_and_exchange(&page->doc->render_error, NULL, error))
+            g_error_free(error);
+    } else if (!page->doc->recorded_pages) {
+        if (!page->poppler)
+            page->poppler = poppler_document_get_page(jkpdf_document_get_poppler(page->doc), page->index);
+
+        JKPDF_PROBE1(page_render_start, page->index);
+        poppler_page_render_for_printing(page->poppler, cr);
+        JKPDF_PROBE1(page_render_done, page->index);
+    } else {
+        JkPdfRecordedPage *rec = _jkpdf_document_get_recorded_page(page->doc, page->index);
+
+        g_mutex_lock(&rec->lock);
+        cairo_save(cr);
+        cairo_set_source_surface(cr, rec->recording, 0, 0);
+        cairo_paint(cr);
+        cairo_restore(cr);
+        g_mutex_unlock(&rec->lock);
+    }
+}
+
+// In-process pipelines
+//
+// The multicall binary implements these to pass pages from one tool to the
+// next without going through PDF. They are missing in the standalone tools.
+
+JkPdfDocument *jkpdf_pipeline_input(void) JKPDF_HOOK;
+JkPdfDocument *jkpdf_pipeline_sink(cairo_surface_t *surf) JKPDF_HOOK;
+gboolean       jkpdf_pipeline_passthrough(JkPdfDocument *doc) JKPDF_HOOK;
+
+// CairoScript input, see jkpdf_want_script_output()
+
+static inline cairo_surface_t *
+_jkpdf_script_surface_create(void *closure, cairo_content_t content, double width, double height, long uid)
+{
+    (void)closure; (void)uid;
+
+    cairo_rectangle_t extents = { 0, 0, width, height };
+    return cairo_recording_surface_create(content, &extents);
+}
+
+static inline void
+_jkpdf_script_show_page(void *closure, cairo_t *cr)
+{
+    JkPdfDocument *doc = closure;
+    cairo_surface_t *target = cairo_get_target(cr);
+
+    cairo_rectangle_t extents;
+    if (!cairo_recording_surface_get_extents(target, &extents)) {
+        fprintf(stderr, "WTF: CairoScript page without size\n");
+        exit(1);
+    }
+
+    if (!doc->stream) {
+        jkpdf_document_add_recorded_page(doc, cairo_surface_reference(target), extents.width, extents.height);
+        return;
+    }
+
+    // hand the page over and wait until it is used, the interpreter may be
+    // needed to draw its glyphs
+    JkPdfScriptStream *stream = doc->stream;
+
+    g_mutex_lock(&stream->lock);
+    jkpdf_document_add_recorded_page(doc, cairo_surface_reference(target), extents.width, extents.height);
+    g_cond_broadcast(&stream->cond);
+
+    while ((int)doc->recorded_pages->len >= stream->wanted)
+        g_cond_wait(&stream->cond, &stream->lock);
+    g_mutex_unlock(&stream->lock);
+}
+
+static inline gboolean
+jkpdf_bytes_are_script(GBytes *bytes)
+{
+    static const char magic[] = "%!CairoScript";
+
+    gsize len = 0;
+    const char *data = g_bytes_get_data(bytes, &len);
+
+    return len >= sizeof(magic) - 1 && !memcmp(data, magic, sizeof(magic) - 1);
+}
+
+static inline JkPdfDocument *
+jkpdf_document_new_for_script(GBytes *bytes, GError **error)
+{
+    JkPdfStats *stats = jkpdf_stats_current();
+    gint64 start = jkpdf_stats_now(stats);
+
+    g_autoptr(JkPdfDocument) doc = jkpdf_document_new_recorded();
+
+    csi_hooks_t hooks = { 0 };
+    hooks.closure = doc;
+    hooks.surface_create = _jkpdf_script_surface_create;
+    hooks.show_page = _jkpdf_script_show_page;
+
+    gsize len = 0;
+    const void *data = g_bytes_get_data(bytes, &len);
+
+    FILE *stream = fmemopen((void *)data, len, "r");
+    if (!stream) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "fmemopen(3) failed: %s", strerror(errno));
+        return NULL;
+    }
+
+    csi_t *csi = cairo_script_interpreter_create();
+    cairo_script_interpreter_install_hooks(csi, &hooks);
+
+    cairo_status_t status = cairo_script_interpreter_feed_stream(csi, stream);
+    if (!status)
+        status = cairo_script_interpreter_finish(csi);
+
+    // fonts created by the script keep the interpreter alive as needed
+    cairo_script_interpreter_destroy(csi);
+    fclose(stream);
+
+    if (status) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "could not read CairoScript: %s", cairo_status_to_string(status));
+        return NULL;
+    }
+
+    if (jkpdf_document_get_n_pages(doc) < 1) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_NO_PAGES, "input CairoScript has no pages");
+        return NULL;
+    }
+
+    jkpdf_stats_add_open(stats, start);
+
+    return g_steal_pointer(&doc);
+}
+
+static inline ssize_t
+_jkpdf_script_stream_read(void *cookie, char *buf, size_t size)
+{
+    JkPdfScriptStream *stream = cookie;
+
+    g_mutex_lock(&stream->lock);
+    gboolean cancelled = stream->cancelled;
+    g_mutex_unlock(&stream->lock);
+
+    if (cancelled)
+        return 0;
+
+    if (stream->peek_pos < stream->peek_len) {
+        size_t count = MIN(size, stream->peek_len - stream->peek_pos);
+        memcpy(buf, stream->peek + stream->peek_pos, count);
+        stream->peek_pos += count;
+        return (ssize_t)count;
+    }
+
+    ssize_t count;
+    do {
+        count = read(stream->fd, buf, size);
+    } while (count < 0 && errno == EINTR);
+
+    return count;
+}
+
+static inline gpointer
+_jkpdf_script_stream_thread(gpointer data)
+{
+    JkPdfDocument *doc = data;
+    JkPdfScriptStream *stream = doc->stream;
+
+    cairo_status_t status = CAIRO_STATUS_READ_ERROR;
+
+    cookie_io_functions_t io = { .read = _jkpdf_script_stream_read };
+    FILE *file = fopencookie(stream, "r", io);
+    if (file) {
+        csi_hooks_t hooks = { 0 };
+        hooks.closure = doc;
+        hooks.surface_create = _jkpdf_script_surface_create;
+        hooks.show_page = _jkpdf_script_show_page;
+
+        csi_t *csi = cairo_script_interpreter_create();
+        cairo_script_interpreter_install_hooks(csi, &hooks);
+
+        status = cairo_script_interpreter_feed_stream(csi, file);
+        if (!status)
+            status = cairo_script_interpreter_finish(csi);
+
+        cairo_script_interpreter_destroy(csi);
+        fclose(file);
+    }
+
+    g_mutex_lock(&stream->lock);
+    stream->status = stream->cancelled ? CAIRO_STATUS_SUCCESS : status;
+    stream->done = TRUE;
+    g_cond_broadcast(&stream->cond);
+    g_mutex_unlock(&stream->lock);
+
+    return NULL;
+}
+
+// Reads CairoScript from fd while the document is already in use, so that
+// tools can work on each page as soon as it arrives. peek is what has
+// already been read from fd. Pages are only read when asked for by
+// jkpdf_document_wait_for_page(), and only one thread may use the document
+// until all of them have been read.
+static inline JkPdfDocument *
+jkpdf_document_new_for_script_stream(int fd, const guint8 *peek, gsize peek_len)
+{
+    g_return_val_if_fail(peek_len <= sizeof(((JkPdfScriptStream *)NULL)->peek), NULL);
+
+    JkPdfDocument *doc = jkpdf_document_new_recorded();
+
+    JkPdfScriptStream *stream = g_new0(JkPdfScriptStream, 1);
+    g_mutex_init(&stream->lock);
+    g_cond_init(&stream->cond);
+    stream->fd = fd;
+    memcpy(stream->peek, peek, peek_len);
+    stream->peek_len = peek_len;
+    stream->wanted = 1;
+
+    doc->stream = stream;
+    stream->thread = g_thread_new("jkpdf-script", _jkpdf_script_stream_thread, doc);
+
+    return doc;
+}
+
+static inline JkPdfDocument *
+jkpdf_document_new_for_image(GBytes *bytes, GError **error)
+{
+    JkPdfImage *image = jkpdf_image_new_from_bytes(bytes, error);
+    if (!image)
+        return NULL;
+
+    JkPdfDocument *doc = g_new0(JkPdfDocument, 1);
+    doc->ref_count = 1;
+    doc->image = image;
+    doc->n_pages = 1;
+    doc->keep_alive = g_ptr_array_new_with_free_func((GDestroyNotify)jkpdf_document_unref);
+
+    return doc;
+}
+
+// Opens PDF, CairoScript or an image, whichever it is
+static inline JkPdfDocument *
+jkpdf_document_new_from_bytes(GBytes *bytes, GError **error)
+{
+    if (jkpdf_bytes_are_script(bytes))
+        return jkpdf_document_new_for_script(bytes, error);
+
+    if (jkpdf_bytes_are_image(bytes))
+        return jkpdf_document_new_for_image(bytes, error);
+
+    PopplerDocument *poppler = jkpdf_poppler_document_new_from_bytes(bytes, error);
+    if (!poppler)
+        return NULL;
+
+    return jkpdf_document_new_for_poppler(poppler);
+}
+
+// Document cache of jkpdftool-server. Returns NULL if the document should
+// be opened normally. Missing outside of the server.
+JkPdfDocument *jkpdf_document_cache_open(GBytes *bytes) JKPDF_HOOK;
+
+static inline JkPdfDocument *
+jkpdf_create_document_from_bytes(GBytes *bytes)
+{
+    if (jkpdf_document_cache_open) {
+        JkPdfDocument *doc = jkpdf_document_cache_open(bytes);
+        if (doc)
+            return doc;
+    }
+
+    g_autoptr(GError) error = NULL;
+    JkPdfDocument *doc = jkpdf_document_new_from_bytes(bytes, &error);
+    if (!doc)
+        jkpdf_exit_with_error(error);
+
+    return doc;
+}
+
+static inline JkPdfDocument *
+jkpdf_create_document_for_stdin(void)
+{
+    if (jkpdf_pipeline_input) {
+        JkPdfDocument *doc = jkpdf_pipeline_input();
+        if (doc)
+            return doc;
+    }
+
+    jkpdf_check_stdin();
+
+    struct stat st;
+    gboolean have_stat = fstat(0, &st) == 0;
+
+    g_autoptr(GBytes) bytes = NULL;
+    if (have_stat && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode))) {
+        // CairoScript from a previous tool is used while it is still being
+        // written. PDF needs all of it, poppler cannot do without the xref
+        // table at the end (not even for linearized files).
+        static const char magic[] = "%!CairoScript";
+        guint8 peek[sizeof(magic) - 1];
+        gsize peek_len = 0;
+
+        while (peek_len < sizeof(peek)) {
+            ssize_t count = read(0, peek + peek_len, sizeof(peek) - peek_len);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count < 0) {
+                perror("ERROR: while reading stdin");
+                exit(1);
+            }
+            if (count == 0)
+                break;
+
+            peek_len += (gsize)count;
+        }
+
+        if (peek_len == sizeof(peek) && !memcmp(peek, magic, sizeof(peek)))
+            return jkpdf_document_new_for_script_stream(0, peek, peek_len);
+
+        bytes = _jkpdf_read_spooled(0, peek, peek_len);
+    } else {
+        bytes = jkpdf_read_fd(0);
+    }
+
+    return jkpdf_create_document_from_bytes(bytes);
+}
+
+static inline JkPdfDocument *
+jkpdf_create_document_for_commandline_arg(const char *arg)
+{
+    g_autoptr(GBytes) bytes = jkpdf_read_commandline_arg(arg);
+
+    return jkpdf_create_document_from_bytes(bytes);
+}
+
+// Returns the document collecting the pages drawn to surf, if the output
+// goes to the next tool in the pipeline instead of being written as PDF.
+static inline JkPdfDocument *
+jkpdf_get_page_sink(cairo_surface_t *surf)
+{
+    if (jkpdf_pipeline_sink)
+        return jkpdf_pipeline_sink(surf);
+
+    return NULL;
+}
+
+// Passthrough
+//
+// Tools which find that they would not change a single page hand their input
+// on as it is, instead of rendering all pages and encoding every font and
+// image again. In an in-process pipeline, the next tool gets the document
+// itself. Otherwise, PDF input is written to stdout byte for byte, straight
+// from the mapped input (vmsplice'd when stdout is a pipe). Either way, an
+// INFO line says so. Returns FALSE if the pages have to be rendered after
+// all: for pages read as CairoScript or from an earlier tool in the same
+// process, and with JKPDF_OUTPUT_FORMAT=script, which promises CairoScript.
+static inline gboolean
+jkpdf_passthrough(JkPdfDocument *doc)
+{
+    if (jkpdf_pipeline_passthrough && jkpdf_pipeline_passthrough(doc)) {
+        fprintf(stderr, "INFO: no page changed, passing the input on in memory\n");
+        return TRUE;
+    }
+
+    if (doc->recorded_pages || !doc->bytes || jkpdf_preview.page || jkpdf_estimate || jkpdf_want_script_output())
+        return FALSE;
+
+    if (isatty(1)) {
+        fprintf(stderr, "ERROR: refusing to write PDF to terminal\n");
+        exit(1);
+    }
+
+    gsize len = 0;
+    const guint8 *data = g_bytes_get_data(doc->bytes, &len);
+
+    struct stat st;
+    gboolean use_vmsplice = fstat(1, &st) == 0 && S_ISFIFO(st.st_mode);
+
+    int err = _jkpdf_write_all(1, data, len, &use_vmsplice);
+    if (err) {
+        fprintf(stderr, "ERROR: while writing output: %s\n", g_strerror(err));
+        exit(1);
+    }
+
+    fprintf(stderr, "INFO: no page changed, copied %" G_GSIZE_FORMAT " bytes of input to output\n", len);
+
+    jkpdf_stats_add_output(jkpdf_stats_current(), len, 0);
+    jkpdf_stats_report(jkpdf_stats_current());
+
+    return TRUE;
+}
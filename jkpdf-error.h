@@ -0,0 +1,33 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <glib.h>
+
+// Errors reported by libjkpdf, see jkpdf.h
+
+#define JKPDF_ERROR jkpdf_error_quark()
+static inline GQuark jkpdf_error_quark(void)
+{
+    return g_quark_from_static_string("jkpdf-error-quark");
+}
+
+typedef enum {
+    JKPDF_ERROR_INVALID_INPUT,   // not a PDF file or otherwise unreadable
+    JKPDF_ERROR_NO_PAGES,        // input has no pages
+    JKPDF_ERROR_INVALID_OPTIONS, // options make no sense for this input
+    JKPDF_ERROR_OUTPUT           // cairo failed to produce the output
+} JkPdfError;
@@ -0,0 +1,200 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include "jkpdf-io.h"
+
+#include <math.h>
+
+// Page geometry index
+//
+// Tools need page sizes all the time, for layout and long before rendering.
+// Asking poppler means creating a PopplerPage every time, so every PDF
+// document gets a packed array of its page geometry instead, built in a
+// single pass when first needed and shared by all copies of the document.
+//
+// With JKPDF_GEOMETRY_CACHE set to a directory, the index of every input is
+// also stored there, keyed by the document ID from the trailer and the file
+// size, or by a hash of the contents for files without an ID. The next tool
+// reading the same document, from a file, a pipe or a previous stage, then
+// skips the pass entirely. Only the JKPDF_GEOMETRY_CACHE_ENTRIES most
+// recently used entries are kept.
+
+typedef struct {
+    double width;  // as displayed, like poppler_page_get_size()
+    double height;
+    PopplerRectangle crop_box;
+    gint32 rotation; // 0 or 90, see jkpdf_geometry_build()
+    gint32 padding;
+} JkPdfPageGeometry;
+
+#define JKPDF_GEOMETRY_MAGIC "JKGEOM02"
+#define JKPDF_GEOMETRY_CACHE_ENTRIES 1000
+
+typedef struct {
+    char    magic[8];
+    guint32 n_pages;
+    guint32 entry_size;
+} JkPdfGeometryHeader;
+
+static inline GBytes *
+jkpdf_geometry_build(PopplerDocument *poppler)
+{
+    int n_pages = poppler_document_get_n_pages(poppler);
+    JkPdfPageGeometry *geometry = g_new0(JkPdfPageGeometry, n_pages);
+
+    for (int i = 0; i < n_pages; ++i) {
+        g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(poppler, i);
+
+        poppler_page_get_size(page, &geometry[i].width, &geometry[i].height);
+        poppler_page_get_crop_box(page, &geometry[i].crop_box);
+
+        // poppler-glib does not tell /Rotate, only whether the displayed
+        // size is the crop box turned sideways (90 or 270 degrees)
+        double crop_width = fabs(geometry[i].crop_box.x2 - geometry[i].crop_box.x1);
+        double crop_height = fabs(geometry[i].crop_box.y2 - geometry[i].crop_box.y1);
+        if (crop_width != crop_height && (crop_width > crop_height) != (geometry[i].width > geometry[i].height))
+            geometry[i].rotation = 90;
+    }
+
+    return g_bytes_new_take(geometry, sizeof(JkPdfPageGeometry) * (gsize)n_pages);
+}
+
+// Returns the cache file for the index of a document, or NULL
+static inline gchar *
+jkpdf_geometry_cache_path(PopplerDocument *poppler, GBytes *bytes)
+{
+    const char *dir = g_getenv("JKPDF_GEOMETRY_CACHE");
+    if (!dir || !*dir)
+        return NULL;
+
+    gsize size = 0;
+    const guchar *data = g_bytes_get_data(bytes, &size);
+    guint64 size64 = size;
+
+    g_autoptr(GChecksum) checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, (const guchar *)&size64, sizeof(size64));
+
+    // a writer changing the document must change the second ID, so the
+    // IDs and the size are as good as the contents and much cheaper
+    g_autofree gchar *permanent_id = NULL;
+    g_autofree gchar *update_id = NULL;
+    if (poppler_document_get_id(poppler, &permanent_id, &update_id)) {
+        g_checksum_update(checksum, (const guchar *)permanent_id, 32);
+        g_checksum_update(checksum, (const guchar *)update_id, 32);
+    } else {
+        g_checksum_update(checksum, data, (gssize)size);
+    }
+
+    g_autofree gchar *name = g_strdup_printf("%s.geom", g_checksum_get_string(checksum));
+
+    return g_build_filename(dir, name, NULL);
+}
+
+// Removes the least recently used entries beyond JKPDF_GEOMETRY_CACHE_ENTRIES
+static inline void
+_jkpdf_geometry_cache_trim(const char *dir)
+{
+    g_autoptr(GDir) d = g_dir_open(dir, 0, NULL);
+    if (!d)
+        return;
+
+    g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+    g_autoptr(GArray) times = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+    const char *name;
+    while ((name = g_dir_read_name(d))) {
+        if (!g_str_has_suffix(name, ".geom"))
+            continue;
+
+        gchar *path = g_build_filename(dir, name, NULL);
+        struct stat st;
+        if (stat(path, &st) < 0) {
+            g_free(path);
+            continue;
+        }
+
+        gint64 mtime = (gint64)st.st_mtim.tv_sec * G_USEC_PER_SEC + st.st_mtim.tv_nsec / 1000;
+        g_ptr_array_add(paths, path);
+        g_array_append_val(times, mtime);
+    }
+
+    while (paths->len > JKPDF_GEOMETRY_CACHE_ENTRIES) {
+        guint oldest = 0;
+        for (guint i = 1; i < times->len; ++i) {
+            if (g_array_index(times, gint64, i) < g_array_index(times, gint64, oldest))
+                oldest = i;
+        }
+
+        (void)unlink(g_ptr_array_index(paths, oldest));
+        g_ptr_array_remove_index_fast(paths, oldest);
+        g_array_remove_index_fast(times, oldest);
+    }
+}
+
+static inline GBytes *
+jkpdf_geometry_load(const char *path, int n_pages)
+{
+    gchar *contents = NULL;
+    gsize len = 0;
+    if (!g_file_get_contents(path, &contents, &len, NULL))
+        return NULL;
+
+    g_autoptr(GBytes) file = g_bytes_new_take(contents, len);
+
+    JkPdfGeometryHeader header;
+    gsize data_len = sizeof(JkPdfPageGeometry) * (gsize)n_pages;
+    if (len != sizeof(header) + data_len)
+        return NULL;
+
+    memcpy(&header, contents, sizeof(header));
+    if (memcmp(header.magic, JKPDF_GEOMETRY_MAGIC, sizeof(header.magic))
+            || header.n_pages != (guint32)n_pages
+            || header.entry_size != sizeof(JkPdfPageGeometry))
+        return NULL;
+
+    if (jkpdf_verbose())
+        fprintf(stderr, "INFO: using page geometry from %s\n", path);
+
+    // the modification time tells which entries were used last
+    (void)utimensat(AT_FDCWD, path, NULL, 0);
+
+    return g_bytes_new_from_bytes(file, sizeof(header), data_len);
+}
+
+static inline void
+jkpdf_geometry_save(const char *path, GBytes *geometry)
+{
+    gsize data_len = 0;
+    const guint8 *data = g_bytes_get_data(geometry, &data_len);
+
+    JkPdfGeometryHeader header = { { 0 }, (guint32)(data_len / sizeof(JkPdfPageGeometry)), sizeof(JkPdfPageGeometry) };
+    memcpy(header.magic, JKPDF_GEOMETRY_MAGIC, sizeof(header.magic));
+
+    g_autoptr(GByteArray) contents = g_byte_array_sized_new((guint)(sizeof(header) + data_len));
+    g_byte_array_append(contents, (const guint8 *)&header, sizeof(header));
+    g_byte_array_append(contents, data, (guint)data_len);
+
+    // just a cache, a tool failing to write it is no reason to fail the tool
+    g_autoptr(GError) error = NULL;
+    if (!g_file_set_contents(path, (const gchar *)contents->data, contents->len, &error)) {
+        if (jkpdf_verbose())
+            fprintf(stderr, "INFO: could not write page geometry cache: %s\n", error->message);
+        return;
+    }
+
+    g_autofree gchar *dir = g_path_get_dirname(path);
+    _jkpdf_geometry_cache_trim(dir);
+}
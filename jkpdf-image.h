@@ -0,0 +1,407 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include "jkpdf-io.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+// Image input
+//
+// JPEG, PNG and TIFF files are documents with a single page showing the
+// image, so scans go straight into any tool without a conversion step. The
+// page size follows from the resolution stored in the file, unless
+// JKPDF_IMAGE_DPI is set (default 300 for files without one).
+//
+// Opening an image only reads the size and resolution from its headers
+// (JFIF or EXIF, PNG pHYs, TIFF tags). Images are decoded when the page is
+// rendered, not kept in memory. JPEG files are attached to the pixels as
+// CAIRO_MIME_TYPE_JPEG, so PDF output embeds the original file instead of
+// compressing the pixels again, and does not need them decoded at all.
+// EXIF orientation is ignored for the same reason.
+
+typedef struct {
+    GBytes *bytes;
+    int width;  // pixels
+    int height;
+    double page_width;  // points
+    double page_height;
+    gboolean is_jpeg;
+} JkPdfImage;
+
+static inline void
+jkpdf_image_free(JkPdfImage *image)
+{
+    if (!image)
+        return;
+
+    g_bytes_unref(image->bytes);
+    g_free(image);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(JkPdfImage, jkpdf_image_free)
+
+static inline gboolean
+_jkpdf_bytes_start_with(GBytes *bytes, const void *magic, gsize magic_len)
+{
+    gsize len = 0;
+    const guint8 *data = g_bytes_get_data(bytes, &len);
+
+    return len >= magic_len && !memcmp(data, magic, magic_len);
+}
+
+static inline gboolean
+_jkpdf_bytes_are_jpeg(GBytes *bytes)
+{
+    return _jkpdf_bytes_start_with(bytes, "\xff\xd8\xff", 3);
+}
+
+static inline gboolean
+jkpdf_bytes_are_image(GBytes *bytes)
+{
+    return _jkpdf_bytes_are_jpeg(bytes)
+        || _jkpdf_bytes_start_with(bytes, "\x89PNG\r\n\x1a\n", 8)
+        || _jkpdf_bytes_start_with(bytes, "II*\0", 4)
+        || _jkpdf_bytes_start_with(bytes, "MM\0*", 4);
+}
+
+// Returns the resolution from JKPDF_IMAGE_DPI, or 0 if not set
+static inline double
+_jkpdf_image_dpi_override(void)
+{
+    const char *env = g_getenv("JKPDF_IMAGE_DPI");
+    if (!env || !*env)
+        return 0.0;
+
+    char *end = NULL;
+    double dpi = g_ascii_strtod(env, &end);
+    if (*end || !(dpi > 0.0 && dpi <= 100000.0)) {
+        fprintf(stderr, "WARN: ignoring invalid JKPDF_IMAGE_DPI value '%s'\n", env);
+        return 0.0;
+    }
+
+    return dpi;
+}
+
+static inline void
+_jkpdf_image_size_prepared(GdkPixbufLoader *loader, int width, int height, gpointer user_data)
+{
+    (void)loader;
+
+    int *size = user_data;
+    size[0] = width;
+    size[1] = height;
+}
+
+// Feeds the image to a loader, stopping early once the size is known if
+// that is all we want. Returns the pixels, or NULL if stopped early.
+static inline GdkPixbuf *
+_jkpdf_image_load(GBytes *bytes, int *size, gboolean size_only, GError **error)
+{
+    g_autoptr(GdkPixbufLoader) loader = gdk_pixbuf_loader_new();
+    g_signal_connect(loader, "size-prepared", G_CALLBACK(_jkpdf_image_size_prepared), size);
+
+    gsize len = 0;
+    const guint8 *data = g_bytes_get_data(bytes, &len);
+
+    g_autoptr(GError) loader_error = NULL;
+    for (gsize pos = 0; pos < len; pos += 65536) {
+        if (!gdk_pixbuf_loader_write(loader, data + pos, MIN(65536, len - pos), &loader_error))
+            break;
+
+        if (size_only && size[0] > 0)
+            break;
+    }
+
+    // complains about the missing rest if stopped early
+    gboolean closed = gdk_pixbuf_loader_close(loader, loader_error ? NULL : &loader_error);
+
+    if (size_only && size[0] > 0)
+        return NULL;
+
+    GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+    if (!closed || !pixbuf) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "could not read image: %s", loader_error ? loader_error->message : "unknown error");
+        return NULL;
+    }
+
+    return g_object_ref(pixbuf);
+}
+
+static inline guint32
+_jkpdf_image_read_uint(const guint8 *p, int n, gboolean big_endian)
+{
+    guint32 value = 0;
+    for (int i = 0; i < n; ++i)
+        value |= (guint32)p[big_endian ? i : n - 1 - i] << (8 * (n - 1 - i));
+
+    return value;
+}
+
+static inline double
+_jkpdf_image_checked_dpi(double dpi)
+{
+    return dpi > 0.0 && dpi <= 100000.0 ? dpi : 0.0;
+}
+
+// Reads the size and resolution from a TIFF header, which is also how EXIF
+// data in JPEG files is stored. Missing values are left alone.
+static inline void
+_jkpdf_tiff_read_header(const guint8 *data, gsize len, int *size, double *dpi)
+{
+    if (len < 8 || (memcmp(data, "II*\0", 4) && memcmp(data, "MM\0*", 4)))
+        return;
+
+    gboolean be = data[0] == 'M';
+    guint32 ifd = _jkpdf_image_read_uint(data + 4, 4, be);
+    if (ifd > len - 2)
+        return;
+
+    double resolution[2] = { 0.0, 0.0 };
+    guint32 unit = 2; // inch
+
+    guint32 n_entries = _jkpdf_image_read_uint(data + ifd, 2, be);
+    for (guint32 i = 0; i < n_entries && ifd + 2 + (i + 1) * 12 <= len; ++i) {
+        const guint8 *entry = data + ifd + 2 + i * 12;
+        guint32 tag = _jkpdf_image_read_uint(entry, 2, be);
+        guint32 type = _jkpdf_image_read_uint(entry + 2, 2, be);
+
+        // SHORT and LONG values are stored in the entry itself
+        guint32 value = type == 3 ? _jkpdf_image_read_uint(entry + 8, 2, be)
+                                  : _jkpdf_image_read_uint(entry + 8, 4, be);
+
+        if (tag == 256 || tag == 257) {
+            size[tag - 256] = (int)MIN(value, G_MAXINT32);
+        } else if ((tag == 282 || tag == 283) && type == 5 && value <= len - 8) {
+            guint32 num = _jkpdf_image_read_uint(data + value, 4, be);
+            guint32 den = _jkpdf_image_read_uint(data + value + 4, 4, be);
+            if (den)
+                resolution[tag - 282] = (double)num / den;
+        } else if (tag == 296) {
+            unit = value;
+        }
+    }
+
+    if (unit == 2 || unit == 3) {
+        for (int i = 0; i < 2; ++i) {
+            if (resolution[i] > 0.0)
+                dpi[i] = _jkpdf_image_checked_dpi(unit == 3 ? resolution[i] * 2.54 : resolution[i]);
+        }
+    }
+}
+
+static inline void
+_jkpdf_jpeg_read_header(const guint8 *data, gsize len, int *size, double *dpi)
+{
+    double exif_dpi[2] = { 0.0, 0.0 };
+    int exif_size[2] = { 0, 0 };
+
+    gsize pos = 2;
+    while (pos + 4 <= len && data[pos] == 0xff) {
+        guint8 marker = data[pos + 1];
+        if (marker == 0xff) {
+            ++pos; // fill byte
+            continue;
+        }
+
+        gsize seg_len = _jkpdf_image_read_uint(data + pos + 2, 2, TRUE);
+        if (seg_len < 2 || pos + 2 + seg_len > len)
+            break;
+
+        const guint8 *seg = data + pos + 4;
+        seg_len -= 2;
+
+        if (marker == 0xe0 && seg_len >= 12 && !memcmp(seg, "JFIF\0", 5) && (seg[7] == 1 || seg[7] == 2)) {
+            double factor = seg[7] == 2 ? 2.54 : 1.0;
+            dpi[0] = _jkpdf_image_checked_dpi(_jkpdf_image_read_uint(seg + 8, 2, TRUE) * factor);
+            dpi[1] = _jkpdf_image_checked_dpi(_jkpdf_image_read_uint(seg + 10, 2, TRUE) * factor);
+        } else if (marker == 0xe1 && seg_len >= 6 && !memcmp(seg, "Exif\0\0", 6)) {
+            _jkpdf_tiff_read_header(seg + 6, seg_len - 6, exif_size, exif_dpi);
+        } else if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+            // start of frame, comes after all the metadata
+            if (seg_len >= 5) {
+                size[1] = (int)_jkpdf_image_read_uint(seg + 1, 2, TRUE);
+                size[0] = (int)_jkpdf_image_read_uint(seg + 3, 2, TRUE);
+            }
+            break;
+        }
+
+        pos += 2 + seg_len + 2;
+    }
+
+    if (dpi[0] <= 0.0 || dpi[1] <= 0.0) {
+        dpi[0] = exif_dpi[0];
+        dpi[1] = exif_dpi[1];
+    }
+}
+
+static inline void
+_jkpdf_png_read_header(const guint8 *data, gsize len, int *size, double *dpi)
+{
+    gsize pos = 8;
+    while (pos + 12 <= len) {
+        guint32 chunk_len = _jkpdf_image_read_uint(data + pos, 4, TRUE);
+        const guint8 *type = data + pos + 4;
+        const guint8 *chunk = data + pos + 8;
+        if (chunk_len > len - pos - 12 || !memcmp(type, "IDAT", 4))
+            break;
+
+        if (!memcmp(type, "IHDR", 4) && chunk_len >= 8) {
+            size[0] = (int)MIN(_jkpdf_image_read_uint(chunk, 4, TRUE), G_MAXINT32);
+            size[1] = (int)MIN(_jkpdf_image_read_uint(chunk + 4, 4, TRUE), G_MAXINT32);
+        } else if (!memcmp(type, "pHYs", 4) && chunk_len >= 9 && chunk[8] == 1) {
+            // pixels per metre
+            dpi[0] = _jkpdf_image_checked_dpi(_jkpdf_image_read_uint(chunk, 4, TRUE) * 0.0254);
+            dpi[1] = _jkpdf_image_checked_dpi(_jkpdf_image_read_uint(chunk + 4, 4, TRUE) * 0.0254);
+        }
+
+        pos += 12 + chunk_len;
+    }
+}
+
+// Reads the size and resolution from the file headers, without decoding
+// any pixels. Missing values are left alone.
+static inline void
+_jkpdf_image_read_header(GBytes *bytes, int *size, double *dpi)
+{
+    gsize len = 0;
+    const guint8 *data = g_bytes_get_data(bytes, &len);
+
+    if (_jkpdf_bytes_are_jpeg(bytes))
+        _jkpdf_jpeg_read_header(data, len, size, dpi);
+    else if (_jkpdf_bytes_start_with(bytes, "\x89PNG\r\n\x1a\n", 8))
+        _jkpdf_png_read_header(data, len, size, dpi);
+    else
+        _jkpdf_tiff_read_header(data, len, size, dpi);
+}
+
+static inline JkPdfImage *
+jkpdf_image_new_from_bytes(GBytes *bytes, GError **error)
+{
+    g_autoptr(JkPdfImage) image = g_new0(JkPdfImage, 1);
+    image->bytes = g_bytes_ref(bytes);
+    image->is_jpeg = _jkpdf_bytes_are_jpeg(bytes);
+
+    int size[2] = { 0, 0 };
+    double dpi[2] = { 0.0, 0.0 };
+    _jkpdf_image_read_header(bytes, size, dpi);
+
+    // gdk-pixbuf knows more format variants, but its TIFF loader decodes
+    // everything before telling the size
+    if (size[0] <= 0 || size[1] <= 0) {
+        size[0] = size[1] = 0;
+        g_autoptr(GError) load_error = NULL;
+        g_autoptr(GdkPixbuf) pixbuf = _jkpdf_image_load(bytes, size, TRUE, &load_error);
+        if (load_error) {
+            g_propagate_error(error, g_steal_pointer(&load_error));
+            return NULL;
+        }
+        if (pixbuf) {
+            size[0] = gdk_pixbuf_get_width(pixbuf);
+            size[1] = gdk_pixbuf_get_height(pixbuf);
+        }
+    }
+
+    double dpi_override = _jkpdf_image_dpi_override();
+    if (dpi_override > 0.0)
+        dpi[0] = dpi[1] = dpi_override;
+    else if (dpi[0] <= 0.0 || dpi[1] <= 0.0)
+        dpi[0] = dpi[1] = 300.0;
+
+    if (size[0] <= 0 || size[1] <= 0) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "image has no pixels");
+        return NULL;
+    }
+
+    image->width = size[0];
+    image->height = size[1];
+    image->page_width = image->width * 72.0 / dpi[0];
+    image->page_height = image->height * 72.0 / dpi[1];
+
+    return g_steal_pointer(&image);
+}
+
+// Copies the pixels into a cairo image surface, premultiplying alpha
+static inline cairo_surface_t *
+_jkpdf_surface_from_pixbuf(GdkPixbuf *pixbuf)
+{
+    int width = gdk_pixbuf_get_width(pixbuf);
+    int height = gdk_pixbuf_get_height(pixbuf);
+    int n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+    int pixbuf_stride = gdk_pixbuf_get_rowstride(pixbuf);
+    const guint8 *pixels = gdk_pixbuf_read_pixels(pixbuf);
+    gboolean alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+
+    cairo_surface_t *surf = cairo_image_surface_create(alpha ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24, width, height);
+    cairo_surface_flush(surf);
+
+    guint8 *data = cairo_image_surface_get_data(surf);
+    int stride = cairo_image_surface_get_stride(surf);
+
+    for (int y = 0; y < height; ++y) {
+        const guint8 *src = pixels + (gsize)y * (gsize)pixbuf_stride;
+        uint32_t *dst = (uint32_t *)(void *)(data + (gsize)y * (gsize)stride);
+
+        for (int x = 0; x < width; ++x, src += n_channels) {
+            uint32_t a = alpha ? src[3] : 0xff;
+            uint32_t r = src[0] * a / 0xff;
+            uint32_t g = src[1] * a / 0xff;
+            uint32_t b = src[2] * a / 0xff;
+
+            dst[x] = a << 24 | r << 16 | g << 8 | b;
+        }
+    }
+
+    cairo_surface_mark_dirty(surf);
+
+    return surf;
+}
+
+// Draws the image onto the page, which is image->page_width by
+// image->page_height points. Draws nothing if the image cannot be decoded.
+static inline gboolean
+jkpdf_image_render(const JkPdfImage *image, cairo_t *cr, GError **error)
+{
+    g_autoptr(JKPdfCairoSurfaceT) surf = NULL;
+
+    // A PDF surface embeds the file and never looks at the pixels. The
+    // zeroed memory of the blank surface is not even touched; cairo only
+    // falls back to pixels for operators PDF cannot express.
+    gboolean embed = image->is_jpeg && cairo_surface_supports_mime_type(cairo_get_target(cr), CAIRO_MIME_TYPE_JPEG);
+    if (embed) {
+        surf = cairo_image_surface_create(CAIRO_FORMAT_RGB24, image->width, image->height);
+    } else {
+        int size[2] = { 0, 0 };
+        g_autoptr(GdkPixbuf) pixbuf = _jkpdf_image_load(image->bytes, size, FALSE, error);
+        if (!pixbuf)
+            return FALSE;
+
+        surf = _jkpdf_surface_from_pixbuf(pixbuf);
+    }
+
+    if (image->is_jpeg) {
+        gsize len = 0;
+        const guint8 *data = g_bytes_get_data(image->bytes, &len);
+        cairo_surface_set_mime_data(surf, CAIRO_MIME_TYPE_JPEG, data, len, (cairo_destroy_func_t)g_bytes_unref, g_bytes_ref(image->bytes));
+    }
+
+    cairo_save(cr);
+    cairo_scale(cr, image->page_width / image->width, image->page_height / image->height);
+    cairo_set_source_surface(cr, surf, 0, 0);
+    cairo_paint(cr);
+    cairo_restore(cr);
+
+    return TRUE;
+}
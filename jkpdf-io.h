@@ -14,15 +14,31 @@
 
 #pragma once
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for vmsplice(2), splice(2) and memfd_create(2)
+#endif
+
+#include "jkpdf-error.h"
+#include "jkpdf-memory.h"
+#include "jkpdf-probes.h"
+#include "jkpdf-stats.h"
+
 #include <poppler.h>
 #include <gio/gio.h>
 #include <cairo.h>
 #include <cairo-pdf.h>
+#include <cairo-script.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 typedef cairo_t JKPdfCairoT;
 typedef cairo_surface_t JKPdfCairoSurfaceT;
@@ -33,86 +49,915 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC(JKPdfCairoSurfaceT, cairo_surface_destroy)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(JKPdfPopplerDocument, g_object_unref)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(JKPdfPopplerPage, g_object_unref)
 
+// Hooks implemented by some executables, NULL in the others. Hidden, so that
+// libjkpdf.so neither exports them nor picks up those of its user.
+#define JKPDF_HOOK __attribute__((weak, visibility("hidden")))
+
+static inline gboolean
+jkpdf_verbose(void)
+{
+    const char *env = g_getenv("JKPDF_VERBOSE");
+    return env && *env && strcmp(env, "0");
+}
+
+// With a memory limit, the peak RSS is always of interest
+static inline void
+jkpdf_report_peak_rss(void)
+{
+    if (!jkpdf_verbose() && !jkpdf_memory_limit())
+        return;
+
+    fprintf(stderr, "INFO: peak RSS %.1f MiB\n", (double)jkpdf_memory_peak_rss() / (1024 * 1024));
+}
+
+// Asynchronous output writer
+//
+// cairo hands us its output in lots of tiny pieces. These are collected into
+// large buffers, which a separate thread writes to stdout while the tool keeps
+// rendering. When stdout is a pipe, the buffers are vmsplice(2)d into it
+// instead of being copied. A vmsplice'd buffer is still referenced by the
+// pipe, so it is only filled again once the reader has consumed all of it,
+// which FIONREAD tells. Unmapping and mapping a fresh buffer after every
+// write instead costs page faults on every single megabyte of output.
+
+#define JKPDF_WRITER_BUFFER_SIZE  (1024 * 1024)
+#define JKPDF_WRITER_BUFFER_COUNT 4
+
+typedef struct {
+    guint8 *data;
+    gsize   len;
+    guint64 end; // bytes_written after this buffer, while in the pipe
+} JkPdfWriterBuffer;
+
+typedef struct {
+    GMutex   lock;
+    GCond    cond;
+    GThread *thread;
+    int      fd;
+    gboolean use_vmsplice;
+    gboolean is_stream;     // somebody may be waiting for every page
+
+    GQueue   full_buffers;     // waiting to be written, in order
+    GQueue   empty_buffers;    // ready to be filled
+    GQueue   draining_buffers; // vmsplice'd, maybe still read from
+    JkPdfWriterBuffer *current;
+    gboolean stalled;          // somebody waits for an empty buffer
+
+    gboolean discard;       // cairo's output is replaced, see jkpdf_writer_take_over()
+    gboolean closing;
+    gboolean finished;
+    int      error;         // errno of the first failed write
+    JkPdfStats *stats;
+    gint64   stall_usec;    // time spent waiting for a free buffer
+    guint64  bytes_written;
+    guint64  bytes_produced; // handed to us by cairo so far, for --stats
+} JkPdfWriter;
+
+static inline guint8 *
+_jkpdf_writer_alloc_data(void)
+{
+    void *data = mmap(NULL, JKPDF_WRITER_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        perror("ERROR: mmap(2) for output buffer");
+        exit(1);
+    }
+
+    return data;
+}
+
+static inline gboolean
+_jkpdf_poll_fd(int fd, short events)
+{
+    struct pollfd pfd = { fd, events, 0 };
+    while (poll(&pfd, 1, -1) < 0) {
+        if (errno != EINTR)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Write the whole buffer, retrying partial writes. Returns 0 or an errno value.
+static inline int
+_jkpdf_write_all(int fd, const guint8 *data, gsize len, gboolean *use_vmsplice)
+{
+    while (len > 0) {
+        ssize_t written;
+
+        if (*use_vmsplice) {
+            struct iovec iov = { (void *)data, len };
+            written = vmsplice(fd, &iov, 1, 0);
+            if (written < 0 && (errno == EINVAL || errno == ENOSYS || errno == EBADF)) {
+                *use_vmsplice = FALSE;
+                continue;
+            }
+        } else {
+            written = write(fd, data, len);
+        }
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN && _jkpdf_poll_fd(fd, POLLOUT))
+                continue;
+
+            return errno;
+        }
+
+        data += written;
+        len -= (gsize)written;
+    }
+
+    return 0;
+}
+
+// Moves vmsplice'd buffers the reader is done with back to the empty ones.
+// Called with the lock held.
+static inline void
+_jkpdf_writer_reclaim(JkPdfWriter *writer)
+{
+    if (g_queue_is_empty(&writer->draining_buffers))
+        return;
+
+    int unread = 0;
+    if (ioctl(writer->fd, FIONREAD, &unread) < 0)
+        unread = -1;
+
+    JkPdfWriterBuffer *buf;
+    while ((buf = g_queue_peek_head(&writer->draining_buffers))) {
+        if (unread < 0) {
+            // cannot tell, the pipe may still reference our pages
+            munmap(buf->data, JKPDF_WRITER_BUFFER_SIZE);
+            buf->data = _jkpdf_writer_alloc_data();
+        } else if (buf->end > writer->bytes_written - (guint64)unread) {
+            break;
+        }
+
+        g_queue_pop_head(&writer->draining_buffers);
+        g_queue_push_tail(&writer->empty_buffers, buf);
+        g_cond_broadcast(&writer->cond);
+    }
+}
+
+static inline gpointer
+_jkpdf_writer_thread(gpointer data)
+{
+    JkPdfWriter *writer = data;
+
+    for (;;) {
+        g_mutex_lock(&writer->lock);
+        while (g_queue_is_empty(&writer->full_buffers) && !writer->closing) {
+            // nothing else wakes us up when the reader makes progress
+            if (writer->stalled && !g_queue_is_empty(&writer->draining_buffers)) {
+                g_cond_wait_until(&writer->cond, &writer->lock, g_get_monotonic_time() + 1000);
+                _jkpdf_writer_reclaim(writer);
+            } else {
+                g_cond_wait(&writer->cond, &writer->lock);
+            }
+        }
+
+        JkPdfWriterBuffer *buf = g_queue_pop_head(&writer->full_buffers);
+        gboolean failed = writer->error != 0;
+        g_mutex_unlock(&writer->lock);
+
+        if (!buf)
+            break;
+
+        int err = 0;
+        gboolean spliced = writer->use_vmsplice;
+        if (!failed)
+            err = _jkpdf_write_all(writer->fd, buf->data, buf->len, &writer->use_vmsplice);
+
+        g_mutex_lock(&writer->lock);
+        if (err && !writer->error)
+            writer->error = err;
+        if (!failed)
+            writer->bytes_written += buf->len;
+        buf->len = 0;
+        buf->end = writer->bytes_written;
+        if (spliced)
+            g_queue_push_tail(&writer->draining_buffers, buf);
+        else
+            g_queue_push_tail(&writer->empty_buffers, buf);
+        _jkpdf_writer_reclaim(writer);
+        g_cond_broadcast(&writer->cond);
+        g_mutex_unlock(&writer->lock);
+    }
+
+    return NULL;
+}
+
+static inline void
+_jkpdf_writer_submit_current(JkPdfWriter *writer)
+{
+    g_mutex_lock(&writer->lock);
+    g_queue_push_tail(&writer->full_buffers, writer->current);
+    g_cond_broadcast(&writer->cond);
+
+    gint64 stall_start = 0;
+    if (g_queue_is_empty(&writer->empty_buffers)) {
+        stall_start = g_get_monotonic_time();
+        writer->stalled = TRUE;
+        g_cond_broadcast(&writer->cond);
+        while (g_queue_is_empty(&writer->empty_buffers))
+            g_cond_wait(&writer->cond, &writer->lock);
+        writer->stalled = FALSE;
+        writer->stall_usec += g_get_monotonic_time() - stall_start;
+    }
+
+    writer->current = g_queue_pop_head(&writer->empty_buffers);
+    g_mutex_unlock(&writer->lock);
+
+    if (stall_start)
+        jkpdf_stats_span(writer->stats, "write stall", stall_start, -1, 0, 0);
+}
+
+// Returns FALSE if an earlier write failed
+static inline gboolean
+jkpdf_writer_append(JkPdfWriter *writer, const guint8 *data, gsize length)
+{
+    if (g_atomic_int_get(&writer->error))
+        return FALSE;
+
+    writer->bytes_produced += length;
+
+    while (length > 0) {
+        gsize n = MIN(length, JKPDF_WRITER_BUFFER_SIZE - writer->current->len);
+        memcpy(writer->current->data + writer->current->len, data, n);
+        writer->current->len += n;
+        data += n;
+        length -= n;
+
+        if (writer->current->len == JKPDF_WRITER_BUFFER_SIZE)
+            _jkpdf_writer_submit_current(writer);
+    }
+
+    return TRUE;
+}
+
 static inline cairo_status_t
 _jkpdf_cairo_write_to_stdout(void *closure, const unsigned char *data, unsigned int length)
 {
-    (void)closure;
+    JkPdfWriter *writer = closure;
+
+    if (writer->discard)
+        return CAIRO_STATUS_SUCCESS;
 
-    ssize_t written = write(1, data, length);
-    if (written < 0) {
-        perror("write(2)");
+    if (!jkpdf_writer_append(writer, data, length))
         return CAIRO_STATUS_WRITE_ERROR;
+
+    return CAIRO_STATUS_SUCCESS;
+}
+
+// Drops everything cairo writes from now on, for output which was put
+// together elsewhere and is handed over with jkpdf_writer_append() instead.
+// Returns FALSE if some of cairo's output has already been written.
+static inline gboolean
+jkpdf_writer_take_over(JkPdfWriter *writer)
+{
+    if (writer->current->len != writer->bytes_produced)
+        return FALSE;
+
+    // at most the PDF header so far
+    writer->current->len = 0;
+    writer->bytes_produced = 0;
+    writer->discard = TRUE;
+
+    return TRUE;
+}
+
+// stats is the run to account the output to, or NULL
+static inline JkPdfWriter *
+jkpdf_writer_new(int fd, JkPdfStats *stats)
+{
+    JkPdfWriter *writer = g_new0(JkPdfWriter, 1);
+    writer->stats = jkpdf_stats_ref(stats);
+    g_mutex_init(&writer->lock);
+    g_cond_init(&writer->cond);
+    g_queue_init(&writer->full_buffers);
+    g_queue_init(&writer->empty_buffers);
+    g_queue_init(&writer->draining_buffers);
+    writer->fd = fd;
+
+    struct stat st;
+    writer->use_vmsplice = fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+    writer->is_stream = writer->use_vmsplice || S_ISSOCK(st.st_mode);
+
+    for (int i = 0; i < JKPDF_WRITER_BUFFER_COUNT; ++i) {
+        JkPdfWriterBuffer *buf = g_new0(JkPdfWriterBuffer, 1);
+        buf->data = _jkpdf_writer_alloc_data();
+        g_queue_push_tail(&writer->empty_buffers, buf);
     }
+    writer->current = g_queue_pop_head(&writer->empty_buffers);
 
-    if (written != (ssize_t)length) {
-        fprintf(stderr, "WTF: tried to write %u bytes, but wrote %zd\n", length, written);
-        return CAIRO_STATUS_WRITE_ERROR;
+    writer->thread = g_thread_new("jkpdf-writer", _jkpdf_writer_thread, writer);
+
+    return writer;
+}
+
+static inline void
+_jkpdf_writer_buffer_free(gpointer data)
+{
+    JkPdfWriterBuffer *buf = data;
+
+    munmap(buf->data, JKPDF_WRITER_BUFFER_SIZE);
+    g_free(buf);
+}
+
+// Flushes all pending output and waits for the writer thread. Returns 0 or
+// the errno of the first failed write.
+static inline int
+jkpdf_writer_finish(JkPdfWriter *writer)
+{
+    if (writer->finished)
+        return writer->error;
+
+    if (writer->current->len > 0)
+        _jkpdf_writer_submit_current(writer);
+
+    g_mutex_lock(&writer->lock);
+    writer->closing = TRUE;
+    g_cond_broadcast(&writer->cond);
+    g_mutex_unlock(&writer->lock);
+
+    g_thread_join(writer->thread);
+    writer->finished = TRUE;
+
+    if (jkpdf_verbose()) {
+        fprintf(stderr, "INFO: wrote %" G_GUINT64_FORMAT " bytes, rendering stalled %.3f s waiting for output\n",
+                writer->bytes_written, (double)writer->stall_usec / G_USEC_PER_SEC);
     }
 
-    return CAIRO_STATUS_SUCCESS;
+    jkpdf_report_peak_rss();
+    jkpdf_stats_add_output(writer->stats, writer->bytes_written, writer->stall_usec);
+
+    return writer->error;
+}
+
+// Destroy notify of the output surface. Errors are reported by
+// jkpdf_surface_finish(), this only cleans up.
+static inline void
+jkpdf_writer_close(void *data)
+{
+    JkPdfWriter *writer = data;
+
+    jkpdf_writer_finish(writer);
+
+    _jkpdf_writer_buffer_free(writer->current);
+    g_queue_clear_full(&writer->empty_buffers, _jkpdf_writer_buffer_free);
+    g_queue_clear_full(&writer->draining_buffers, _jkpdf_writer_buffer_free);
+    g_cond_clear(&writer->cond);
+    g_mutex_clear(&writer->lock);
+    jkpdf_stats_unref(writer->stats);
+    g_free(writer);
+}
+
+static const cairo_user_data_key_t jkpdf_writer_key;
+
+// CairoScript output
+//
+// Between two jkpdftool processes, PDF is a waste of time: cairo compresses
+// and subsets everything, just for poppler to parse it again. With
+// JKPDF_OUTPUT_FORMAT=script, tools write the pages as binary CairoScript
+// instead, which every tool accepts as input (see jkpdf-document.h).
+// Only the last tool of a pipe should write PDF.
+
+static inline gboolean
+jkpdf_want_script_output(void)
+{
+    const char *env = g_getenv("JKPDF_OUTPUT_FORMAT");
+    if (!env || !*env || !strcmp(env, "pdf"))
+        return FALSE;
+
+    if (!strcmp(env, "script"))
+        return TRUE;
+
+    fprintf(stderr, "WARN: ignoring unknown JKPDF_OUTPUT_FORMAT '%s'\n", env);
+    return FALSE;
+}
+
+typedef struct {
+    cairo_device_t *script;
+    JkPdfWriter *writer;
+} JkPdfScriptOutput;
+
+static const cairo_user_data_key_t jkpdf_script_output_key;
+
+static inline void
+_jkpdf_script_output_close(void *data)
+{
+    JkPdfScriptOutput *out = data;
+
+    cairo_device_finish(out->script);
+    cairo_status_t status = cairo_device_status(out->script);
+    cairo_device_destroy(out->script);
+
+    jkpdf_writer_close(out->writer);
+    g_free(out);
+
+    if (status)
+        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+}
+
+// Returns the script device if pages for surf should be written as CairoScript
+static inline cairo_device_t *
+jkpdf_get_script_device(cairo_surface_t *surf)
+{
+    JkPdfScriptOutput *out = cairo_surface_get_user_data(surf, &jkpdf_script_output_key);
+
+    return out ? out->script : NULL;
+}
+
+// Returns the writer behind the output surface, if any
+static inline JkPdfWriter *
+jkpdf_surface_get_writer(cairo_surface_t *surf)
+{
+    JkPdfScriptOutput *out = cairo_surface_get_user_data(surf, &jkpdf_script_output_key);
+    if (out)
+        return out->writer;
+
+    return cairo_surface_get_user_data(surf, &jkpdf_writer_key);
+}
+
+// Called after every page. The next tool of a shell pipe reads CairoScript
+// page by page (see jkpdf-document.h), so pages are not held back until
+// the output buffer is full.
+static inline void
+jkpdf_flush_script_output(cairo_surface_t *surf)
+{
+    JkPdfScriptOutput *out = cairo_surface_get_user_data(surf, &jkpdf_script_output_key);
+    if (!out)
+        return;
+
+    // otherwise, --stats would only see bytes once the device is finished
+    if (out->writer->is_stream || jkpdf_stats_enabled(out->writer->stats))
+        cairo_device_flush(out->script);
+
+    if (!out->writer->is_stream)
+        return;
+
+    if (out->writer->current->len > 0)
+        _jkpdf_writer_submit_current(out->writer);
+}
+
+// Removes "NAME VALUE" or "NAME=VALUE" from argv, for the options which every
+// tool takes no matter how it parses the rest. Returns the last value given.
+static inline gchar *
+jkpdf_take_arg(int *argc, char **argv, const char *name)
+{
+    gchar *value = NULL;
+    size_t name_len = strlen(name);
+
+    for (int i = 1; i < *argc && strcmp(argv[i], "--"); ++i) {
+        int n_args = 0;
+        if (!strcmp(argv[i], name) && i + 1 < *argc) {
+            g_free(value);
+            value = g_strdup(argv[i + 1]);
+            n_args = 2;
+        } else if (!strncmp(argv[i], name, name_len) && argv[i][name_len] == '=') {
+            g_free(value);
+            value = g_strdup(argv[i] + name_len + 1);
+            n_args = 1;
+        } else {
+            continue;
+        }
+
+        memmove(&argv[i], &argv[i + n_args], sizeof(char *) * (size_t)(*argc - i - n_args + 1));
+        *argc -= n_args;
+        --i;
+    }
+
+    return value;
+}
+
+// Like jkpdf_take_arg(), for options without a value. Returns whether the
+// option was given.
+static inline gboolean
+jkpdf_take_flag(int *argc, char **argv, const char *name)
+{
+    gboolean found = FALSE;
+
+    for (int i = 1; i < *argc && strcmp(argv[i], "--"); ++i) {
+        if (strcmp(argv[i], name))
+            continue;
+
+        memmove(&argv[i], &argv[i + 1], sizeof(char *) * (size_t)(*argc - i));
+        *argc -= 1;
+        --i;
+        found = TRUE;
+    }
+
+    return found;
+}
+
+// Also sets up JKPDF_TRACE, which goes along with the stats
+static inline void
+jkpdf_take_stats_arg(int *argc, char **argv)
+{
+    g_autoptr(JkPdfStats) stats = jkpdf_stats_new(argv[0], jkpdf_take_flag(argc, argv, "--stats"));
+    jkpdf_stats_set_current(stats);
+}
+
+// Preview mode
+//
+// With --preview-page N, a tool renders nothing but output page N and writes
+// it to stdout as PNG, at --preview-dpi (default 72). Only the pages needed
+// for that one page are rendered, see jkpdf_render_pages(). The output
+// surface merely carries the request.
+
+typedef struct {
+    int    page;  // 1-based, 0 for normal output
+    double dpi;
+} JkPdfPreview;
+
+// set by jkpdf_take_preview_args() at the start of every tool
+static JkPdfPreview jkpdf_preview = { 0, 72.0 };
+
+static const cairo_user_data_key_t jkpdf_preview_key;
+
+static inline void
+jkpdf_take_preview_args(int *argc, char **argv)
+{
+    g_autofree gchar *page = jkpdf_take_arg(argc, argv, "--preview-page");
+    g_autofree gchar *dpi = jkpdf_take_arg(argc, argv, "--preview-dpi");
+
+    jkpdf_preview.page = 0;
+    jkpdf_preview.dpi = 72.0;
+
+    if (page) {
+        char *end = NULL;
+        long n = strtol(page, &end, 10);
+        if (*end || end == page || n < 1 || n > G_MAXINT) {
+            fprintf(stderr, "ERROR: invalid --preview-page '%s'\n", page);
+            exit(1);
+        }
+
+        jkpdf_preview.page = (int)n;
+    }
+
+    if (dpi) {
+        char *end = NULL;
+        double d = g_ascii_strtod(dpi, &end);
+        if (*end || end == dpi || !(d > 0.0 && d <= 2400.0)) {
+            fprintf(stderr, "ERROR: invalid --preview-dpi '%s'\n", dpi);
+            exit(1);
+        }
+
+        jkpdf_preview.dpi = d;
+    }
 }
 
+// Returns the preview request if the pages for surf should be rendered as PNG
+static inline const JkPdfPreview *
+jkpdf_get_preview(cairo_surface_t *surf)
+{
+    return cairo_surface_get_user_data(surf, &jkpdf_preview_key);
+}
+
+// Estimate mode
+//
+// With --estimate, a tool renders nothing and writes an estimate of what
+// rendering would take to stdout as JSON instead, see jkpdf_render_pages().
+// Only page sizes and cheap document statistics are looked at, so tools
+// skip anything that would render pages up front.
+
+// set by jkpdf_take_estimate_arg() at the start of every tool
+static gboolean jkpdf_estimate = FALSE;
+
+static const cairo_user_data_key_t jkpdf_estimate_key;
+
+static inline void
+jkpdf_take_estimate_arg(int *argc, char **argv)
+{
+    jkpdf_estimate = jkpdf_take_flag(argc, argv, "--estimate");
+}
+
+// Whether the pages for surf should only be estimated
+static inline gboolean
+jkpdf_get_estimate(cairo_surface_t *surf)
+{
+    return cairo_surface_get_user_data(surf, &jkpdf_estimate_key) != NULL;
+}
+
+// Implemented by the multicall binary when the output goes to the next tool
+// in an in-process pipeline, see jkpdf-document.h
+cairo_surface_t *jkpdf_pipeline_output(void) JKPDF_HOOK;
+
 static inline cairo_surface_t *
-jkpdf_create_surface_for_stdout(void)
+_jkpdf_create_surface_for_stdout(JkPdfStats *stats)
 {
+    if (jkpdf_pipeline_output) {
+        cairo_surface_t *surf = jkpdf_pipeline_output();
+        if (surf) {
+            if (jkpdf_preview.page)
+                fprintf(stderr, "WARN: ignoring --preview-page, only the last tool of a pipeline can show a preview\n");
+            if (jkpdf_estimate)
+                fprintf(stderr, "WARN: ignoring --estimate, only the last tool of a pipeline can estimate\n");
+
+            return surf;
+        }
+    }
+
+    if (jkpdf_estimate) {
+        // never drawn to, the estimate is plain text
+        cairo_rectangle_t extents = { 0, 0, 1, 1 };
+        cairo_surface_t *surf = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+        cairo_surface_set_user_data(surf, &jkpdf_estimate_key, GINT_TO_POINTER(1), NULL);
+
+        return surf;
+    }
+
     if (isatty(1)) {
-        fprintf(stderr, "ERROR: refusing to write PDF to terminal\n");
+        fprintf(stderr, "ERROR: refusing to write %s to terminal\n", jkpdf_preview.page ? "PNG" : "PDF");
         exit(1);
     } else if (errno == EBADF) {
         fprintf(stderr, "WTF: stdout is not a valid file descriptor\n");
         exit(1);
     }
 
-    return cairo_pdf_surface_create_for_stream(_jkpdf_cairo_write_to_stdout, NULL, 100, 100);
+    if (jkpdf_preview.page) {
+        // never drawn to, like the CairoScript output surface
+        cairo_rectangle_t extents = { 0, 0, 1, 1 };
+        cairo_surface_t *surf = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+        cairo_surface_set_user_data(surf, &jkpdf_preview_key, &jkpdf_preview, NULL);
+
+        return surf;
+    }
+
+    JkPdfWriter *writer = jkpdf_writer_new(1, stats);
+
+    if (jkpdf_want_script_output()) {
+        JkPdfScriptOutput *out = g_new0(JkPdfScriptOutput, 1);
+        out->writer = writer;
+        out->script = cairo_script_create_for_stream(_jkpdf_cairo_write_to_stdout, writer);
+        cairo_script_set_mode(out->script, CAIRO_SCRIPT_MODE_BINARY);
+
+        // Never drawn to, jkpdf_render_pages() creates a script surface for
+        // every page. It only carries the script device.
+        cairo_rectangle_t extents = { 0, 0, 1, 1 };
+        cairo_surface_t *surf = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+        cairo_surface_set_user_data(surf, &jkpdf_script_output_key, out, _jkpdf_script_output_close);
+
+        return surf;
+    }
+
+    cairo_surface_t *surf = cairo_pdf_surface_create_for_stream(_jkpdf_cairo_write_to_stdout, writer, 100, 100);
+
+    // flushed by jkpdf_surface_finish(), freed with the surface
+    cairo_surface_set_user_data(surf, &jkpdf_writer_key, writer, jkpdf_writer_close);
+
+    return surf;
+}
+
+static const cairo_user_data_key_t jkpdf_stats_key;
+
+// Returns the stats of the tool run writing to surf, or NULL
+static inline JkPdfStats *
+jkpdf_surface_get_stats(cairo_surface_t *surf)
+{
+    return cairo_surface_get_user_data(surf, &jkpdf_stats_key);
+}
+
+static inline cairo_surface_t *
+jkpdf_create_surface_for_stdout(void)
+{
+    JkPdfStats *stats = jkpdf_stats_current();
+
+    cairo_surface_t *surf = _jkpdf_create_surface_for_stdout(stats);
+    if (stats)
+        cairo_surface_set_user_data(surf, &jkpdf_stats_key, jkpdf_stats_ref(stats), (cairo_destroy_func_t)jkpdf_stats_unref);
+
+    return surf;
+}
+
+// Input which could not be drawn, e.g. a broken image, fails the output
+// once it is finished instead of leaving pages blank silently
+static const cairo_user_data_key_t jkpdf_render_error_key;
+
+static inline void
+jkpdf_surface_set_render_error(cairo_surface_t *surf, const GError *error)
+{
+    if (!cairo_surface_get_user_data(surf, &jkpdf_render_error_key))
+        cairo_surface_set_user_data(surf, &jkpdf_render_error_key, g_error_copy(error), (cairo_destroy_func_t)g_error_free);
+}
+
+// Finishes the output surface, flushes the output and prints the --stats
+// report if asked to. Use instead of cairo_surface_finish() in tools.
+// Returns FALSE after printing why the output is incomplete.
+static inline gboolean
+jkpdf_surface_finish(cairo_surface_t *surf)
+{
+    JkPdfStats *stats = jkpdf_surface_get_stats(surf);
+    gint64 start = jkpdf_stats_now(stats);
+
+    cairo_surface_finish(surf);
+
+    JkPdfScriptOutput *out = cairo_surface_get_user_data(surf, &jkpdf_script_output_key);
+    if (out)
+        cairo_device_finish(out->script);
+
+    // writing the last buffer is part of finishing
+    JkPdfWriter *writer = jkpdf_surface_get_writer(surf);
+    int write_error = writer ? jkpdf_writer_finish(writer) : 0;
+
+    jkpdf_stats_add_finish(stats, start);
+    jkpdf_stats_report(stats);
+
+    if (write_error) {
+        fprintf(stderr, "ERROR: while writing output: %s\n", g_strerror(write_error));
+        return FALSE;
+    }
+
+    const GError *render_error = cairo_surface_get_user_data(surf, &jkpdf_render_error_key);
+    if (render_error) {
+        fprintf(stderr, "ERROR: %s\n", render_error->message);
+        return FALSE;
+    }
+
+    return TRUE;
 }
 
 static inline PopplerDocument *
-jkpdf_create_poppler_document_from_bytes(GBytes *bytes)
+jkpdf_poppler_document_new_from_bytes(GBytes *bytes, GError **error)
 {
-    g_autoptr(GError) error = NULL;
+    JkPdfStats *stats = jkpdf_stats_current();
+    gint64 start = jkpdf_stats_now(stats);
+
+    g_autoptr(GError) poppler_error = NULL;
     g_autoptr(JKPdfPopplerDocument) doc = poppler_document_new_from_bytes(bytes,
-                                                                          NULL, &error);
+                                                                          NULL, &poppler_error);
     if (!doc) {
-        fprintf(stderr, "ERROR: could not open PDF: %s\n", error->message);
-        exit(1);
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "could not open PDF: %s", poppler_error->message);
+        return NULL;
     }
 
     if (poppler_document_get_n_pages(doc) < 1) {
-        fprintf(stderr, "WTF: input PDF has no pages\n");
-        exit(1);
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_NO_PAGES, "input PDF has no pages");
+        return NULL;
     }
 
+    // keep the bytes around so that worker threads can open their own copy
+    g_object_set_data_full(G_OBJECT(doc), "jkpdf-bytes", g_bytes_ref(bytes), (GDestroyNotify)g_bytes_unref);
+
+    JKPDF_PROBE2(document_open, g_bytes_get_size(bytes), poppler_document_get_n_pages(doc));
+    jkpdf_stats_add_open(stats, start);
+
     return g_steal_pointer(&doc);
 }
 
+static inline void
+jkpdf_exit_with_error(GError *error)
+{
+    // no pages is not the user's fault, everything else probably is
+    if (g_error_matches(error, JKPDF_ERROR, JKPDF_ERROR_NO_PAGES))
+        fprintf(stderr, "WTF: %s\n", error->message);
+    else
+        fprintf(stderr, "ERROR: %s\n", error->message);
+
+    exit(1);
+}
+
 static inline PopplerDocument *
-jkpdf_create_poppler_document_for_fd(int fd)
+jkpdf_create_poppler_document_from_bytes(GBytes *bytes)
 {
-    g_autoptr(GMappedFile) map = g_mapped_file_new_from_fd(fd, FALSE, NULL);
-    if (map) {
-        // regular file we can randomly access
-        g_autoptr(GBytes) bytes = g_mapped_file_get_bytes(map);
+    g_autoptr(GError) error = NULL;
+    PopplerDocument *doc = jkpdf_poppler_document_new_from_bytes(bytes, &error);
+    if (!doc)
+        jkpdf_exit_with_error(error);
+
+    return doc;
+}
 
-        return jkpdf_create_poppler_document_from_bytes(bytes);
-    } else {
-        GByteArray *arr = g_byte_array_new();
+#define JKPDF_SPOOL_CHUNK_SIZE (1024 * 1024)
 
-        guint8 buf[2048];
-        ssize_t count = 0;
-        while ((count = read(fd, buf, sizeof(buf))) > 0) {
-            g_byte_array_append(arr, buf, (guint)count);
+// Copies everything from a non-seekable fd (usually a pipe) into an anonymous
+// memory file, which can then be mapped like a regular file. splice(2) moves
+// the data without it ever passing through userspace. The prefix is what has
+// already been read from fd, if anything.
+static inline int
+_jkpdf_spool_to_memfd(int fd, const guint8 *prefix, gsize prefix_len)
+{
+    int memfd = memfd_create("jkpdf-spool", MFD_CLOEXEC);
+    if (memfd < 0) {
+        perror("ERROR: memfd_create(2)");
+        exit(1);
+    }
+
+    if (prefix_len > 0) {
+        gboolean no_vmsplice = FALSE;
+        int err = _jkpdf_write_all(memfd, prefix, prefix_len, &no_vmsplice);
+        if (err) {
+            fprintf(stderr, "ERROR: while spooling input: %s\n", g_strerror(err));
+            exit(1);
         }
+    }
+
+    // Larger pipe buffers mean fewer wakeups. Not being allowed to grow
+    // the pipe is harmless.
+    (void)fcntl(fd, F_SETPIPE_SZ, JKPDF_SPOOL_CHUNK_SIZE);
+
+    gboolean use_splice = TRUE;
+    g_autofree guint8 *buf = NULL;
+
+    for (;;) {
+        ssize_t count;
+
+        if (use_splice) {
+            count = splice(fd, NULL, memfd, NULL, JKPDF_SPOOL_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (count < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                // not a pipe, e.g. a socket or a character device
+                use_splice = FALSE;
+                buf = g_malloc(JKPDF_SPOOL_CHUNK_SIZE);
+                continue;
+            }
+        } else {
+            count = read(fd, buf, JKPDF_SPOOL_CHUNK_SIZE);
+            if (count > 0) {
+                gboolean no_vmsplice = FALSE;
+                int err = _jkpdf_write_all(memfd, buf, (gsize)count, &no_vmsplice);
+                if (err) {
+                    fprintf(stderr, "ERROR: while spooling input: %s\n", g_strerror(err));
+                    exit(1);
+                }
+            }
+        }
+
+        if (count == 0)
+            break;
+
         if (count < 0) {
-            perror("ERROR: while read(2)'ing input file");
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN && _jkpdf_poll_fd(fd, POLLIN))
+                continue;
+
+            perror("ERROR: while reading input file");
             exit(1);
         }
+    }
+
+    return memfd;
+}
+
+static inline GMappedFile *
+_jkpdf_map_fd(int fd)
+{
+    GMappedFile *map = g_mapped_file_new_from_fd(fd, FALSE, NULL);
+    if (!map)
+        return NULL;
+
+    // poppler jumps around in the file (xref table at the end, objects
+    // wherever), so just ask for all of it to be paged in early
+    gsize len = g_mapped_file_get_length(map);
+    if (len > 0)
+        (void)madvise(g_mapped_file_get_contents(map), len, MADV_WILLNEED);
+
+    return map;
+}
+
+// Returns everything read from a pipe (after the prefix already read)
+static inline GBytes *
+_jkpdf_read_spooled(int fd, const guint8 *prefix, gsize prefix_len)
+{
+    JkPdfStats *stats = jkpdf_stats_current();
+    gint64 start = jkpdf_stats_now(stats);
+
+    int memfd = _jkpdf_spool_to_memfd(fd, prefix, prefix_len);
+    g_autoptr(GMappedFile) map = _jkpdf_map_fd(memfd);
+    close(memfd); // the mapping keeps the memory alive
 
-        return jkpdf_create_poppler_document_from_bytes(g_byte_array_free_to_bytes(arr));
+    if (!map) {
+        perror("ERROR: while mapping spooled input");
+        exit(1);
     }
+
+    GBytes *bytes = g_mapped_file_get_bytes(map);
+    jkpdf_stats_add_read(stats, start, g_bytes_get_size(bytes));
+
+    return bytes;
 }
 
-static inline PopplerDocument *
-jkpdf_create_poppler_document_for_stdin(void)
+// Returns the complete contents of the file, mapped into memory
+static inline GBytes *
+jkpdf_read_fd(int fd)
+{
+    JkPdfStats *stats = jkpdf_stats_current();
+    gint64 start = jkpdf_stats_now(stats);
+
+    g_autoptr(GMappedFile) map = _jkpdf_map_fd(fd);
+    if (!map) {
+        // pipe or similar, spool it into memory first
+        return _jkpdf_read_spooled(fd, NULL, 0);
+    }
+
+    GBytes *bytes = g_mapped_file_get_bytes(map);
+    jkpdf_stats_add_read(stats, start, g_bytes_get_size(bytes));
+
+    return bytes;
+}
+
+static inline void
+jkpdf_check_stdin(void)
 {
     if (isatty(0)) {
         fprintf(stderr, "ERROR: refusing to read PDF from terminal\n");
@@ -121,34 +966,43 @@ jkpdf_create_poppler_document_for_stdin(void)
         fprintf(stderr, "WTF: stdin is not a valid file descriptor\n");
         exit(1);
     }
+}
 
-    return jkpdf_create_poppler_document_for_fd(0);
+static inline GBytes *
+jkpdf_read_commandline_arg(const char *arg)
+{
+    int fd = open(arg, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: while opening '%s': %s", arg, strerror(errno));
+        exit(1);
+    }
+
+    GBytes *bytes = jkpdf_read_fd(fd);
+    close(fd);
+
+    return bytes;
 }
 
-static inline void
-_jkpdf_weak_close_fd(gpointer data, GObject *where_the_object_was)
+static inline PopplerDocument *
+jkpdf_create_poppler_document_for_fd(int fd)
 {
-    (void)where_the_object_was;
+    g_autoptr(GBytes) bytes = jkpdf_read_fd(fd);
 
-    close(GPOINTER_TO_INT(data));
+    return jkpdf_create_poppler_document_from_bytes(bytes);
 }
 
+static inline PopplerDocument *
+jkpdf_create_poppler_document_for_stdin(void)
+{
+    jkpdf_check_stdin();
+
+    return jkpdf_create_poppler_document_for_fd(0);
+}
 
 static inline PopplerDocument *
 jkpdf_create_poppler_document_for_commandline_arg(const char *arg)
 {
-    int fd = open(arg, O_RDONLY);
-    if (fd < 0) {
-        fprintf(stderr, "ERROR: while opening '%s': %s", arg, strerror(errno));
-        exit(1);
-    }
+    g_autoptr(GBytes) bytes = jkpdf_read_commandline_arg(arg);
 
-    PopplerDocument *doc = jkpdf_create_poppler_document_for_fd(fd);
-    if (doc) {
-        g_object_weak_ref(G_OBJECT(doc), _jkpdf_weak_close_fd, GINT_TO_POINTER(fd));
-    } else {
-        close(fd);
-    }
-
-    return doc;
+    return jkpdf_create_poppler_document_from_bytes(bytes);
 }
@@ -0,0 +1,240 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include "jkpdf-pool.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+
+// Process isolation
+//
+// poppler bug 104864 (see jkpdf-detect-bug104864.h) mixes up images as soon
+// as pages of two documents end up in the same PDF output. With
+// jkpdf_isolate_documents(), every PDF document is rendered by a forked
+// process of its own, which shares the input mapping copy-on-write and
+// sends the pages back as CairoScript through a memfd. The parent then
+// works with recorded pages, just like those of a previous pipeline stage,
+// which carry nothing poppler could confuse. Up to one process per CPU runs
+// at a time, so merging many files also uses all cores. With a memory
+// limit, no new process is started while we are above it.
+
+static inline cairo_status_t
+_jkpdf_isolate_write(void *closure, const unsigned char *data, unsigned int length)
+{
+    FILE *stream = closure;
+
+    if (fwrite(data, 1, length, stream) != length)
+        return CAIRO_STATUS_WRITE_ERROR;
+
+    return CAIRO_STATUS_SUCCESS;
+}
+
+// Pages which are not selected stay blank, so that page numbers still match
+static inline void G_GNUC_NORETURN
+_jkpdf_isolate_render(JkPdfDocument *doc, const JkPdfPageSelection *selection, int fd)
+{
+    FILE *stream = fdopen(fd, "w");
+    if (!stream) {
+        perror("ERROR: fdopen(3)");
+        _exit(1);
+    }
+
+    setvbuf(stream, NULL, _IOFBF, 1024 * 1024);
+
+    cairo_device_t *script = cairo_script_create_for_stream(_jkpdf_isolate_write, stream);
+    cairo_script_set_mode(script, CAIRO_SCRIPT_MODE_BINARY);
+
+    int n_pages = jkpdf_document_get_n_pages(doc);
+    for (int i = 0; i < n_pages; ++i) {
+        g_autoptr(JkPdfPage) page = jkpdf_document_get_page(doc, i);
+
+        double w = 0, h = 0;
+        jkpdf_page_get_size(page, &w, &h);
+
+        g_autoptr(JKPdfCairoSurfaceT) surf = cairo_script_surface_create(script, CAIRO_CONTENT_COLOR_ALPHA, w, h);
+        g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
+
+        if (jkpdf_page_selection_contains(selection, i))
+            jkpdf_page_render(page, cr);
+        cairo_show_page(cr);
+        JKPDF_PROBE1(page_show, i + 1);
+    }
+
+    cairo_device_finish(script);
+    cairo_status_t status = cairo_device_status(script);
+    cairo_device_destroy(script);
+
+    if (status) {
+        fprintf(stderr, "ERROR: cairo status: %s\n", cairo_status_to_string(status));
+        _exit(1);
+    }
+
+    if (doc->render_error) {
+        fprintf(stderr, "ERROR: %s\n", doc->render_error->message);
+        _exit(1);
+    }
+
+    if (fclose(stream) != 0) {
+        perror("ERROR: while writing isolated pages");
+        _exit(1);
+    }
+
+    // no exit(), the parent's atexit handlers and stdout are none of our business
+    _exit(0);
+}
+
+// Reads the pages rendered by a child into a recorded document
+static inline JkPdfDocument *
+_jkpdf_isolate_read(int fd, int index, GError **error)
+{
+    g_autoptr(GMappedFile) map = _jkpdf_map_fd(fd);
+    if (!map) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "could not map the pages of input %d: %s", index + 1, g_strerror(errno));
+        return NULL;
+    }
+
+    g_autoptr(GBytes) bytes = g_mapped_file_get_bytes(map);
+    JkPdfDocument *isolated = jkpdf_document_new_for_script(bytes, error);
+    if (!isolated)
+        g_prefix_error(error, "input %d: ", index + 1);
+
+    return isolated;
+}
+
+// Replaces every PDF document in docs with its pages, rendered in a separate
+// process. Recorded documents and images are left alone. selections may be
+// NULL, or hold one selection per document (NULL for all pages); pages which
+// are not selected are left blank. Streamed documents are read completely
+// first, so that no other thread holds a lock while forking.
+static inline gboolean
+jkpdf_isolate_documents(JkPdfDocument **docs, int n_docs, JkPdfPageSelection *const *selections, GError **error)
+{
+    for (int i = 0; i < n_docs; ++i) {
+        if (jkpdf_document_is_streaming(docs[i]))
+            jkpdf_document_get_n_pages(docs[i]);
+    }
+
+    int max_running = (int)g_get_num_processors();
+    guint64 memory_limit = jkpdf_memory_limit();
+    int running = 0;
+    int next = 0;
+    gboolean ok = TRUE;
+
+    g_autofree pid_t *pids = g_new0(pid_t, n_docs);
+    g_autofree int *fds = g_new0(int, n_docs);
+    g_autoptr(GPtrArray) isolated = g_ptr_array_new_full((guint)n_docs, (GDestroyNotify)jkpdf_document_unref);
+    for (int i = 0; i < n_docs; ++i) {
+        fds[i] = -1;
+        g_ptr_array_add(isolated, NULL);
+    }
+
+    for (;;) {
+        for (; ok && next < n_docs && running < max_running; ++next) {
+            if (!jkpdf_document_is_pdf(docs[next]))
+                continue;
+
+            if (running && memory_limit && jkpdf_memory_rss() > memory_limit)
+                break;
+
+            fds[next] = memfd_create("jkpdf-isolate", MFD_CLOEXEC);
+            if (fds[next] < 0) {
+                g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_OUTPUT, "memfd_create(2): %s", g_strerror(errno));
+                ok = FALSE;
+                break;
+            }
+
+            fflush(NULL);
+
+            pid_t pid = fork();
+            if (pid < 0) {
+                g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_OUTPUT, "fork(2): %s", g_strerror(errno));
+                ok = FALSE;
+                break;
+            } else if (pid == 0) {
+                _jkpdf_isolate_render(docs[next], selections ? selections[next] : NULL, fds[next]);
+            }
+
+            pids[next] = pid;
+            running++;
+        }
+
+        if (running == 0)
+            break;
+
+        // Only our own children are waited for, waitpid(-1) could take the
+        // exit status of a child forked elsewhere in this process (e.g. by
+        // the server). Rendering takes far longer than the polling delay.
+        int status = 0;
+        int exited = -1;
+        for (int i = 0; i < n_docs && exited < 0; ++i) {
+            if (!pids[i])
+                continue;
+
+            pid_t pid = waitpid(pids[i], &status, WNOHANG);
+            if (pid < 0 && errno != EINTR) {
+                if (ok)
+                    g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_OUTPUT, "waitpid(2): %s", g_strerror(errno));
+                ok = FALSE;
+                pids[i] = 0;
+                running--;
+            } else if (pid == pids[i]) {
+                exited = i;
+            }
+        }
+
+        if (exited >= 0) {
+            pids[exited] = 0;
+            running--;
+
+            if (ok && (!WIFEXITED(status) || WEXITSTATUS(status))) {
+                g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "rendering input %d failed", exited + 1);
+                ok = FALSE;
+            }
+
+            if (ok) {
+                g_ptr_array_index(isolated, (guint)exited) = _jkpdf_isolate_read(fds[exited], exited, error);
+                ok = g_ptr_array_index(isolated, (guint)exited) != NULL;
+            }
+        } else if (running > 0) {
+            g_usleep(10000);
+        }
+
+        // no need to wait for the others to finish their work
+        for (int j = 0; !ok && j < n_docs; ++j) {
+            if (pids[j])
+                kill(pids[j], SIGKILL);
+        }
+    }
+
+    for (int i = 0; i < n_docs; ++i) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+
+    if (!ok)
+        return FALSE;
+
+    for (int i = 0; i < n_docs; ++i) {
+        JkPdfDocument *doc = g_ptr_array_index(isolated, (guint)i);
+        if (!doc)
+            continue;
+
+        jkpdf_document_unref(docs[i]);
+        docs[i] = g_steal_pointer(&g_ptr_array_index(isolated, (guint)i));
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,173 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Bounded memory
+//
+// JKPDF_MEMORY_LIMIT is a soft limit for the resident memory, like "512M" or
+// "2G", or "cgroup" for the memory.max of the cgroup we are running in. Above
+// the limit, the render pool does not start new pages before the ones in
+// flight have been written (see jkpdf-pool.h).
+//
+// JKPDF_MAX_DOCUMENTS is the number of PDF documents each thread keeps open
+// (default: unlimited, or 8 with a memory limit). poppler never forgets
+// anything it has parsed, so documents which were not used for a while are
+// closed and parsed again when needed (see jkpdf-document.h).
+
+static inline gboolean
+_jkpdf_parse_memory_size(const char *str, guint64 *size)
+{
+    char *end = NULL;
+    errno = 0;
+    guint64 value = g_ascii_strtoull(str, &end, 10);
+    if (errno || end == str)
+        return FALSE;
+
+    int shift = 0;
+    switch (g_ascii_toupper(*end)) {
+    case 'K': shift = 10; end++; break;
+    case 'M': shift = 20; end++; break;
+    case 'G': shift = 30; end++; break;
+    case 'T': shift = 40; end++; break;
+    }
+
+    if (*end || value > (G_MAXUINT64 >> shift))
+        return FALSE;
+
+    *size = value << shift;
+    return TRUE;
+}
+
+// memory.max of our cgroup (v2 only), or 0 if there is none
+static inline guint64
+_jkpdf_cgroup_memory_limit(void)
+{
+    g_autofree gchar *cgroups = NULL;
+    if (!g_file_get_contents("/proc/self/cgroup", &cgroups, NULL, NULL))
+        return 0;
+
+    g_auto(GStrv) lines = g_strsplit(cgroups, "\n", -1);
+    for (guint i = 0; lines[i]; ++i) {
+        if (!g_str_has_prefix(lines[i], "0::"))
+            continue;
+
+        g_autofree gchar *path = g_build_filename("/sys/fs/cgroup", lines[i] + 3, "memory.max", NULL);
+        g_autofree gchar *max = NULL;
+        if (!g_file_get_contents(path, &max, NULL, NULL))
+            return 0;
+
+        guint64 limit = 0;
+        if (!_jkpdf_parse_memory_size(g_strstrip(max), &limit))
+            return 0; // "max"
+
+        return limit;
+    }
+
+    return 0;
+}
+
+// Returns the memory limit in bytes, 0 if there is none
+static inline guint64
+jkpdf_memory_limit(void)
+{
+    static gsize limit = 0; // limit + 1, so 0 means not initialized
+
+    if (g_once_init_enter(&limit)) {
+        guint64 value = 0;
+        const char *env = g_getenv("JKPDF_MEMORY_LIMIT");
+
+        if (env && !strcmp(env, "cgroup")) {
+            value = _jkpdf_cgroup_memory_limit();
+            if (!value)
+                fprintf(stderr, "WARN: JKPDF_MEMORY_LIMIT=cgroup, but there is no cgroup memory limit\n");
+        } else if (env && *env && !_jkpdf_parse_memory_size(env, &value)) {
+            fprintf(stderr, "WARN: ignoring invalid JKPDF_MEMORY_LIMIT value '%s'\n", env);
+            value = 0;
+        }
+
+        g_once_init_leave(&limit, (gsize)value + 1);
+    }
+
+    return (guint64)limit - 1;
+}
+
+// Returns the maximum number of open PDF documents per thread, 0 if unlimited
+static inline int
+jkpdf_max_resident_documents(void)
+{
+    static gsize max = 0; // max + 1, so 0 means not initialized
+
+    if (g_once_init_enter(&max)) {
+        long value = jkpdf_memory_limit() ? 8 : 0;
+        const char *env = g_getenv("JKPDF_MAX_DOCUMENTS");
+
+        if (env && *env) {
+            char *end = NULL;
+            long n = strtol(env, &end, 10);
+            if (*end || n < 0 || n > 65536)
+                fprintf(stderr, "WARN: ignoring invalid JKPDF_MAX_DOCUMENTS value '%s'\n", env);
+            else
+                value = n;
+        }
+
+        g_once_init_leave(&max, (gsize)value + 1);
+    }
+
+    return (int)(max - 1);
+}
+
+// Current resident set size in bytes
+static inline guint64
+jkpdf_memory_rss(void)
+{
+    int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    char buf[128];
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    if (len <= 0)
+        return 0;
+
+    buf[len] = 0;
+
+    unsigned long long size = 0, resident = 0;
+    if (sscanf(buf, "%llu %llu", &size, &resident) != 2)
+        return 0;
+
+    return (guint64)resident * (guint64)sysconf(_SC_PAGESIZE);
+}
+
+// Peak resident set size in bytes
+static inline guint64
+jkpdf_memory_peak_rss(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return 0;
+
+    return (guint64)usage.ru_maxrss * 1024;
+}
@@ -0,0 +1,114 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include "jkpdf.h"
+#include "jkpdf-pool.h"
+
+// Arranging several pages on one sheet, used by jkpdftool-nup and libjkpdf
+
+struct _jkpdf_nup_params {
+    int rows;
+    int cols;
+    int pages_per_sheet;
+};
+
+static inline void
+_jkpdf_nup_sheet_layout(JkPdfDocument *doc, const struct _jkpdf_nup_params *params, int sheetno, int *rows, int *cols, double *w, double *h)
+{
+    jkpdf_document_get_page_size(doc, sheetno * params->pages_per_sheet, w, h);
+
+    *rows = params->rows;
+    *cols = params->cols;
+    if (*rows == 0 || *cols == 0) {
+        if (*w > *h) {
+            *rows = 2;
+            *cols = 1;
+        } else {
+            *rows = 1;
+            *cols = 2;
+        }
+    }
+}
+
+static inline void
+_jkpdf_nup_page_size(JkPdfDocument **docs, int sheetno, double *width, double *height, gpointer user_data)
+{
+    const struct _jkpdf_nup_params *params = user_data;
+
+    int rows, cols;
+    double w, h;
+    _jkpdf_nup_sheet_layout(docs[0], params, sheetno, &rows, &cols, &w, &h);
+
+    *width = w * cols;
+    *height = h * rows;
+}
+
+static inline void
+_jkpdf_nup_render_page(cairo_t *cr, JkPdfDocument **docs, int sheetno, gpointer user_data)
+{
+    const struct _jkpdf_nup_params *params = user_data;
+
+    int rows, cols;
+    double w, h;
+    _jkpdf_nup_sheet_layout(docs[0], params, sheetno, &rows, &cols, &w, &h);
+
+    int pageno = sheetno * params->pages_per_sheet;
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x, ++pageno) {
+            if (pageno >= jkpdf_document_get_n_pages(docs[0]))
+                return;
+
+            g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], pageno);
+
+            cairo_save(cr);
+
+            cairo_rectangle_t page_r = { x * w, y * h, w, h };
+            cairo_rectangle_t source_r = { 0, 0, 0, 0 };
+            jkpdf_page_get_size(page, &source_r.width, &source_r.height);
+
+            cairo_rectangle(cr, page_r.x, page_r.y, page_r.width, page_r.height);
+            cairo_clip(cr);
+
+            cairo_matrix_t m = jkpdf_transform_rect_into_bounds(source_r, page_r);
+            cairo_transform(cr, &m);
+
+            jkpdf_page_render(page, cr);
+
+            cairo_restore(cr);
+        }
+    }
+}
+
+static inline gboolean
+jkpdf_nup_document(JkPdfDocument *doc, const JkPdfNupOptions *options, cairo_surface_t *surf, GError **error)
+{
+    if (options->rows < 0 || options->cols < 0) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_OPTIONS, "negative number of rows or columns");
+        return FALSE;
+    }
+
+    struct _jkpdf_nup_params params = { options->rows, options->cols, 2 };
+    if (options->rows != 0 && options->cols != 0)
+        params.pages_per_sheet = options->rows * options->cols;
+
+    int n_sheets = (jkpdf_document_get_n_pages(doc) + params.pages_per_sheet - 1) / params.pages_per_sheet;
+
+    static const JkPdfPageFuncs funcs = { _jkpdf_nup_page_size, _jkpdf_nup_render_page, NULL };
+    jkpdf_render_pages(surf, &doc, 1, n_sheets, &funcs, &params);
+
+    return jkpdf_check_surface_status(surf, error);
+}
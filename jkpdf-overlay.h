@@ -0,0 +1,73 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include "jkpdf.h"
+#include "jkpdf-pool.h"
+
+// Drawing documents on top of each other, used by jkpdftool-overlay and
+// libjkpdf. The first document is the base, and determines the number and
+// size of the pages.
+
+struct _jkpdf_overlay_params {
+    int n_docs;
+    const JkPdfOverlayOptions *options;
+};
+
+static inline void
+_jkpdf_overlay_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    (void)user_data;
+
+    jkpdf_document_get_page_size(docs[0], pageno, width, height);
+}
+
+static inline void
+_jkpdf_overlay_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const struct _jkpdf_overlay_params *params = user_data;
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], pageno);
+
+    double w, h;
+    jkpdf_page_get_size(page, &w, &h);
+
+    cairo_rectangle(cr, 0, 0, w, h);
+    cairo_clip(cr);
+
+    jkpdf_page_render(page, cr);
+
+    cairo_translate(cr, params->options->offset[0], params->options->offset[1]);
+
+    for (int k = 1; k < params->n_docs; ++k) {
+        if (pageno >= jkpdf_document_get_n_pages(docs[k]))
+            continue;
+
+        g_autoptr(JkPdfPage) overlay_page = jkpdf_document_get_page(docs[k], pageno);
+
+        jkpdf_page_render(overlay_page, cr);
+    }
+}
+
+static inline gboolean
+jkpdf_overlay_documents(JkPdfDocument **docs, int n_docs, const JkPdfOverlayOptions *options, cairo_surface_t *surf, GError **error)
+{
+    struct _jkpdf_overlay_params params = { n_docs, options };
+
+    static const JkPdfPageFuncs funcs = { _jkpdf_overlay_page_size, _jkpdf_overlay_render_page, NULL };
+    jkpdf_render_pages(surf, docs, n_docs, jkpdf_document_get_n_pages(docs[0]), &funcs, &params);
+
+    return jkpdf_check_surface_status(surf, error);
+}
@@ -0,0 +1,145 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include "jkpdf.h"
+#include "jkpdf-pool.h"
+
+// Scaling pages onto a given page format, used by jkpdftool-pagefit and
+// libjkpdf
+
+static inline void
+_jkpdf_swap_doubles(double *a, double *b)
+{
+    double tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static inline cairo_rectangle_t
+_jkpdf_pagefit_target_rect(const JkPdfPagefitOptions *options, const cairo_rectangle_t *source_r)
+{
+    cairo_rectangle_t page_r = { 0, 0, options->width, options->height };
+
+    if (options->width == 0.0 || options->height == 0.0) {
+        page_r.width = source_r->width;
+        page_r.height = source_r->height;
+    }
+
+    if (options->orientation == JKPDF_ORIENTATION_AUTO) {
+        if ((source_r->width > source_r->height && page_r.width < page_r.height) ||
+            (source_r->width < source_r->height && page_r.width > page_r.height)) {
+            _jkpdf_swap_doubles(&page_r.width, &page_r.height);
+        }
+    } else if (options->orientation == JKPDF_ORIENTATION_LANDSCAPE) {
+        if (page_r.width < page_r.height) {
+            _jkpdf_swap_doubles(&page_r.width, &page_r.height);
+        }
+    } else if (options->orientation == JKPDF_ORIENTATION_PORTRAIT) {
+        if (page_r.width > page_r.height) {
+            _jkpdf_swap_doubles(&page_r.width, &page_r.height);
+        }
+    }
+
+    return page_r;
+}
+
+static inline void
+_jkpdf_pagefit_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    const JkPdfPagefitOptions *options = user_data;
+
+    cairo_rectangle_t source_r = { 0, 0, 0, 0 };
+    jkpdf_document_get_page_size(docs[0], pageno, &source_r.width, &source_r.height);
+
+    cairo_rectangle_t page_r = _jkpdf_pagefit_target_rect(options, &source_r);
+    *width = page_r.width;
+    *height = page_r.height;
+}
+
+static inline void
+_jkpdf_pagefit_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const JkPdfPagefitOptions *options = user_data;
+    const double *margins = options->margins;
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], pageno);
+
+    cairo_rectangle_t source_r = { 0, 0, 0, 0 };
+    jkpdf_page_get_size(page, &source_r.width, &source_r.height);
+
+    cairo_rectangle_t page_r = _jkpdf_pagefit_target_rect(options, &source_r);
+
+    page_r.x += margins[3];
+    page_r.y += margins[0];
+    page_r.width -= margins[3] + margins[1];
+    page_r.height -= margins[0] + margins[2];
+
+    cairo_matrix_t m = jkpdf_transform_rect_into_bounds_3(source_r, page_r, options->halign, options->valign, options->scale);
+    cairo_transform(cr, &m);
+    jkpdf_page_render(page, cr);
+}
+
+// Whether every page would come out as it is
+static inline gboolean
+jkpdf_pagefit_is_identity(JkPdfDocument *doc, const JkPdfPagefitOptions *options)
+{
+    const double *margins = options->margins;
+    if (margins[0] != 0.0 || margins[1] != 0.0 || margins[2] != 0.0 || margins[3] != 0.0)
+        return FALSE;
+
+    if (options->scale > 0.0 && options->scale != 1.0)
+        return FALSE;
+
+    // not worth waiting for all of it
+    if (jkpdf_document_is_streaming(doc))
+        return FALSE;
+
+    for (int pageno = 0; pageno < jkpdf_document_get_n_pages(doc); ++pageno) {
+        cairo_rectangle_t source_r = { 0, 0, 0, 0 };
+        jkpdf_document_get_page_size(doc, pageno, &source_r.width, &source_r.height);
+
+        // paper sizes given in mm never quite match the rounded sizes
+        // found in PDF files
+        cairo_rectangle_t page_r = _jkpdf_pagefit_target_rect(options, &source_r);
+        if (fabs(page_r.width - source_r.width) > 0.01 || fabs(page_r.height - source_r.height) > 0.01)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static inline gboolean
+jkpdf_pagefit_document(JkPdfDocument *doc, const JkPdfPagefitOptions *options, cairo_surface_t *surf, GError **error)
+{
+    const double *margins = options->margins;
+    gboolean have_margins = margins[0] != 0.0 || margins[1] != 0.0 || margins[2] != 0.0 || margins[3] != 0.0;
+
+    // checked up front, the pages are rendered on worker threads
+    for (int pageno = 0; have_margins && pageno < jkpdf_document_get_n_pages(doc); ++pageno) {
+        double w, h;
+        _jkpdf_pagefit_page_size(&doc, pageno, &w, &h, (gpointer)options);
+
+        if (margins[0] + margins[2] >= h || margins[1] + margins[3] >= w) {
+            g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_OPTIONS, "while processing page %d: margins greater than the page", pageno+1);
+            return FALSE;
+        }
+    }
+
+    static const JkPdfPageFuncs funcs = { _jkpdf_pagefit_page_size, _jkpdf_pagefit_render_page, NULL };
+    jkpdf_render_pages(surf, &doc, 1, JKPDF_EACH_INPUT_PAGE, &funcs, (gpointer)options);
+
+    return jkpdf_check_surface_status(surf, error);
+}
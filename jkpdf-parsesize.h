@@ -19,6 +19,7 @@
 #include <glib.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <errno.h>
 #include <string.h>
 #include <math.h>
 
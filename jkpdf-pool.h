@@ -0,0 +1,1262 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include "jkpdf-document.h"
+#include "jkpdf-ranges.h"
+
+#include <math.h>
+
+// Page rendering, optionally spread over a pool of worker threads.
+//
+// A tool describes its output as a sequence of pages. For every output page,
+// page_size() must return the page dimensions and render_page() must draw the
+// page content. Both callbacks get the documents they should read from, which
+// are private copies when running on a worker thread. The callbacks may be
+// called concurrently for different pages and must not modify shared state.
+//
+// Worker threads render into recording surfaces, which are then replayed
+// strictly in order onto the output surface. The number of threads is taken
+// from the JKPDF_THREADS environment variable ("0" means one thread per CPU).
+// By default, everything is rendered directly on the calling thread. The
+// same happens if a document cannot be opened a second time, like poppler
+// documents handed to libjkpdf which were not opened by jkpdf_open_pdf().
+//
+// If the output surface feeds the next tool of an in-process pipeline, the
+// pages are recorded and handed over instead. With CairoScript output, every
+// page gets its own script surface. In preview mode (see jkpdf-io.h), only
+// the one requested page is rendered, so tools get to preview any page at
+// the cost of the input pages it is made of.
+//
+// With JKPDF_MEMORY_LIMIT (see jkpdf-memory.h), workers stop picking up new
+// pages while the process is above the limit, until the pages in flight have
+// been replayed and freed.
+//
+// With --estimate (see jkpdf-io.h), nothing is rendered. The page sizes and
+// the rasters reported by page_raster() go into an estimate instead.
+//
+// Long jobs can be resumed after being interrupted, see --checkpoint below.
+//
+// Tools working page by page take --pages to transform only some of the
+// pages (see below). Output page n is input page n of the first document
+// for them, so all other pages are just copied without asking the tool.
+
+typedef void (*JkPdfPageSizeFunc)(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data);
+typedef void (*JkPdfPageRenderFunc)(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data);
+typedef guint64 (*JkPdfPageRasterFunc)(JkPdfDocument **docs, int pageno, gpointer user_data);
+
+typedef struct {
+    JkPdfPageSizeFunc   page_size;
+    JkPdfPageRenderFunc render_page;
+    JkPdfPageRasterFunc page_raster; // optional, bytes of image surfaces needed to render a page
+} JkPdfPageFuncs;
+
+// As n_pages for tools turning input page n into output page n: as many
+// pages as the first document has. Streamed input (see jkpdf-document.h) is
+// then rendered page by page as it arrives, instead of after all of it.
+#define JKPDF_EACH_INPUT_PAGE (-1)
+
+static inline gboolean
+_jkpdf_have_page(JkPdfDocument **docs, int pageno, int n_pages)
+{
+    if (n_pages == JKPDF_EACH_INPUT_PAGE)
+        return jkpdf_document_wait_for_page(docs[0], pageno);
+
+    return pageno < n_pages;
+}
+
+static inline int
+jkpdf_get_thread_count(void)
+{
+    const char *env = g_getenv("JKPDF_THREADS");
+    if (!env || !*env)
+        return 1;
+
+    char *end = NULL;
+    long n = strtol(env, &end, 10);
+    if (*end || n < 0 || n > 1024) {
+        fprintf(stderr, "WARN: ignoring invalid JKPDF_THREADS value '%s'\n", env);
+        return 1;
+    }
+
+    if (n == 0)
+        return (int)g_get_num_processors();
+
+    return (int)n;
+}
+
+// Surfaces other than PDF (supplied by libjkpdf users) have a fixed size
+static inline void
+_jkpdf_set_page_size(cairo_surface_t *surf, double width, double height)
+{
+    if (cairo_surface_get_type(surf) == CAIRO_SURFACE_TYPE_PDF)
+        cairo_pdf_surface_set_size(surf, width, height);
+}
+
+static inline gboolean
+jkpdf_check_surface_status(cairo_surface_t *surf, GError **error)
+{
+    const GError *render_error = cairo_surface_get_user_data(surf, &jkpdf_render_error_key);
+    if (render_error) {
+        g_propagate_error(error, g_error_copy(render_error));
+        return FALSE;
+    }
+
+    cairo_status_t status = cairo_surface_status(surf);
+    if (status) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_OUTPUT, "cairo status: %s", cairo_status_to_string(status));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+typedef struct {
+    cairo_surface_t *recording;
+    double width;
+    double height;
+    gint64 render_usec; // spent by the worker, for --stats
+} JkPdfPoolSlot;
+
+typedef struct {
+    GMutex lock;
+    GCond  cond;
+
+    JkPdfDocument **docs;
+    int n_docs;
+    int n_pages;
+    const JkPdfPageFuncs *funcs;
+    gpointer user_data;
+    JkPdfStats *stats; // of the output surface
+
+    int next_page;     // next page to be picked up by a worker
+    int emitted_pages; // pages already replayed onto the output surface
+    int window;        // maximum number of pages in flight
+    JkPdfPoolSlot *slots;
+
+    guint64 memory_limit;
+} JkPdfPool;
+
+// Called with the lock held
+static inline gboolean
+_jkpdf_pool_must_wait(JkPdfPool *pool)
+{
+    if (pool->next_page >= pool->n_pages)
+        return FALSE;
+
+    if (pool->next_page >= pool->emitted_pages + pool->window)
+        return TRUE;
+
+    // one page always makes progress, no matter how much memory it takes
+    return pool->memory_limit
+        && pool->next_page > pool->emitted_pages
+        && jkpdf_memory_rss() > pool->memory_limit;
+}
+
+// Rasterizing
+//
+// Prepares an ARGB32 image of a page of the given size at dpi, reusing
+// *psurf if it has the right size, and paints it white. Returns a context
+// for drawing the page in page coordinates.
+static inline cairo_t *
+jkpdf_raster_begin(cairo_surface_t **psurf, double pagewidth, double pageheight, double dpi)
+{
+    int imgwidth = (int)round(pagewidth * dpi / 72.0);
+    int imgheight = (int)round(pageheight * dpi / 72.0);
+
+    if (*psurf) {
+        int oldwidth = cairo_image_surface_get_width(*psurf);
+        int oldheight = cairo_image_surface_get_height(*psurf);
+
+        if (oldwidth != imgwidth || oldheight != imgheight) {
+            cairo_surface_destroy(*psurf);
+            *psurf = NULL;
+        }
+    }
+
+    if (!*psurf) {
+        *psurf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, imgwidth, imgheight);
+    }
+
+    cairo_t *cr = cairo_create(*psurf);
+
+    // white bg
+    cairo_save(cr);
+    cairo_rectangle(cr, 0, 0, imgwidth, imgheight);
+    cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 1.0);
+    cairo_fill(cr);
+    cairo_restore(cr);
+
+    cairo_scale(cr, imgwidth/pagewidth, imgheight/pageheight);
+
+    return cr;
+}
+
+// Time budget
+//
+// With --page-budget SECONDS, every output page which takes longer to
+// render is replaced by an image of its recording at --fallback-dpi
+// (default 300), like jkpdftool-rasterize would do it. Pages with huge
+// numbers of paths are then not written to the output as vectors, which
+// would take even longer and make the output huge. Such pages are reported
+// on stderr. Pages are always recorded first when there is a budget, and
+// the budget is only checked once the recording is complete: it bounds
+// what is written, not how long a page takes to render.
+
+// for the --help of the tools
+#define JKPDF_BUDGET_HELP \
+    "Time budget:\n" \
+    "  With --page-budget SECONDS, a page which takes longer to render is turned\n" \
+    "  into a bitmap at --fallback-dpi DPI (default 300), and the tool carries on.\n" \
+    "  Its text and vector graphics are gone from the output, nothing but a\n" \
+    "  warning on stderr tells which pages were replaced. The budget limits\n" \
+    "  what is written, not the render time: a page is checked only after it\n" \
+    "  has been rendered in full, then rastered on top of that.\n"
+
+typedef struct {
+    double seconds; // 0 for no budget
+    double dpi;
+} JkPdfBudget;
+
+// set by jkpdf_take_budget_args() at the start of every tool
+static JkPdfBudget jkpdf_budget = { 0.0, 300.0 };
+
+static inline void
+jkpdf_take_budget_args(int *argc, char **argv)
+{
+    g_autofree gchar *seconds = jkpdf_take_arg(argc, argv, "--page-budget");
+    g_autofree gchar *dpi = jkpdf_take_arg(argc, argv, "--fallback-dpi");
+
+    jkpdf_budget.seconds = 0.0;
+    jkpdf_budget.dpi = 300.0;
+
+    if (seconds) {
+        char *end = NULL;
+        double d = g_ascii_strtod(seconds, &end);
+        if (*end || end == seconds || !(d > 0.0 && d < 1e6)) {
+            fprintf(stderr, "ERROR: invalid --page-budget '%s'\n", seconds);
+            exit(1);
+        }
+
+        jkpdf_budget.seconds = d;
+    }
+
+    if (dpi) {
+        char *end = NULL;
+        double d = g_ascii_strtod(dpi, &end);
+        if (*end || end == dpi || !(d > 0.0 && d <= 2400.0)) {
+            fprintf(stderr, "ERROR: invalid --fallback-dpi '%s'\n", dpi);
+            exit(1);
+        }
+
+        jkpdf_budget.dpi = d;
+    }
+}
+
+// Replaces a page which took too long by an image of it. Replaying the
+// recording is much cheaper than interpreting the page a second time.
+static inline cairo_surface_t *
+_jkpdf_budget_fallback(cairo_surface_t *page, double width, double height)
+{
+    g_autoptr(JKPdfCairoSurfaceT) image = NULL;
+    {
+        g_autoptr(JKPdfCairoT) cr = jkpdf_raster_begin(&image, width, height, jkpdf_budget.dpi);
+        cairo_set_source_surface(cr, page, 0, 0);
+        cairo_paint(cr);
+    }
+    cairo_surface_flush(image);
+
+    cairo_rectangle_t extents = { 0, 0, width, height };
+    cairo_surface_t *recording = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+
+    g_autoptr(JKPdfCairoT) cr = cairo_create(recording);
+    cairo_scale(cr, width / cairo_image_surface_get_width(image), height / cairo_image_surface_get_height(image));
+    cairo_set_source_surface(cr, image, 0, 0);
+    cairo_rectangle(cr, 0, 0, cairo_image_surface_get_width(image), cairo_image_surface_get_height(image));
+    cairo_fill(cr);
+
+    return recording;
+}
+
+static inline cairo_surface_t *
+_jkpdf_record_page(JkPdfDocument **docs, int pageno, const JkPdfPageFuncs *funcs, gpointer user_data, double *width, double *height)
+{
+    funcs->page_size(docs, pageno, width, height, user_data);
+
+    gint64 start = g_get_monotonic_time();
+
+    cairo_rectangle_t extents = { 0, 0, *width, *height };
+    cairo_surface_t *recording = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+
+    {
+        g_autoptr(JKPdfCairoT) cr = cairo_create(recording);
+        funcs->render_page(cr, docs, pageno, user_data);
+    }
+
+    double elapsed = (double)(g_get_monotonic_time() - start) / G_USEC_PER_SEC;
+    if (jkpdf_budget.seconds > 0.0 && elapsed > jkpdf_budget.seconds) {
+        fprintf(stderr, "WARN: page %d took %.1fs to render, using an image at %g dpi instead\n", pageno + 1, elapsed, jkpdf_budget.dpi);
+
+        cairo_surface_t *image = _jkpdf_budget_fallback(recording, *width, *height);
+        cairo_surface_destroy(recording);
+        recording = image;
+    }
+
+    return recording;
+}
+
+static inline gpointer
+_jkpdf_pool_worker(gpointer data)
+{
+    JkPdfPool *pool = data;
+
+    // reopening documents counts towards the same run
+    jkpdf_stats_set_current(pool->stats);
+
+    // poppler objects must not be shared between threads, so every worker
+    // opens its own copy of the documents
+    GPtrArray *docs = g_ptr_array_new_full((guint)pool->n_docs, (GDestroyNotify)jkpdf_document_unref);
+    for (int i = 0; i < pool->n_docs; ++i) {
+        g_ptr_array_add(docs, jkpdf_document_duplicate(pool->docs[i]));
+    }
+
+    for (;;) {
+        g_mutex_lock(&pool->lock);
+        while (_jkpdf_pool_must_wait(pool))
+            g_cond_wait(&pool->cond, &pool->lock);
+
+        if (pool->next_page >= pool->n_pages) {
+            g_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        int pageno = pool->next_page++;
+        g_mutex_unlock(&pool->lock);
+
+        gint64 start = jkpdf_stats_now(pool->stats);
+
+        double w = 0, h = 0;
+        cairo_surface_t *recording = _jkpdf_record_page((JkPdfDocument **)docs->pdata, pageno, pool->funcs, pool->user_data, &w, &h);
+
+        g_mutex_lock(&pool->lock);
+        JkPdfPoolSlot *slot = &pool->slots[pageno % pool->window];
+        slot->recording = recording;
+        slot->width = w;
+        slot->height = h;
+        slot->render_usec = jkpdf_stats_now(pool->stats) - start;
+        g_cond_broadcast(&pool->cond);
+        g_mutex_unlock(&pool->lock);
+
+        jkpdf_stats_span(pool->stats, "render page", start, pageno, w, h);
+    }
+
+    // The recordings may still reference fonts owned by our documents,
+    // so they are only released after all pages have been replayed.
+    return docs;
+}
+
+// Accounts output page pageno for --stats and the trace, once it has been
+// shown. start is when this thread began working on it, other_usec the time
+// spent elsewhere. Checkpoint chunks have no stats, their pages are
+// accounted when they are copied to the output.
+static inline void
+_jkpdf_stats_page(cairo_surface_t *surf, const char *name, int pageno, gint64 start, gint64 other_usec, double width, double height)
+{
+    JkPdfStats *stats = jkpdf_surface_get_stats(surf);
+    if (!stats)
+        return;
+
+    JkPdfWriter *writer = jkpdf_surface_get_writer(surf);
+    jkpdf_stats_add_page(stats, pageno, jkpdf_stats_now(stats) - start + other_usec, writer ? writer->bytes_produced : 0);
+    jkpdf_stats_span(stats, name, start, stats->page_offset + pageno, width, height);
+}
+
+// Draws one page onto a fresh CairoScript surface
+static inline void
+_jkpdf_script_page(cairo_device_t *script, double w, double h, cairo_surface_t *recording, JkPdfDocument **docs, int pageno, const JkPdfPageFuncs *funcs, gpointer user_data)
+{
+    g_autoptr(JKPdfCairoSurfaceT) page = cairo_script_surface_create(script, CAIRO_CONTENT_COLOR_ALPHA, w, h);
+    g_autoptr(JKPdfCairoT) cr = cairo_create(page);
+
+    if (recording) {
+        cairo_set_source_surface(cr, recording, 0, 0);
+        cairo_paint(cr);
+    } else {
+        funcs->render_page(cr, docs, pageno, user_data);
+    }
+
+    cairo_show_page(cr);
+    JKPDF_PROBE1(page_show, pageno + 1);
+
+    cairo_status_t status = cairo_status(cr);
+    if (status)
+        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+}
+
+static inline void
+_jkpdf_render_pages_sequential(cairo_surface_t *surf, JkPdfDocument *sink, JkPdfDocument **docs, int n_pages, const JkPdfPageFuncs *funcs, gpointer user_data)
+{
+    JkPdfStats *stats = jkpdf_surface_get_stats(surf);
+
+    if (sink) {
+        for (int pageno = 0; _jkpdf_have_page(docs, pageno, n_pages); ++pageno) {
+            gint64 start = jkpdf_stats_now(stats);
+
+            double w = 0, h = 0;
+            cairo_surface_t *recording = _jkpdf_record_page(docs, pageno, funcs, user_data, &w, &h);
+            jkpdf_document_add_recorded_page(sink, recording, w, h);
+
+            _jkpdf_stats_page(surf, "render page", pageno, start, 0, w, h);
+        }
+
+        return;
+    }
+
+    // see _jkpdf_record_page()
+    gboolean record = jkpdf_budget.seconds > 0.0;
+
+    cairo_device_t *script = jkpdf_get_script_device(surf);
+    if (script) {
+        for (int pageno = 0; _jkpdf_have_page(docs, pageno, n_pages); ++pageno) {
+            gint64 start = jkpdf_stats_now(stats);
+
+            double w = 0, h = 0;
+            g_autoptr(JKPdfCairoSurfaceT) recording = NULL;
+            if (record)
+                recording = _jkpdf_record_page(docs, pageno, funcs, user_data, &w, &h);
+            else
+                funcs->page_size(docs, pageno, &w, &h, user_data);
+
+            _jkpdf_script_page(script, w, h, recording, docs, pageno, funcs, user_data);
+            jkpdf_flush_script_output(surf);
+
+            _jkpdf_stats_page(surf, "render page", pageno, start, 0, w, h);
+        }
+
+        return;
+    }
+
+    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
+
+    for (int pageno = 0; _jkpdf_have_page(docs, pageno, n_pages); ++pageno) {
+        gint64 start = jkpdf_stats_now(stats);
+
+        double w = 0, h = 0;
+        g_autoptr(JKPdfCairoSurfaceT) recording = NULL;
+        if (record)
+            recording = _jkpdf_record_page(docs, pageno, funcs, user_data, &w, &h);
+        else
+            funcs->page_size(docs, pageno, &w, &h, user_data);
+
+        _jkpdf_set_page_size(surf, w, h);
+
+        cairo_save(cr);
+        if (recording) {
+            cairo_set_source_surface(cr, recording, 0, 0);
+            cairo_paint(cr);
+        } else {
+            funcs->render_page(cr, docs, pageno, user_data);
+        }
+        cairo_restore(cr);
+
+        cairo_surface_show_page(surf);
+        JKPDF_PROBE1(page_show, pageno + 1);
+
+        _jkpdf_stats_page(surf, "render page", pageno, start, 0, w, h);
+    }
+
+    cairo_status_t status = cairo_status(cr);
+    if (status)
+        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+}
+
+// Page selection
+//
+// The selection is attached to the output surface, so that tools only need
+// to parse the option and pass it on.
+
+typedef struct {
+    int n_pages; // up to the last selected page, at most the whole document
+    gboolean *selected;
+} JkPdfPageSelection;
+
+static const cairo_user_data_key_t jkpdf_page_selection_key;
+
+static inline void
+jkpdf_page_selection_free(JkPdfPageSelection *selection)
+{
+    if (!selection)
+        return;
+
+    g_free(selection->selected);
+    g_free(selection);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(JkPdfPageSelection, jkpdf_page_selection_free)
+
+// Parses a page range like "1-2,5,7", see jkpdf-ranges.h
+static inline JkPdfPageSelection *
+jkpdf_page_selection_new(const char *pages, int n_pages, GError **error)
+{
+    g_autoptr(GArray) page_range = jkpdf_parse_range(pages, error);
+    if (!page_range)
+        return NULL;
+
+    g_autoptr(GArray) page_list = jkpdf_expand_page_range(page_range, n_pages, error);
+    if (!page_list)
+        return NULL;
+
+    JkPdfPageSelection *selection = g_new0(JkPdfPageSelection, 1);
+    selection->n_pages = n_pages;
+    selection->selected = g_new0(gboolean, n_pages);
+    for (guint i = 0; i < page_list->len; ++i)
+        selection->selected[g_array_index(page_list, int, i) - 1] = TRUE;
+
+    return selection;
+}
+
+// NULL selects all pages
+static inline gboolean
+jkpdf_page_selection_contains(const JkPdfPageSelection *selection, int pageno)
+{
+    return !selection || (pageno < selection->n_pages && selection->selected[pageno]);
+}
+
+// Adds --pages to the options of a tool
+static inline void
+jkpdf_add_pages_option(GOptionContext *context, gchar **arg_pages)
+{
+    GOptionEntry entries[] = {
+        { "pages", 0, 0, G_OPTION_ARG_STRING, arg_pages, "Only transform these pages, copy the others as they are", "PAGESPEC" },
+        { NULL }
+    };
+
+    g_option_context_add_main_entries(context, entries, NULL);
+}
+
+// For tools without GOption: removes --pages SPEC or --pages=SPEC from argv
+static inline gchar *
+jkpdf_take_pages_arg(int *argc, char **argv)
+{
+    return jkpdf_take_arg(argc, argv, "--pages");
+}
+
+// Parses the --pages option of a tool, exits on errors. Returns NULL if all
+// pages are selected.
+static inline JkPdfPageSelection *
+jkpdf_parse_pages_option(const char *pages, JkPdfDocument *doc)
+{
+    if (!pages || !*pages)
+        return NULL;
+
+    // Every range ends, so a CairoScript stream only needs to be read up to
+    // the last selected page rather than to its end
+    int n_pages = 0;
+    g_autoptr(GArray) page_range = jkpdf_parse_range(pages, NULL);
+    for (guint i = 0; page_range && i < page_range->len; ++i) {
+        struct jkpdf_range_expr range = g_array_index(page_range, struct jkpdf_range_expr, i);
+        n_pages = MAX(n_pages, MAX(range.begin, range.end));
+    }
+
+    if (!jkpdf_document_is_streaming(doc) || !jkpdf_document_wait_for_page(doc, n_pages - 1))
+        n_pages = jkpdf_document_get_n_pages(doc);
+
+    g_autoptr(GError) error = NULL;
+    JkPdfPageSelection *selection = jkpdf_page_selection_new(pages, n_pages, &error);
+    if (!selection) {
+        fprintf(stderr, "ERROR: invalid page selection '%s': %s\n", pages, error->message);
+        exit(1);
+    }
+
+    return selection;
+}
+
+// Takes ownership of the selection
+static inline void
+jkpdf_surface_set_page_selection(cairo_surface_t *surf, JkPdfPageSelection *selection)
+{
+    cairo_surface_set_user_data(surf, &jkpdf_page_selection_key, selection, (cairo_destroy_func_t)jkpdf_page_selection_free);
+}
+
+typedef struct {
+    const JkPdfPageSelection *selection;
+    const JkPdfPageFuncs *funcs;
+    gpointer user_data;
+} JkPdfSelectedPages;
+
+static inline void
+_jkpdf_selected_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    const JkPdfSelectedPages *sel = user_data;
+
+    if (jkpdf_page_selection_contains(sel->selection, pageno))
+        sel->funcs->page_size(docs, pageno, width, height, sel->user_data);
+    else
+        jkpdf_document_get_page_size(docs[0], pageno, width, height);
+}
+
+static inline void
+_jkpdf_selected_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const JkPdfSelectedPages *sel = user_data;
+
+    if (jkpdf_page_selection_contains(sel->selection, pageno)) {
+        sel->funcs->render_page(cr, docs, pageno, sel->user_data);
+    } else {
+        g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], pageno);
+        jkpdf_page_render(page, cr);
+    }
+}
+
+static inline guint64
+_jkpdf_selected_page_raster(JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const JkPdfSelectedPages *sel = user_data;
+
+    if (!sel->funcs->page_raster || !jkpdf_page_selection_contains(sel->selection, pageno))
+        return 0;
+
+    return sel->funcs->page_raster(docs, pageno, sel->user_data);
+}
+
+static inline gint
+_jkpdf_compare_raster_desc(gconstpointer a, gconstpointer b)
+{
+    guint64 x = *(const guint64 *)a;
+    guint64 y = *(const guint64 *)b;
+
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Rasters worth as much as rendering one simple page: A4 at 300 dpi, ARGB32
+#define JKPDF_ESTIMATE_RASTER_BYTES_PER_PAGE (2480.0 * 3508.0 * 4.0)
+
+// Writes the estimate for rendering the pages as JSON to stdout. The peak
+// raster memory assumes the largest pages are rendered at the same time.
+static inline void
+_jkpdf_render_estimate(JkPdfDocument **docs, int n_docs, int n_pages, const JkPdfPageFuncs *funcs, gpointer user_data)
+{
+    int n_threads = MAX(1, MIN(jkpdf_get_thread_count(), n_pages));
+    for (int i = 0; i < n_docs; ++i) {
+        if (!jkpdf_document_can_duplicate(docs[i]))
+            n_threads = 1;
+    }
+
+    g_autoptr(GArray) rasters = g_array_sized_new(FALSE, TRUE, sizeof(guint64), (guint)n_pages);
+    double output_area = 0;
+    double raster_total = 0;
+
+    for (int pageno = 0; pageno < n_pages; ++pageno) {
+        double w = 0, h = 0;
+        funcs->page_size(docs, pageno, &w, &h, user_data);
+        output_area += w * h;
+
+        guint64 raster = funcs->page_raster ? funcs->page_raster(docs, pageno, user_data) : 0;
+        g_array_append_val(rasters, raster);
+        raster_total += (double)raster;
+    }
+
+    g_array_sort(rasters, _jkpdf_compare_raster_desc);
+
+    guint64 peak_raster = 0;
+    for (guint i = 0; i < rasters->len && i < (guint)n_threads; ++i)
+        peak_raster += g_array_index(rasters, guint64, i);
+
+    int input_pages = 0;
+    guint64 input_bytes = 0;
+    double render_cost = raster_total / JKPDF_ESTIMATE_RASTER_BYTES_PER_PAGE;
+
+    for (int i = 0; i < n_docs; ++i) {
+        int n = jkpdf_document_get_n_pages(docs[i]);
+        for (int pageno = 0; pageno < n; ++pageno)
+            render_cost += jkpdf_document_estimate_page_cost(docs[i], pageno);
+
+        input_pages += n;
+        if (docs[i]->bytes)
+            input_bytes += g_bytes_get_size(docs[i]->bytes);
+    }
+
+    printf("{\"output_pages\": %d, \"output_area_pt2\": %.0f, \"input_pages\": %d, \"input_bytes\": %" G_GUINT64_FORMAT ", "
+           "\"threads\": %d, \"peak_raster_bytes\": %" G_GUINT64_FORMAT ", \"render_cost\": %.2f}\n",
+           n_pages, output_area, input_pages, input_bytes, n_threads, peak_raster, render_cost);
+    fflush(stdout);
+}
+
+// Renders nothing but the requested page, as PNG
+static inline void
+_jkpdf_render_preview(const JkPdfPreview *preview, JkPdfDocument **docs, int n_pages, const JkPdfPageFuncs *funcs, gpointer user_data)
+{
+    int pageno = preview->page - 1;
+    if (pageno >= n_pages) {
+        fprintf(stderr, "ERROR: cannot preview page %d, the output has %d pages\n", preview->page, n_pages);
+        exit(1);
+    }
+
+    double w = 0, h = 0;
+    funcs->page_size(docs, pageno, &w, &h, user_data);
+
+    double scale = preview->dpi / 72.0;
+    int width = MAX(1, (int)ceil(w * scale));
+    int height = MAX(1, (int)ceil(h * scale));
+
+    g_autoptr(JKPdfCairoSurfaceT) image = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    {
+        g_autoptr(JKPdfCairoT) cr = cairo_create(image);
+        cairo_set_source_rgb(cr, 1, 1, 1);
+        cairo_paint(cr);
+
+        cairo_scale(cr, scale, scale);
+        funcs->render_page(cr, docs, pageno, user_data);
+    }
+
+    JkPdfWriter *writer = jkpdf_writer_new(1, NULL);
+    cairo_status_t status = cairo_surface_write_to_png_stream(image, _jkpdf_cairo_write_to_stdout, writer);
+    int write_error = jkpdf_writer_finish(writer);
+    jkpdf_writer_close(writer);
+
+    if (write_error) {
+        fprintf(stderr, "ERROR: could not write preview: %s\n", g_strerror(write_error));
+        exit(1);
+    }
+    if (status) {
+        fprintf(stderr, "ERROR: could not write preview: %s\n", cairo_status_to_string(status));
+        exit(1);
+    }
+}
+
+static const cairo_user_data_key_t jkpdf_worker_docs_key;
+
+// The recordings replayed onto surf reference fonts of the worker copies,
+// and Type 3 glyphs are only emitted when surf is finished.
+static inline void
+_jkpdf_surface_keep_alive(cairo_surface_t *surf, JkPdfDocument *doc)
+{
+    GPtrArray *docs = cairo_surface_get_user_data(surf, &jkpdf_worker_docs_key);
+    if (!docs) {
+        docs = g_ptr_array_new_with_free_func((GDestroyNotify)jkpdf_document_unref);
+        cairo_surface_set_user_data(surf, &jkpdf_worker_docs_key, docs, (cairo_destroy_func_t)g_ptr_array_unref);
+    }
+
+    g_ptr_array_add(docs, jkpdf_document_ref(doc));
+}
+
+static inline void
+_jkpdf_render_pages(cairo_surface_t *surf, JkPdfDocument **docs, int n_docs, int n_pages, const JkPdfPageFuncs *funcs, gpointer user_data)
+{
+    const JkPdfPreview *preview = jkpdf_get_preview(surf);
+    if (preview) {
+        _jkpdf_render_preview(preview, docs, n_pages, funcs, user_data);
+        return;
+    }
+
+    if (jkpdf_get_estimate(surf)) {
+        _jkpdf_render_estimate(docs, n_docs, n_pages, funcs, user_data);
+        return;
+    }
+
+    JkPdfDocument *sink = jkpdf_get_page_sink(surf);
+    if (sink) {
+        // the recorded pages may reference fonts owned by our inputs
+        for (int i = 0; i < n_docs; ++i)
+            jkpdf_document_keep_alive(sink, docs[i]);
+    }
+
+    // streamed pages are only rendered on this thread, see jkpdf-document.h
+    int n_threads = n_pages == JKPDF_EACH_INPUT_PAGE ? 1 : MIN(jkpdf_get_thread_count(), n_pages);
+    for (int i = 0; i < n_docs; ++i) {
+        if (!jkpdf_document_can_duplicate(docs[i]))
+            n_threads = 1;
+    }
+
+    if (n_threads <= 1) {
+        _jkpdf_render_pages_sequential(surf, sink, docs, n_pages, funcs, user_data);
+        return;
+    }
+
+    // the copies made by the workers share the page geometry index
+    for (int i = 0; i < n_docs; ++i) {
+        if (jkpdf_document_is_pdf(docs[i]))
+            jkpdf_document_get_geometry(docs[i]);
+    }
+
+    JkPdfPool pool = {
+        .docs = docs,
+        .n_docs = n_docs,
+        .n_pages = n_pages,
+        .funcs = funcs,
+        .user_data = user_data,
+        .stats = jkpdf_surface_get_stats(surf),
+        .next_page = 0,
+        .emitted_pages = 0,
+        .window = n_threads * 4,
+        .memory_limit = jkpdf_memory_limit(),
+    };
+    g_mutex_init(&pool.lock);
+    g_cond_init(&pool.cond);
+    pool.slots = g_new0(JkPdfPoolSlot, pool.window);
+
+    g_autofree GThread **threads = g_new0(GThread *, n_threads);
+    for (int i = 0; i < n_threads; ++i) {
+        threads[i] = g_thread_new("jkpdf-render", _jkpdf_pool_worker, &pool);
+    }
+
+    cairo_device_t *script = jkpdf_get_script_device(surf);
+    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
+
+    for (int pageno = 0; pageno < n_pages; ++pageno) {
+        g_mutex_lock(&pool.lock);
+        JkPdfPoolSlot *slot = &pool.slots[pageno % pool.window];
+        while (!slot->recording)
+            g_cond_wait(&pool.cond, &pool.lock);
+
+        g_autoptr(JKPdfCairoSurfaceT) recording = g_steal_pointer(&slot->recording);
+        double w = slot->width;
+        double h = slot->height;
+        gint64 render_usec = slot->render_usec;
+
+        pool.emitted_pages++;
+        g_cond_broadcast(&pool.cond);
+        g_mutex_unlock(&pool.lock);
+
+        gint64 start = jkpdf_stats_now(pool.stats);
+
+        if (sink) {
+            jkpdf_document_add_recorded_page(sink, g_steal_pointer(&recording), w, h);
+        } else if (script) {
+            _jkpdf_script_page(script, w, h, recording, NULL, pageno, funcs, user_data);
+            jkpdf_flush_script_output(surf);
+        } else {
+            _jkpdf_set_page_size(surf, w, h);
+
+            cairo_save(cr);
+            cairo_set_source_surface(cr, recording, 0, 0);
+            cairo_paint(cr);
+            cairo_restore(cr);
+
+            cairo_surface_show_page(surf);
+            JKPDF_PROBE1(page_show, pageno + 1);
+        }
+
+        _jkpdf_stats_page(surf, "write page", pageno, start, render_usec, w, h);
+    }
+
+    for (int i = 0; i < n_threads; ++i) {
+        g_autoptr(GPtrArray) thread_docs = g_thread_join(threads[i]);
+
+        for (guint j = 0; j < thread_docs->len; ++j) {
+            JkPdfDocument *doc = g_ptr_array_index(thread_docs, j);
+            if (sink)
+                jkpdf_document_keep_alive(sink, doc);
+            else
+                _jkpdf_surface_keep_alive(surf, doc);
+        }
+    }
+
+    g_free(pool.slots);
+    g_cond_clear(&pool.cond);
+    g_mutex_clear(&pool.lock);
+
+    cairo_status_t status = cairo_status(cr);
+    if (status)
+        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+}
+
+// Checkpoints
+//
+// With --checkpoint DIR, the output is rendered in chunks of
+// --checkpoint-pages pages (default 100). Every chunk is written to DIR as
+// a PDF file and recorded in DIR/journal once it is safely on disk. Running
+// the same command on the same input again skips the chunks already done,
+// so an interrupted job loses at most one chunk of work. qpdf then
+// concatenates the chunks into the actual output, copying PDF objects like
+// jkpdftool-batch does. Without qpdf, or for CairoScript output, the pages
+// of the chunks are drawn to the output once more, which costs about as
+// much as rendering them did. DIR is left as it is, remove it once the
+// output is safe.
+
+typedef struct {
+    gchar *dir;      // NULL if not checkpointing
+    int chunk_pages;
+    gchar *command;  // identifies the job, together with the input
+} JkPdfCheckpoint;
+
+// set by jkpdf_take_checkpoint_args() at the start of every tool
+static JkPdfCheckpoint jkpdf_checkpoint = { NULL, 100, NULL };
+
+static const cairo_user_data_key_t jkpdf_checkpoint_key;
+
+static inline void
+jkpdf_take_checkpoint_args(int *argc, char **argv)
+{
+    g_autofree gchar *pages = jkpdf_take_arg(argc, argv, "--checkpoint-pages");
+
+    g_free(jkpdf_checkpoint.dir);
+    jkpdf_checkpoint.dir = jkpdf_take_arg(argc, argv, "--checkpoint");
+    jkpdf_checkpoint.chunk_pages = 100;
+
+    if (pages) {
+        char *end = NULL;
+        long n = strtol(pages, &end, 10);
+        if (*end || end == pages || n < 1 || n > G_MAXINT) {
+            fprintf(stderr, "ERROR: invalid --checkpoint-pages '%s'\n", pages);
+            exit(1);
+        }
+
+        jkpdf_checkpoint.chunk_pages = (int)n;
+    }
+
+    // whatever is left decides what the output looks like
+    g_autoptr(GString) command = g_string_new(NULL);
+    g_autofree gchar *tool = g_path_get_basename(argv[0]);
+    g_string_append(command, tool);
+    for (int i = 1; i < *argc; ++i) {
+        g_string_append_c(command, '\0');
+        g_string_append(command, argv[i]);
+    }
+
+    g_autofree gchar *command_sum = g_compute_checksum_for_data(G_CHECKSUM_SHA256, (const guchar *)command->str, command->len);
+
+    g_free(jkpdf_checkpoint.command);
+    jkpdf_checkpoint.command = g_strdup_printf("%s %d", command_sum, jkpdf_checkpoint.chunk_pages);
+}
+
+static inline gchar *
+_jkpdf_checkpoint_job_id(JkPdfDocument **docs, int n_docs, int n_pages)
+{
+    g_autoptr(GChecksum) sum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(sum, (const guchar *)jkpdf_checkpoint.command, -1);
+    g_checksum_update(sum, (const guchar *)&n_pages, sizeof(n_pages));
+
+    for (int i = 0; i < n_docs; ++i) {
+        if (docs[i]->bytes) {
+            gsize len = 0;
+            const guchar *data = g_bytes_get_data(docs[i]->bytes, &len);
+            g_checksum_update(sum, data, (gssize)len);
+            continue;
+        }
+
+        // recorded pages are not worth hashing, their sizes will have to do
+        for (int pageno = 0; pageno < jkpdf_document_get_n_pages(docs[i]); ++pageno) {
+            double size[2];
+            jkpdf_document_get_page_size(docs[i], pageno, &size[0], &size[1]);
+            g_checksum_update(sum, (const guchar *)size, sizeof(size));
+        }
+    }
+
+    return g_strdup(g_checksum_get_string(sum));
+}
+
+static inline void
+_jkpdf_checkpoint_sync(FILE *file, const char *path)
+{
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0) {
+        fprintf(stderr, "ERROR: while writing '%s': %s\n", path, strerror(errno));
+        exit(1);
+    }
+}
+
+// Opens the journal for appending and marks the chunks it lists as done.
+// Exits if the journal belongs to a different job.
+static inline FILE *
+_jkpdf_checkpoint_open_journal(const char *path, const char *job_id, gboolean *done, int n_chunks)
+{
+    g_autofree gchar *header = g_strdup_printf("jkpdf-checkpoint 1 %s", job_id);
+    g_autofree gchar *contents = NULL;
+    gboolean have_header = FALSE;
+
+    // a line only counts once its newline has been written
+    if (g_file_get_contents(path, &contents, NULL, NULL) && strchr(contents, '\n')) {
+        g_auto(GStrv) lines = g_strsplit(contents, "\n", -1);
+
+        if (strcmp(lines[0], header)) {
+            fprintf(stderr, "ERROR: checkpoint '%s' was made by a different command or input\n", path);
+            exit(1);
+        }
+
+        have_header = TRUE;
+
+        for (int i = 1; lines[i] && lines[i + 1]; ++i) {
+            int chunk = -1;
+            char tail;
+            if (sscanf(lines[i], "done %d%c", &chunk, &tail) == 1 && chunk >= 0 && chunk < n_chunks)
+                done[chunk] = TRUE;
+        }
+    }
+
+    FILE *journal = fopen(path, have_header ? "a" : "w");
+    if (!journal) {
+        fprintf(stderr, "ERROR: while opening '%s': %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    if (!have_header) {
+        fprintf(journal, "%s\n", header);
+        _jkpdf_checkpoint_sync(journal, path);
+    }
+
+    return journal;
+}
+
+typedef struct {
+    int first;
+    const JkPdfPageFuncs *funcs;
+    gpointer user_data;
+} JkPdfCheckpointChunk;
+
+static inline void
+_jkpdf_chunk_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    const JkPdfCheckpointChunk *chunk = user_data;
+
+    chunk->funcs->page_size(docs, chunk->first + pageno, width, height, chunk->user_data);
+}
+
+static inline void
+_jkpdf_chunk_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const JkPdfCheckpointChunk *chunk = user_data;
+
+    chunk->funcs->render_page(cr, docs, chunk->first + pageno, chunk->user_data);
+}
+
+static inline void
+_jkpdf_copy_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    (void)user_data;
+
+    jkpdf_document_get_page_size(docs[0], pageno, width, height);
+}
+
+static inline void
+_jkpdf_copy_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    (void)user_data;
+
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], pageno);
+    jkpdf_page_render(page, cr);
+}
+
+// Renders the pages of one chunk into a PDF file, which only appears under
+// its name once complete
+static inline void
+_jkpdf_checkpoint_write_chunk(const char *path, JkPdfStats *stats, JkPdfDocument **docs, int n_docs, int first, int count, const JkPdfPageFuncs *funcs, gpointer user_data)
+{
+    g_autofree gchar *tmp_path = g_strconcat(path, ".tmp", NULL);
+
+    g_autoptr(JKPdfCairoSurfaceT) surf = cairo_pdf_surface_create(tmp_path, 1, 1);
+    if (stats) {
+        cairo_surface_set_user_data(surf, &jkpdf_stats_key, jkpdf_stats_ref(stats), (cairo_destroy_func_t)jkpdf_stats_unref);
+        jkpdf_stats_set_page_offset(stats, first);
+    }
+
+    static const JkPdfPageFuncs chunk_funcs = { _jkpdf_chunk_page_size, _jkpdf_chunk_render_page, NULL };
+    JkPdfCheckpointChunk chunk = { first, funcs, user_data };
+    _jkpdf_render_pages(surf, docs, n_docs, count, &chunk_funcs, &chunk);
+
+    cairo_surface_finish(surf);
+
+    cairo_status_t status = cairo_surface_status(surf);
+    if (status) {
+        fprintf(stderr, "ERROR: while writing '%s': %s\n", tmp_path, cairo_status_to_string(status));
+        exit(1);
+    }
+
+    int fd = open(tmp_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) != 0 || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "ERROR: while writing '%s': %s\n", path, strerror(errno));
+        exit(1);
+    }
+    close(fd);
+}
+
+// Concatenates the chunks with qpdf and writes the result to the output
+// instead of whatever cairo would write. Returns FALSE if that did not work
+// out, the pages have to be copied then.
+static inline gboolean
+_jkpdf_checkpoint_concatenate(cairo_surface_t *surf, const char *dir, GPtrArray *chunk_paths)
+{
+    JkPdfWriter *writer = jkpdf_surface_get_writer(surf);
+    if (!writer || jkpdf_get_script_device(surf))
+        return FALSE;
+
+    g_autofree gchar *qpdf = g_find_program_in_path("qpdf");
+    if (!qpdf)
+        return FALSE;
+
+    g_autofree gchar *path = g_build_filename(dir, "output.pdf", NULL);
+
+    // like jkpdftool-splice-qpdf
+    g_autoptr(GPtrArray) argv = g_ptr_array_new();
+    g_ptr_array_add(argv, qpdf);
+    g_ptr_array_add(argv, "--pages");
+    for (guint i = 0; i < chunk_paths->len; ++i)
+        g_ptr_array_add(argv, g_ptr_array_index(chunk_paths, i));
+    g_ptr_array_add(argv, "--");
+    g_ptr_array_add(argv, "--empty");
+    g_ptr_array_add(argv, path);
+    g_ptr_array_add(argv, NULL);
+
+    g_autoptr(GError) error = NULL;
+    gint wait_status = 0;
+    if (!g_spawn_sync(NULL, (gchar **)argv->pdata, NULL, G_SPAWN_STDOUT_TO_DEV_NULL, NULL, NULL, NULL, NULL, &wait_status, &error)
+#if GLIB_CHECK_VERSION(2, 70, 0)
+        || !g_spawn_check_wait_status(wait_status, &error)) {
+#else
+        || !g_spawn_check_exit_status(wait_status, &error)) {
+#endif
+        fprintf(stderr, "WARN: checkpoint: qpdf failed, copying the pages instead: %s\n", error->message);
+        (void)unlink(path);
+        return FALSE;
+    }
+
+    g_autoptr(GBytes) bytes = jkpdf_read_commandline_arg(path);
+    (void)unlink(path);
+
+    if (!jkpdf_writer_take_over(writer))
+        return FALSE;
+
+    gsize len = 0;
+    const guint8 *data = g_bytes_get_data(bytes, &len);
+    jkpdf_writer_append(writer, data, len); // errors are reported by jkpdf_surface_finish()
+
+    return TRUE;
+}
+
+static inline void
+_jkpdf_render_checkpointed(cairo_surface_t *surf, JkPdfDocument **docs, int n_docs, int n_pages, const JkPdfPageFuncs *funcs, gpointer user_data)
+{
+    const char *dir = jkpdf_checkpoint.dir;
+    int chunk_pages = jkpdf_checkpoint.chunk_pages;
+    int n_chunks = (int)(((gint64)n_pages + chunk_pages - 1) / chunk_pages);
+
+    if (g_mkdir_with_parents(dir, 0777) != 0) {
+        fprintf(stderr, "ERROR: while creating '%s': %s\n", dir, strerror(errno));
+        exit(1);
+    }
+
+    g_autofree gchar *job_id = _jkpdf_checkpoint_job_id(docs, n_docs, n_pages);
+    g_autofree gchar *journal_path = g_build_filename(dir, "journal", NULL);
+    g_autofree gboolean *done = g_new0(gboolean, n_chunks + 1);
+    FILE *journal = _jkpdf_checkpoint_open_journal(journal_path, job_id, done, n_chunks);
+
+    g_autoptr(GPtrArray) chunk_paths = g_ptr_array_new_with_free_func(g_free);
+    int n_resumed = 0;
+
+    // pages are only accounted to the chunks if they are not copied later
+    JkPdfStats *stats = jkpdf_surface_get_stats(surf);
+    gboolean want_qpdf = jkpdf_surface_get_writer(surf) && !jkpdf_get_script_device(surf);
+    JkPdfStats *chunk_stats = want_qpdf ? stats : NULL;
+
+    for (int c = 0; c < n_chunks; ++c) {
+        gchar *path = g_strdup_printf("%s/chunk-%06d.pdf", dir, c);
+        g_ptr_array_add(chunk_paths, path);
+
+        int first = c * chunk_pages;
+        int count = MIN(chunk_pages, n_pages - first);
+
+        if (done[c] && g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+            n_resumed++;
+            continue;
+        }
+
+        _jkpdf_checkpoint_write_chunk(path, chunk_stats, docs, n_docs, first, count, funcs, user_data);
+
+        fprintf(journal, "done %d\n", c);
+        _jkpdf_checkpoint_sync(journal, journal_path);
+
+        if (jkpdf_verbose())
+            fprintf(stderr, "INFO: checkpoint: pages %d-%d done\n", first + 1, first + count);
+    }
+
+    fclose(journal);
+    jkpdf_stats_set_page_offset(stats, 0);
+
+    if (n_resumed && jkpdf_verbose())
+        fprintf(stderr, "INFO: checkpoint: reused %d of %d chunks from '%s'\n", n_resumed, n_chunks, dir);
+
+    // the output may reference fonts of the chunks until it is finished
+    GPtrArray *chunks = g_ptr_array_new_with_free_func((GDestroyNotify)jkpdf_document_unref);
+    cairo_surface_set_user_data(surf, &jkpdf_checkpoint_key, chunks, (cairo_destroy_func_t)g_ptr_array_unref);
+
+    for (int c = 0; c < n_chunks; ++c) {
+        const char *path = g_ptr_array_index(chunk_paths, (guint)c);
+        int count = MIN(chunk_pages, n_pages - c * chunk_pages);
+
+        g_autoptr(GBytes) bytes = jkpdf_read_commandline_arg(path);
+        g_autoptr(GError) error = NULL;
+        JkPdfDocument *chunk = jkpdf_document_new_from_bytes(bytes, &error);
+        if (!chunk) {
+            fprintf(stderr, "ERROR: while reading '%s': %s\n", path, error->message);
+            exit(1);
+        }
+
+        g_ptr_array_add(chunks, chunk);
+
+        if (jkpdf_document_get_n_pages(chunk) != count) {
+            fprintf(stderr, "ERROR: '%s' has %d pages instead of %d, remove it to render it again\n", path, jkpdf_document_get_n_pages(chunk), count);
+            exit(1);
+        }
+    }
+
+    if (want_qpdf && _jkpdf_checkpoint_concatenate(surf, dir, chunk_paths))
+        return;
+
+    if (jkpdf_verbose())
+        fprintf(stderr, "INFO: checkpoint: drawing the pages of all chunks to the output again\n");
+
+    for (int c = 0; c < n_chunks; ++c) {
+        JkPdfDocument *chunk = g_ptr_array_index(chunks, (guint)c);
+        int count = jkpdf_document_get_n_pages(chunk);
+
+        static const JkPdfPageFuncs copy_funcs = { _jkpdf_copy_page_size, _jkpdf_copy_render_page, NULL };
+        jkpdf_stats_set_page_offset(stats, c * chunk_pages);
+        _jkpdf_render_pages(surf, &chunk, 1, count, &copy_funcs, NULL);
+    }
+
+    jkpdf_stats_set_page_offset(stats, 0);
+}
+
+static inline void
+jkpdf_render_pages(cairo_surface_t *surf, JkPdfDocument **docs, int n_docs, int n_pages, const JkPdfPageFuncs *funcs, gpointer user_data)
+{
+    gboolean checkpoint = jkpdf_checkpoint.dir && !jkpdf_get_preview(surf) && !jkpdf_get_estimate(surf);
+    if (checkpoint && jkpdf_get_page_sink(surf)) {
+        fprintf(stderr, "WARN: ignoring --checkpoint, only the last tool of a pipeline can write checkpoints\n");
+        checkpoint = FALSE;
+    }
+
+    // only streamed input is worth waiting for page by page
+    if (n_pages == JKPDF_EACH_INPUT_PAGE && (!jkpdf_document_is_streaming(docs[0]) || jkpdf_get_preview(surf) || jkpdf_get_estimate(surf) || checkpoint))
+        n_pages = jkpdf_document_get_n_pages(docs[0]);
+
+    static const JkPdfPageFuncs selected_funcs = { _jkpdf_selected_page_size, _jkpdf_selected_render_page, _jkpdf_selected_page_raster };
+    const JkPdfPageSelection *selection = cairo_surface_get_user_data(surf, &jkpdf_page_selection_key);
+    JkPdfSelectedPages sel = { selection, funcs, user_data };
+    if (selection) {
+        funcs = &selected_funcs;
+        user_data = &sel;
+    }
+
+    if (checkpoint)
+        _jkpdf_render_checkpointed(surf, docs, n_docs, n_pages, funcs, user_data);
+    else
+        _jkpdf_render_pages(surf, docs, n_docs, n_pages, funcs, user_data);
+
+    // see jkpdf_page_render(), workers share image documents
+    for (int i = 0; i < n_docs; ++i) {
+        if (docs[i]->render_error)
+            jkpdf_surface_set_render_error(surf, docs[i]->render_error);
+    }
+}
@@ -0,0 +1,49 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+// Static probes
+//
+// When built with systemtap's <sys/sdt.h> (the Makefile checks for it), the
+// tools carry USDT probes for bpftrace, perf and systemtap. An unused probe
+// is a single nop, so they stay in release builds. Without the header, the
+// macros compile to nothing. All probes are in the "jkpdftool" provider:
+//
+//   document_open(bytes, n_pages)          PDF parsed by poppler
+//   page_render_start(page)                before poppler renders a page,
+//   page_render_done(page)                 and after (0-based input page)
+//   page_show(page)                        output page emitted (1-based)
+//   crop_scan_start(width, height)         jkpdftool-crop looks for borders
+//   crop_scan_done(left, right, top, bottom)   in an image of that size,
+//                                          result in pixels
+//   raster_pass_start(pass, width, height) jkpdftool-rasterize runs a pixel
+//   raster_pass_done(pass)                 pass ("grayscale", "transparent"
+//                                          or "chop") over a page image
+//
+// See the bpftrace/ directory for examples.
+
+#ifdef JKPDF_HAVE_SDT
+#include <sys/sdt.h>
+
+#define JKPDF_PROBE1(name, a)          STAP_PROBE1(jkpdftool, name, a)
+#define JKPDF_PROBE2(name, a, b)       STAP_PROBE2(jkpdftool, name, a, b)
+#define JKPDF_PROBE3(name, a, b, c)    STAP_PROBE3(jkpdftool, name, a, b, c)
+#define JKPDF_PROBE4(name, a, b, c, d) STAP_PROBE4(jkpdftool, name, a, b, c, d)
+#else
+#define JKPDF_PROBE1(name, a)          do { } while (0)
+#define JKPDF_PROBE2(name, a, b)       do { } while (0)
+#define JKPDF_PROBE3(name, a, b, c)    do { } while (0)
+#define JKPDF_PROBE4(name, a, b, c, d) do { } while (0)
+#endif
@@ -0,0 +1,132 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include <glib.h>
+
+// Page range parsing, e.g. "1-2,5,7"
+
+#define JKPDF_RANGE_ERROR jkpdf_range_error_quark()
+static inline GQuark jkpdf_range_error_quark(void)
+{
+    return g_quark_from_static_string("range-parse-error-quark");
+}
+
+enum {
+    JKPDF_RANGE_ERROR_PARSEFAIL,
+    JKPDF_RANGE_ERROR_ILLOGICAL,
+    JKPDF_RANGE_ERROR_PAGENOTFOUND
+};
+
+// num ::= '1'|'2'|...|'9' { '0'|...|'9' }
+static inline size_t _jkpdf_range_parse_num(const char *str, size_t i, int *num, GError **error)
+{
+    switch (str[i]) {
+        case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+            *num = str[i] - '0';
+            break;
+        default:
+            g_set_error(error, JKPDF_RANGE_ERROR, JKPDF_RANGE_ERROR_PARSEFAIL, "Unexpected '%c' at position %zu", str[i], i);
+            return (size_t)-1;
+    }
+
+    ++i;
+    size_t retval = 1;
+
+    for (;;) {
+        switch (str[i]) {
+            case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+                *num = *num * 10 + (str[i] - '0');
+                ++i;
+                ++retval;
+                break;
+            default:
+                return retval;
+        }
+    }
+}
+
+// expr ::= num [ '-' num ]
+struct jkpdf_range_expr { int begin; int end; };
+static inline size_t _jkpdf_range_parse_expr(const char *str, size_t i, struct jkpdf_range_expr *out, GError **error)
+{
+    size_t beginlen = _jkpdf_range_parse_num(str, i, &out->begin, error);
+    if (beginlen == (size_t)-1)
+        return (size_t)-1;
+
+    if (str[i + beginlen] == '-') {
+        size_t endlen = _jkpdf_range_parse_num(str, i + beginlen + 1, &out->end, error);
+        if (endlen == (size_t)-1)
+            return (size_t)-1;
+
+        return beginlen + endlen + 1;
+    } else {
+        out->end = out->begin;
+        return beginlen;
+    }
+}
+
+// range ::= expr { ',' expr }
+static inline GArray *jkpdf_parse_range(const char *str, GError **error)
+{
+    g_autoptr(GArray) arr = g_array_new(FALSE, TRUE, sizeof(struct jkpdf_range_expr));
+    struct jkpdf_range_expr tmp;
+
+    size_t exprlen = _jkpdf_range_parse_expr(str, 0, &tmp, error);
+    if (exprlen == (size_t)-1)
+        return NULL;
+
+    g_array_append_val(arr, tmp);
+    size_t i = exprlen;
+    for (;;) {
+        if (str[i] == ',') {
+            ++i;
+            exprlen = _jkpdf_range_parse_expr(str, i, &tmp, error);
+            if (exprlen == (size_t)-1)
+                return NULL;
+
+            i += exprlen;
+            g_array_append_val(arr, tmp);
+        } else if (str[i] == 0) {
+            return g_steal_pointer(&arr);
+        } else {
+            g_set_error(error, JKPDF_RANGE_ERROR, JKPDF_RANGE_ERROR_PARSEFAIL, "Unexpected '%c' at position %zu", str[i], i);
+            return NULL;
+        }
+    }
+}
+
+// Returns the 1-based page numbers selected by the ranges, in order
+static inline GArray *
+jkpdf_expand_page_range(GArray *page_range, int n_pages, GError **error)
+{
+    g_autoptr(GArray) pages = g_array_new(FALSE, TRUE, sizeof(int));
+
+    for (size_t i = 0; i < page_range->len; ++i) {
+        struct jkpdf_range_expr range = g_array_index(page_range, struct jkpdf_range_expr, i);
+        int inc = range.begin <= range.end ? 1 : -1;
+        for (int pageno = range.begin; (inc > 0 && pageno <= range.end) || (inc < 0 && pageno >= range.end); pageno += inc) {
+            if (pageno < 1 || pageno > n_pages) {
+                g_set_error(error, JKPDF_RANGE_ERROR, JKPDF_RANGE_ERROR_PAGENOTFOUND, "Page %d not found", pageno);
+                return NULL;
+            }
+
+            g_array_append_val(pages, pageno);
+        }
+    }
+
+    return g_steal_pointer(&pages);
+}
@@ -0,0 +1,447 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include "jkpdf.h"
+#include "jkpdf-pool.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Rasterizing pages, used by jkpdftool-rasterize and libjkpdf
+
+static inline void
+jkpdf_rasterize_page(cairo_surface_t **psurf, JkPdfPage *page, double dpi)
+{
+    double pagewidth, pageheight;
+    jkpdf_page_get_size(page, &pagewidth, &pageheight);
+
+    {
+        g_autoptr(JKPdfCairoT) cr = jkpdf_raster_begin(psurf, pagewidth, pageheight, dpi);
+        jkpdf_page_render(page, cr);
+    }
+
+    cairo_surface_flush(*psurf);
+}
+
+static inline void
+jkpdf_transparentize(cairo_surface_t *surf)
+{
+    cairo_surface_flush(surf);
+
+    int imgwidth  = cairo_image_surface_get_width(surf);
+    int imgheight = cairo_image_surface_get_height(surf);
+    int imgstride = cairo_image_surface_get_stride(surf);
+    unsigned char *imgdata = cairo_image_surface_get_data(surf);
+
+    JKPDF_PROBE3(raster_pass_start, "transparent", imgwidth, imgheight);
+
+    for (int y = 0; y < imgheight; ++y) {
+        for (int x = 0; x < imgwidth; ++x) {
+            uint32_t p;
+            memcpy(&p, &imgdata[y * imgstride + x*4], 4);
+
+            uint8_t a = (uint8_t)((p & 0xff000000) >> 24);
+            uint8_t r = (uint8_t)((p & 0x00ff0000) >> 16);
+            uint8_t g = (uint8_t)((p & 0x0000ff00) >> 8);
+            uint8_t b = (uint8_t)((p & 0x000000ff));
+
+            g_assert(a == 0xff);
+
+            uint8_t whiteness = MIN(r, MIN(g, b));
+            a = (uint8_t)(a - whiteness);
+            r = (uint8_t)(r - whiteness);
+            g = (uint8_t)(g - whiteness);
+            b = (uint8_t)(b - whiteness);
+
+            p = ((uint32_t)a << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+
+            memcpy(&imgdata[y * imgstride + x*4], &p, 4);
+        }
+    }
+
+    JKPDF_PROBE1(raster_pass_done, "transparent");
+
+    cairo_surface_mark_dirty(surf);
+}
+
+static inline void
+jkpdf_make_grayscale(cairo_surface_t *surf)
+{
+    cairo_surface_flush(surf);
+
+    int imgwidth  = cairo_image_surface_get_width(surf);
+    int imgheight = cairo_image_surface_get_height(surf);
+    int imgstride = cairo_image_surface_get_stride(surf);
+    unsigned char *imgdata = cairo_image_surface_get_data(surf);
+
+    JKPDF_PROBE3(raster_pass_start, "grayscale", imgwidth, imgheight);
+
+    for (int y = 0; y < imgheight; ++y) {
+        for (int x = 0; x < imgwidth; ++x) {
+            uint32_t p;
+            memcpy(&p, &imgdata[y * imgstride + x*4], 4);
+
+            uint8_t a = (uint8_t)((p & 0xff000000) >> 24);
+            uint8_t r = (uint8_t)((p & 0x00ff0000) >> 16);
+            uint8_t g = (uint8_t)((p & 0x0000ff00) >> 8);
+            uint8_t b = (uint8_t)((p & 0x000000ff));
+
+            uint8_t luminance = (uint8_t)((MIN(r, MIN(g, b)) + MAX(r, MAX(g, b))) / 2);
+
+            p = ((uint32_t)a << 24) | ((uint32_t)luminance << 16) | ((uint32_t)luminance << 8) | (uint32_t)luminance;
+
+            memcpy(&imgdata[y * imgstride + x*4], &p, 4);
+        }
+    }
+
+    JKPDF_PROBE1(raster_pass_done, "grayscale");
+
+    cairo_surface_mark_dirty(surf);
+}
+
+static inline bool
+_jkpdf_pixel_is_opaque(unsigned char *data, int imgstride, int x, int y)
+{
+    uint32_t p;
+    memcpy(&p, &data[y * imgstride + x * 4], 4);
+
+    return p > 0x00ffffff;
+}
+
+static inline int
+_jkpdf_border_left(unsigned char *data, int imgstride, int left, int y, int right)
+{
+    for (int i = 0; i < right-left; ++i) {
+        if (_jkpdf_pixel_is_opaque(data, imgstride, left + i, y))
+            return i;
+    }
+
+    return right - left;
+}
+
+static inline int
+_jkpdf_border_right(unsigned char *data, int imgstride, int left, int y, int right)
+{
+    for (int i = 0; i < right-left; ++i) {
+        if (_jkpdf_pixel_is_opaque(data, imgstride, right - i - 1, y))
+            return i;
+    }
+
+    return right - left;
+}
+
+static inline int
+_jkpdf_border_top(unsigned char *data, int imgstride, int top, int x, int bottom)
+{
+    for (int i = 0; i < bottom-top; ++i) {
+        if (_jkpdf_pixel_is_opaque(data, imgstride, x, top + i))
+            return i;
+    }
+
+    return bottom - top;
+}
+
+static inline int
+_jkpdf_border_bottom(unsigned char *data, int imgstride, int top, int x, int bottom)
+{
+    for (int i = 0; i < bottom-top; ++i) {
+        if (_jkpdf_pixel_is_opaque(data, imgstride, x, bottom - i - 1))
+            return i;
+    }
+
+    return bottom - top;
+}
+
+static inline void
+_jkpdf_emit_rect(unsigned char *data, int imgstride, int top, int right, int bottom, int left, bool debug, cairo_t *cr)
+{
+    cairo_save(cr);
+
+    if (debug) {
+        cairo_set_source_rgb(cr, 1.0, 0.0, 0.0);
+        cairo_rectangle(cr, left, top, right-left, bottom-top);
+        cairo_stroke(cr);
+    }
+
+    // copy just this part of the image
+    g_autoptr(JKPdfCairoSurfaceT) copy = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, right-left, bottom-top);
+    int copystride = cairo_image_surface_get_stride(copy);
+    unsigned char *copydata = cairo_image_surface_get_data(copy);
+
+    for (int y = 0; y < bottom - top; ++y) {
+        memcpy(&copydata[y * copystride], &data[(y + top) * imgstride + left * 4], (size_t)(right - left)*4);
+    }
+    cairo_surface_mark_dirty(copy);
+
+    // by setting a content-dependent unique ID, the PDF surface will recognize duplicated images
+    // and embed them only once. For text files with lots of identical glyphs, this will lead
+    // to a dramatically reduced file size.
+    g_autofree gchar *checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA256, copydata, (size_t)((bottom-top)*copystride));
+    gchar *id = g_strdup_printf("jkpdftool-rasterize-surf-%s", checksum);
+    cairo_surface_set_mime_data(copy, CAIRO_MIME_TYPE_UNIQUE_ID, (unsigned char*)id, strlen(id), free, id);
+
+    cairo_translate(cr, left, top);
+    cairo_rectangle(cr, 0, 0, right-left, bottom-top);
+    cairo_set_source_surface(cr, copy, 0, 0);
+    cairo_fill(cr);
+
+    cairo_restore(cr);
+
+    // clear emitted part in original image
+    for (int y = top; y < bottom; ++y) {
+        memset(&data[y * imgstride + 4*left], 0, (size_t)(right - left) * 4);
+    }
+}
+
+static inline void
+_jkpdf_find_rec_recurse(unsigned char *data, int imgstride, int top, int right, int bottom, int left, bool debug, cairo_t *cr)
+{
+    // crop top
+    while (top < bottom) {
+        if (_jkpdf_border_left(data, imgstride, left, top, right) != right - left)
+            break;
+
+        top++;
+    }
+
+    if (top == bottom)
+        return;
+
+    // crop bottom
+    while (top < bottom) {
+        if (_jkpdf_border_left(data, imgstride, left, bottom-1, right) != right - left)
+            break;
+
+        bottom--;
+    }
+
+    // crop left
+    while (left < right) {
+        if (_jkpdf_border_top(data, imgstride, top, left, bottom) != bottom - top)
+            break;
+
+        left++;
+    }
+
+    // crop right
+    while (left < right) {
+        if (_jkpdf_border_top(data, imgstride, top, right-1, bottom) != bottom - top)
+            break;
+
+        right--;
+    }
+
+    // if the region was empty, we should have returned after cropping the top
+    g_assert(top < bottom);
+    g_assert(left < right);
+
+    // try to split horizontally
+    for (int y = top; y < bottom; ++y) {
+        if (_jkpdf_border_left(data, imgstride, left, y, right) == right - left) {
+            _jkpdf_find_rec_recurse(data, imgstride, top, right, y, left, debug, cr);
+            _jkpdf_find_rec_recurse(data, imgstride, y, right, bottom, left, debug, cr);
+            return;
+        }
+    }
+
+    // try to split vertically
+    for (int x = left; x < right; ++x) {
+        if (_jkpdf_border_top(data, imgstride, top, x, bottom) == bottom - top) {
+            _jkpdf_find_rec_recurse(data, imgstride, top, x, bottom, left, debug, cr);
+            _jkpdf_find_rec_recurse(data, imgstride, top, right, bottom, x, debug, cr);
+            return;
+        }
+    }
+
+    // then try chopping away at the corners
+    g_autofree int *borders_top    = g_new0(int, right-left);
+    g_autofree int *borders_bottom = g_new0(int, right-left);
+    g_autofree int *borders_left   = g_new0(int, bottom-top);
+    g_autofree int *borders_right  = g_new0(int, bottom-top);
+
+    for (int x = left; x < right; ++x) {
+        borders_top[x-left]    = _jkpdf_border_top(data, imgstride, top, x, bottom);
+        borders_bottom[x-left] = _jkpdf_border_bottom(data, imgstride, top, x, bottom);
+    }
+    for (int y = top; y < bottom; ++y) {
+        borders_left[y-top]  = _jkpdf_border_left(data, imgstride, left, y, right);
+        borders_right[y-top] = _jkpdf_border_right(data, imgstride, left, y, right);
+    }
+
+    // top left and right corner
+    for (int x = left + 1; x < right-1; ++x) {
+        int b_self  = borders_top[x-left];
+        int b_left  = borders_top[x-left-1];
+        int b_right = borders_top[x-left+1];
+
+        if (b_self > b_left) {
+            // potentially chop left
+            for (int y = top + b_self - 1; y >= top + b_left; --y) {
+                if (borders_left[y-top] >= x-left) {
+                    _jkpdf_find_rec_recurse(data, imgstride, top, x, y, left, debug, cr);
+                    _jkpdf_find_rec_recurse(data, imgstride, top, right, bottom, left, debug, cr);
+                    return;
+                }
+            }
+        }
+        if (b_self > b_right) {
+            // potentially chop right
+            for (int y = top + b_self - 1; y >= top + b_right; --y) {
+                if (borders_right[y-top] >= right-x) {
+                    _jkpdf_find_rec_recurse(data, imgstride, top, right, y, x, debug, cr);
+                    _jkpdf_find_rec_recurse(data, imgstride, top, right, bottom, left, debug, cr);
+                    return;
+                }
+            }
+        }
+    }
+
+    // bottom left and right corner
+    for (int x = left + 1; x < right-1; ++x) {
+        int b_self  = borders_bottom[x-left];
+        int b_left  = borders_bottom[x-left-1];
+        int b_right = borders_bottom[x-left+1];
+
+        if (b_self > b_left) {
+            // potentially chop left
+            for (int y = bottom - b_self - 1; y < bottom - b_left; ++y) {
+                if (borders_left[y-top] >= x-left) {
+                    _jkpdf_find_rec_recurse(data, imgstride, y, x, bottom, left, debug, cr);
+                    _jkpdf_find_rec_recurse(data, imgstride, top, right, bottom, left, debug, cr);
+                    return;
+                }
+            }
+        }
+        if (b_self > b_right) {
+            // potentially chop right
+            for (int y = bottom - b_self - 1; y < bottom - b_right; ++y) {
+                if (borders_right[y-top] >= right-x) {
+                    _jkpdf_find_rec_recurse(data, imgstride, y, right, bottom, x, debug, cr);
+                    _jkpdf_find_rec_recurse(data, imgstride, top, right, bottom, left, debug, cr);
+                    return;
+                }
+            }
+        }
+    }
+
+    // no parts to chop -> finished with this rect
+    _jkpdf_emit_rect(data, imgstride, top, right, bottom, left, debug, cr);
+}
+
+static inline void
+jkpdf_paint_chopped(cairo_surface_t *imgsurf, bool debug, cairo_t *cr_out)
+{
+    int imgwidth  = cairo_image_surface_get_width(imgsurf);
+    int imgheight = cairo_image_surface_get_height(imgsurf);
+    int imgstride = cairo_image_surface_get_stride(imgsurf);
+    unsigned char *imgdata = cairo_image_surface_get_data(imgsurf);
+
+    JKPDF_PROBE3(raster_pass_start, "chop", imgwidth, imgheight);
+    _jkpdf_find_rec_recurse(imgdata, imgstride, 0, imgwidth, imgheight, 0, debug, cr_out);
+    JKPDF_PROBE1(raster_pass_done, "chop");
+}
+
+static inline cairo_surface_t *
+jkpdf_clone_image_surface(cairo_surface_t *source)
+{
+    int w = cairo_image_surface_get_width(source);
+    int h = cairo_image_surface_get_height(source);
+
+    g_autoptr(JKPdfCairoSurfaceT) result = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+    g_autoptr(JKPdfCairoT) cr = cairo_create(result);
+
+    cairo_rectangle(cr, 0, 0, w, h);
+    cairo_set_source_surface(cr, source, 0, 0);
+    cairo_fill(cr);
+
+    cairo_surface_flush(result);
+    return g_steal_pointer(&result);
+}
+
+static inline void
+_jkpdf_rasterize_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    (void)user_data;
+
+    jkpdf_document_get_page_size(docs[0], pageno, width, height);
+}
+
+static inline guint64
+_jkpdf_rasterize_page_raster(JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const JkPdfRasterizeOptions *options = user_data;
+
+    double pagewidth, pageheight;
+    jkpdf_document_get_page_size(docs[0], pageno, &pagewidth, &pageheight);
+
+    // see jkpdf_raster_begin()
+    guint64 imgwidth = (guint64)round(pagewidth * options->resolution / 72.0);
+    guint64 imgheight = (guint64)round(pageheight * options->resolution / 72.0);
+
+    return imgwidth * imgheight * 4;
+}
+
+static inline void
+_jkpdf_rasterize_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const JkPdfRasterizeOptions *options = user_data;
+
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], pageno);
+
+    double pagewidth, pageheight;
+    jkpdf_page_get_size(page, &pagewidth, &pageheight);
+
+    g_autoptr(JKPdfCairoSurfaceT) imgsurf = NULL;
+    jkpdf_rasterize_page(&imgsurf, page, options->resolution);
+
+    if (options->grayscale)
+        jkpdf_make_grayscale(imgsurf);
+
+    if (options->transparent)
+        jkpdf_transparentize(imgsurf);
+
+    double imgwidth = cairo_image_surface_get_width(imgsurf);
+    double imgheight = cairo_image_surface_get_height(imgsurf);
+
+    cairo_scale(cr, pagewidth/imgwidth, pageheight/imgheight);
+
+    if (options->chop) {
+        jkpdf_paint_chopped(imgsurf, options->debug, cr);
+    } else {
+        cairo_set_source_surface(cr, imgsurf, 0, 0);
+        cairo_rectangle(cr, 0, 0, imgwidth, imgheight);
+        cairo_fill(cr);
+    }
+}
+
+static inline gboolean
+jkpdf_rasterize_document(JkPdfDocument *doc, const JkPdfRasterizeOptions *options, cairo_surface_t *surf, GError **error)
+{
+    if (options->resolution <= 0.0) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_OPTIONS, "resolution must be greater than zero");
+        return FALSE;
+    }
+
+    JkPdfRasterizeOptions params = *options;
+    if (params.chop)
+        params.transparent = TRUE;
+
+    static const JkPdfPageFuncs funcs = { _jkpdf_rasterize_page_size, _jkpdf_rasterize_render_page, _jkpdf_rasterize_page_raster };
+    jkpdf_render_pages(surf, &doc, 1, JKPDF_EACH_INPUT_PAGE, &funcs, &params);
+
+    return jkpdf_check_surface_status(surf, error);
+}
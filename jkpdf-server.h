@@ -0,0 +1,186 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include "jkpdf-io.h"
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Protocol between jkpdftool-client and jkpdftool-server
+//
+// The client connects to the server socket and sends a job: a header
+// followed by the working directory, the command line and the JKPDF_*
+// environment variables, all as NUL terminated strings. Its stdin, stdout
+// and stderr are passed along with the header (SCM_RIGHTS), so the job
+// reads and writes them directly. When the job is done, the server replies
+// with the exit status as a 32 bit integer.
+
+#define JKPDF_SERVER_MAGIC 0x4a4b5044u // "JKPD"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t n_args;
+    uint32_t n_env;
+    uint32_t payload_len;
+} JkPdfJobHeader;
+
+// Runs a jkpdftool command line, implemented in jkpdftool.c
+int jkpdftool_run(int argc, char **argv);
+
+// Whether name (with or without "jkpdftool-") is built into jkpdftool
+gboolean jkpdftool_is_tool(const char *name);
+
+static inline gchar *
+jkpdf_server_socket_path(void)
+{
+    const char *env = g_getenv("JKPDF_SERVER_SOCKET");
+    if (env && *env)
+        return g_strdup(env);
+
+    return g_build_filename(g_get_user_runtime_dir(), "jkpdftool.sock", NULL);
+}
+
+static inline gboolean
+jkpdf_server_address(const char *path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(addr->sun_path))
+        return FALSE;
+
+    strcpy(addr->sun_path, path);
+    return TRUE;
+}
+
+static inline gboolean
+jkpdf_read_full(int fd, void *data, size_t len)
+{
+    guint8 *p = data;
+
+    while (len > 0) {
+        ssize_t count = read(fd, p, len);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return FALSE;
+
+        p += count;
+        len -= (size_t)count;
+    }
+
+    return TRUE;
+}
+
+static inline gboolean
+jkpdf_write_full(int fd, const void *data, size_t len)
+{
+    gboolean no_vmsplice = FALSE;
+
+    return _jkpdf_write_all(fd, data, len, &no_vmsplice) == 0;
+}
+
+// Sends data, with the file descriptors attached to the first byte
+static inline gboolean
+jkpdf_send_with_fds(int sock, const void *data, size_t len, const int *fds, int n_fds)
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * 3)];
+    } control;
+
+    g_return_val_if_fail(n_fds >= 1 && n_fds <= 3, FALSE);
+
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { (void *)data, len };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)n_fds);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)n_fds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)n_fds);
+
+    ssize_t count;
+    do {
+        count = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (count < 0 && errno == EINTR);
+
+    if (count < 0)
+        return FALSE;
+
+    // the file descriptors went out with the first byte
+    return jkpdf_write_full(sock, (const guint8 *)data + count, len - (size_t)count);
+}
+
+// Receives exactly len bytes and up to max_fds file descriptors. Returns
+// the number of file descriptors received, or -1 on error.
+static inline int
+jkpdf_recv_with_fds(int sock, void *data, size_t len, int *fds, int max_fds)
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * 3)];
+    } control;
+
+    g_return_val_if_fail(max_fds >= 1 && max_fds <= 3, -1);
+
+    struct iovec iov = { data, len };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t count;
+    do {
+        count = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (count < 0 && errno == EINTR);
+
+    if (count <= 0)
+        return -1;
+
+    int n_fds = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int n = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        int received[3];
+        memcpy(received, CMSG_DATA(cmsg), sizeof(int) * (size_t)MIN(n, 3));
+
+        for (int i = 0; i < n; ++i) {
+            if (n_fds < max_fds)
+                fds[n_fds++] = received[i];
+            else
+                close(received[i]);
+        }
+    }
+
+    if (!jkpdf_read_full(sock, (guint8 *)data + count, len - (size_t)count)) {
+        for (int i = 0; i < n_fds; ++i)
+            close(fds[i]);
+        return -1;
+    }
+
+    return n_fds;
+}
@@ -0,0 +1,159 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+#include "jkpdf.h"
+#include "jkpdf-pool.h"
+#include "jkpdf-ranges.h"
+
+// Concatenating and splitting documents, used by jkpdftool-splice and
+// libjkpdf. Page numbers are contiguous over all documents.
+
+struct _jkpdf_splice_params {
+    int n_docs;
+    int *start_pages; // first page of every document, plus the total page count
+    GArray *pages;
+};
+
+static inline JkPdfPage *
+_jkpdf_splice_get_page(const struct _jkpdf_splice_params *params, JkPdfDocument **docs, int pageno)
+{
+    for (int i = 0; i < params->n_docs; ++i) {
+        if (pageno >= params->start_pages[i] && pageno < params->start_pages[i + 1]) {
+            return jkpdf_document_get_page(docs[i], pageno - params->start_pages[i]);
+        }
+    }
+
+    g_return_val_if_reached(NULL);
+}
+
+static inline void
+_jkpdf_splice_page_size(JkPdfDocument **docs, int i, double *width, double *height, gpointer user_data)
+{
+    const struct _jkpdf_splice_params *params = user_data;
+    g_autoptr(JkPdfPage) page = _jkpdf_splice_get_page(params, docs, g_array_index(params->pages, int, i) - 1);
+    g_return_if_fail(page != NULL);
+
+    jkpdf_page_get_size(page, width, height);
+}
+
+static inline void
+_jkpdf_splice_render_page(cairo_t *cr, JkPdfDocument **docs, int i, gpointer user_data)
+{
+    const struct _jkpdf_splice_params *params = user_data;
+    g_autoptr(JkPdfPage) page = _jkpdf_splice_get_page(params, docs, g_array_index(params->pages, int, i) - 1);
+    g_return_if_fail(page != NULL);
+
+    jkpdf_page_render(page, cr);
+}
+
+// Whether the output would be the single input document, page by page
+static inline gboolean
+jkpdf_splice_is_identity(JkPdfDocument **docs, int n_docs, const JkPdfSpliceOptions *options)
+{
+    if (n_docs != 1)
+        return FALSE;
+
+    if (!options->pages || !*options->pages)
+        return TRUE;
+
+    // invalid selections are reported by jkpdf_splice_documents()
+    int n_pages = jkpdf_document_get_n_pages(docs[0]);
+    g_autoptr(GArray) page_range = jkpdf_parse_range(options->pages, NULL);
+    g_autoptr(GArray) pages = page_range ? jkpdf_expand_page_range(page_range, n_pages, NULL) : NULL;
+    if (!pages || (int)pages->len != n_pages)
+        return FALSE;
+
+    for (int i = 0; i < n_pages; ++i) {
+        if (g_array_index(pages, int, i) != i + 1)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Which pages of every document end up in the output, for
+// jkpdf_isolate_documents(). Returns NULL for all of them, or if the
+// selection is invalid, which jkpdf_splice_documents() reports.
+static inline GPtrArray *
+jkpdf_splice_get_selections(JkPdfDocument **docs, int n_docs, const JkPdfSpliceOptions *options)
+{
+    if (!options->pages || !*options->pages)
+        return NULL;
+
+    g_autofree int *start_pages = g_new0(int, n_docs + 1);
+    for (int i = 0; i < n_docs; ++i)
+        start_pages[i + 1] = start_pages[i] + jkpdf_document_get_n_pages(docs[i]);
+
+    g_autoptr(GArray) page_range = jkpdf_parse_range(options->pages, NULL);
+    g_autoptr(GArray) pages = page_range ? jkpdf_expand_page_range(page_range, start_pages[n_docs], NULL) : NULL;
+    if (!pages)
+        return NULL;
+
+    GPtrArray *selections = g_ptr_array_new_full((guint)n_docs, (GDestroyNotify)jkpdf_page_selection_free);
+    for (int i = 0; i < n_docs; ++i) {
+        JkPdfPageSelection *selection = g_new0(JkPdfPageSelection, 1);
+        selection->n_pages = start_pages[i + 1] - start_pages[i];
+        selection->selected = g_new0(gboolean, selection->n_pages);
+        g_ptr_array_add(selections, selection);
+    }
+
+    for (guint i = 0; i < pages->len; ++i) {
+        int pageno = g_array_index(pages, int, i) - 1;
+        for (int j = 0; j < n_docs; ++j) {
+            if (pageno >= start_pages[j] && pageno < start_pages[j + 1]) {
+                JkPdfPageSelection *selection = g_ptr_array_index(selections, (guint)j);
+                selection->selected[pageno - start_pages[j]] = TRUE;
+            }
+        }
+    }
+
+    return selections;
+}
+
+static inline gboolean
+jkpdf_splice_documents(JkPdfDocument **docs, int n_docs, const JkPdfSpliceOptions *options, cairo_surface_t *surf, GError **error)
+{
+    g_autofree int *start_pages = g_new0(int, n_docs + 1);
+    for (int i = 0; i < n_docs; ++i) {
+        start_pages[i + 1] = start_pages[i] + jkpdf_document_get_n_pages(docs[i]);
+    }
+
+    int total_page_count = start_pages[n_docs];
+
+    g_autoptr(GArray) page_range = NULL;
+    if (options->pages && *options->pages) {
+        page_range = jkpdf_parse_range(options->pages, error);
+        if (!page_range) {
+            g_prefix_error(error, "Invalid page selection: ");
+            return FALSE;
+        }
+    } else {
+        page_range = g_array_new(FALSE, TRUE, sizeof(struct jkpdf_range_expr));
+        g_array_append_val(page_range, ((struct jkpdf_range_expr){ 1, total_page_count }));
+    }
+
+    g_autoptr(GArray) pages = jkpdf_expand_page_range(page_range, total_page_count, error);
+    if (!pages)
+        return FALSE;
+
+    struct _jkpdf_splice_params params = { n_docs, start_pages, pages };
+
+    static const JkPdfPageFuncs funcs = { _jkpdf_splice_page_size, _jkpdf_splice_render_page, NULL };
+    jkpdf_render_pages(surf, docs, n_docs, (int)pages->len, &funcs, &params);
+
+    return jkpdf_check_surface_status(surf, error);
+}
@@ -0,0 +1,280 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#include "jkpdf-memory.h"
+#include "jkpdf-trace.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Performance report
+//
+// With JKPDF_STATS=1 or --stats, a tool prints a JSON summary to stderr once
+// its output is finished: time spent reading the input, opening documents,
+// rendering every page and finishing the output, the bytes written for every
+// page, pages per second and the peak RSS. Times are wall clock seconds.
+// Pages rendered by the thread pool overlap, so their times may add up to
+// more than the wall time. page_render_s and page_bytes are indexed by
+// output page. The same points in time also end up in the JKPDF_TRACE
+// timeline, see jkpdf-trace.h.
+//
+// Stats belong to one tool run and hang off its output surface, so every
+// stage of a jkpdftool pipeline accounts and reports its own.
+
+typedef struct {
+    double  render_secs;
+    guint64 bytes;
+} JkPdfPageStats;
+
+typedef struct {
+    gint        ref_count;
+    gboolean    enabled;   // otherwise only tracing
+    gboolean    reported;
+    gchar      *tool;
+    JkPdfTrace *trace;     // NULL without JKPDF_TRACE
+    GMutex      lock;      // documents are reopened by worker threads
+
+    gint64   start;
+    gint64   read_usec;
+    guint64  read_bytes;
+    gint64   open_usec;
+    gint64   finish_usec;
+    guint64  page_bytes;   // output bytes accounted to pages so far
+    guint64  output_bytes;
+    gint64   stall_usec;
+    guint    n_pages;      // accounted so far
+    GArray  *pages;        // of JkPdfPageStats, by output page number
+    int      page_offset;  // of the pages rendered next, see checkpoints
+} JkPdfStats;
+
+// Returns the stats of one tool run, or NULL if neither stats nor a trace
+// are wanted. Every function taking a JkPdfStats accepts NULL.
+static inline JkPdfStats *
+jkpdf_stats_new(const char *argv0, gboolean requested)
+{
+    const char *env = g_getenv("JKPDF_STATS");
+    gboolean enabled = requested || (env && *env && strcmp(env, "0"));
+
+    JkPdfTrace *trace = jkpdf_trace_new(argv0);
+    if (!enabled && !trace)
+        return NULL;
+
+    JkPdfStats *stats = g_new0(JkPdfStats, 1);
+    stats->ref_count = 1;
+    stats->enabled = enabled;
+    stats->tool = g_path_get_basename(argv0);
+    stats->trace = trace;
+    g_mutex_init(&stats->lock);
+    stats->start = g_get_monotonic_time();
+    stats->pages = g_array_new(FALSE, TRUE, sizeof(JkPdfPageStats));
+
+    return stats;
+}
+
+static inline JkPdfStats *
+jkpdf_stats_ref(JkPdfStats *stats)
+{
+    if (stats)
+        g_atomic_int_inc(&stats->ref_count);
+
+    return stats;
+}
+
+static inline void
+jkpdf_stats_unref(JkPdfStats *stats)
+{
+    if (!stats || !g_atomic_int_dec_and_test(&stats->ref_count))
+        return;
+
+    jkpdf_trace_free(stats->trace);
+    g_array_unref(stats->pages);
+    g_mutex_clear(&stats->lock);
+    g_free(stats->tool);
+    g_free(stats);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(JkPdfStats, jkpdf_stats_unref)
+
+// The run a thread works for: set up by jkpdf_take_stats_arg() at the
+// start of every tool, and for its worker threads by the page pool. Reading
+// and opening input is accounted to it, everything else to the stats of
+// the output surface (see jkpdf_surface_get_stats()).
+static GPrivate _jkpdf_current_stats = G_PRIVATE_INIT((GDestroyNotify)jkpdf_stats_unref);
+
+static inline JkPdfStats *
+jkpdf_stats_current(void)
+{
+    return g_private_get(&_jkpdf_current_stats);
+}
+
+static inline void
+jkpdf_stats_set_current(JkPdfStats *stats)
+{
+    g_private_replace(&_jkpdf_current_stats, jkpdf_stats_ref(stats));
+}
+
+static inline gboolean
+jkpdf_stats_enabled(JkPdfStats *stats)
+{
+    return stats && stats->enabled;
+}
+
+// Start of something to be accounted, cheap if nobody asked for stats
+static inline gint64
+jkpdf_stats_now(JkPdfStats *stats)
+{
+    return stats ? g_get_monotonic_time() : 0;
+}
+
+// Appends a span to the trace, see jkpdf_trace_span()
+static inline void
+jkpdf_stats_span(JkPdfStats *stats, const char *name, gint64 start, int page, double width, double height)
+{
+    if (stats)
+        jkpdf_trace_span(stats->trace, name, start, page, width, height);
+}
+
+static inline void
+jkpdf_stats_add_read(JkPdfStats *stats, gint64 start, guint64 bytes)
+{
+    jkpdf_stats_span(stats, "read input", start, -1, 0, 0);
+
+    if (!jkpdf_stats_enabled(stats))
+        return;
+
+    gint64 usec = g_get_monotonic_time() - start;
+
+    g_mutex_lock(&stats->lock);
+    stats->read_usec += usec;
+    stats->read_bytes += bytes;
+    g_mutex_unlock(&stats->lock);
+}
+
+static inline void
+jkpdf_stats_add_open(JkPdfStats *stats, gint64 start)
+{
+    jkpdf_stats_span(stats, "open document", start, -1, 0, 0);
+
+    if (!jkpdf_stats_enabled(stats))
+        return;
+
+    gint64 usec = g_get_monotonic_time() - start;
+
+    g_mutex_lock(&stats->lock);
+    stats->open_usec += usec;
+    g_mutex_unlock(&stats->lock);
+}
+
+// Checkpoints copy their chunks to the output one at a time, with page
+// numbers starting at 0 for every chunk
+static inline void
+jkpdf_stats_set_page_offset(JkPdfStats *stats, int offset)
+{
+    if (stats)
+        stats->page_offset = offset;
+}
+
+// Accounts output page pageno (0-based), once it has been shown.
+// output_bytes is everything written so far, the page gets the difference
+// to the previous page.
+static inline void
+jkpdf_stats_add_page(JkPdfStats *stats, int pageno, gint64 usec, guint64 output_bytes)
+{
+    if (!jkpdf_stats_enabled(stats) || pageno < 0)
+        return;
+
+    pageno += stats->page_offset;
+
+    g_mutex_lock(&stats->lock);
+    if ((guint)pageno >= stats->pages->len)
+        g_array_set_size(stats->pages, (guint)pageno + 1);
+
+    JkPdfPageStats *page = &g_array_index(stats->pages, JkPdfPageStats, pageno);
+    page->render_secs += (double)usec / G_USEC_PER_SEC;
+    if (output_bytes > stats->page_bytes) {
+        page->bytes += output_bytes - stats->page_bytes;
+        stats->page_bytes = output_bytes;
+    }
+    stats->n_pages++;
+    g_mutex_unlock(&stats->lock);
+}
+
+static inline void
+jkpdf_stats_add_finish(JkPdfStats *stats, gint64 start)
+{
+    jkpdf_stats_span(stats, "finish output", start, -1, 0, 0);
+
+    if (!jkpdf_stats_enabled(stats))
+        return;
+
+    stats->finish_usec += g_get_monotonic_time() - start;
+}
+
+// Called when the output writer is done
+static inline void
+jkpdf_stats_add_output(JkPdfStats *stats, guint64 bytes, gint64 stall_usec)
+{
+    if (!jkpdf_stats_enabled(stats))
+        return;
+
+    g_mutex_lock(&stats->lock);
+    stats->output_bytes += bytes;
+    stats->stall_usec += stall_usec;
+    g_mutex_unlock(&stats->lock);
+}
+
+// Prints the report, once per tool run
+static inline void
+jkpdf_stats_report(JkPdfStats *stats)
+{
+    if (!jkpdf_stats_enabled(stats) || stats->reported)
+        return;
+
+    stats->reported = TRUE;
+
+    double wall = (double)(g_get_monotonic_time() - stats->start) / G_USEC_PER_SEC;
+    guint n_pages = stats->pages->len;
+
+    double render = 0;
+    for (guint i = 0; i < n_pages; ++i)
+        render += g_array_index(stats->pages, JkPdfPageStats, i).render_secs;
+
+    g_autoptr(GString) json = g_string_new("{\"tool\": ");
+    jkpdf_json_append_string(json, stats->tool);
+    g_string_append_printf(json, ", \"wall_s\": %.6f, ", wall);
+    g_string_append_printf(json, "\"read_s\": %.6f, \"read_bytes\": %" G_GUINT64_FORMAT ", ",
+                           (double)stats->read_usec / G_USEC_PER_SEC, stats->read_bytes);
+    g_string_append_printf(json, "\"open_s\": %.6f, \"render_s\": %.6f, \"finish_s\": %.6f, ",
+                           (double)stats->open_usec / G_USEC_PER_SEC, render,
+                           (double)stats->finish_usec / G_USEC_PER_SEC);
+    g_string_append_printf(json, "\"pages\": %u, \"pages_per_s\": %.3f, ", stats->n_pages, wall > 0 ? stats->n_pages / wall : 0.0);
+    g_string_append_printf(json, "\"output_bytes\": %" G_GUINT64_FORMAT ", \"stall_s\": %.6f, ",
+                           stats->output_bytes, (double)stats->stall_usec / G_USEC_PER_SEC);
+    g_string_append_printf(json, "\"peak_rss_bytes\": %" G_GUINT64_FORMAT ", ", jkpdf_memory_peak_rss());
+
+    g_string_append(json, "\"page_render_s\": [");
+    for (guint i = 0; i < n_pages; ++i)
+        g_string_append_printf(json, "%s%.6f", i ? ", " : "", g_array_index(stats->pages, JkPdfPageStats, i).render_secs);
+
+    g_string_append(json, "], \"page_bytes\": [");
+    for (guint i = 0; i < n_pages; ++i)
+        g_string_append_printf(json, "%s%" G_GUINT64_FORMAT, i ? ", " : "", g_array_index(stats->pages, JkPdfPageStats, i).bytes);
+
+    g_string_append(json, "]}");
+
+    fprintf(stderr, "%s\n", json->str);
+}
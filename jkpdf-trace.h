@@ -0,0 +1,154 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for gettid(2)
+#endif
+
+#include <glib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+// Timeline traces
+//
+// With JKPDF_TRACE=FILE, every tool appends its spans (reading and opening
+// input, rendering and writing pages, waiting for output, finishing) to
+// FILE in the Chrome trace event format, tagged with its pid and name.
+// All tools of a pipe can share one file, which then loads into Perfetto
+// or chrome://tracing as one timeline. Timestamps are CLOCK_MONOTONIC, so
+// they match between processes.
+//
+// The file is a JSON array which is never closed; both viewers accept that.
+// Every event is appended with a single write(2), so processes do not
+// interleave within an event. Remove the file before tracing the next run.
+// Each tool run has its own JkPdfTrace, owned by its JkPdfStats (see
+// jkpdf-stats.h), so stages of an in-process pipeline are told apart.
+
+typedef struct {
+    int    fd;
+    gchar *tool;
+    gint   failed; // stop after the first failed write
+} JkPdfTrace;
+
+// Appends str as a JSON string, with quotes
+static inline void
+jkpdf_json_append_string(GString *json, const char *str)
+{
+    g_string_append_c(json, '"');
+    for (const char *p = str; *p; ++p) {
+        if (*p == '"' || *p == '\\')
+            g_string_append_printf(json, "\\%c", *p);
+        else if ((guchar)*p < 0x20)
+            g_string_append_printf(json, "\\u%04x", (guchar)*p);
+        else
+            g_string_append_c(json, *p);
+    }
+    g_string_append_c(json, '"');
+}
+
+static inline void
+_jkpdf_trace_write(JkPdfTrace *trace, GString *event)
+{
+    g_string_append(event, ",\n");
+
+    const char *data = event->str;
+    gsize len = event->len;
+    while (len > 0) {
+        ssize_t count = write(trace->fd, data, len);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0) {
+            if (g_atomic_int_compare_and_exchange(&trace->failed, FALSE, TRUE))
+                fprintf(stderr, "WARN: could not write to JKPDF_TRACE file: %s\n", g_strerror(errno));
+            return;
+        }
+
+        data += count;
+        len -= (gsize)count;
+    }
+}
+
+// Returns the trace of one tool run, or NULL without JKPDF_TRACE
+static inline JkPdfTrace *
+jkpdf_trace_new(const char *argv0)
+{
+    const char *path = g_getenv("JKPDF_TRACE");
+    if (!path || !*path)
+        return NULL;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "WARN: could not open JKPDF_TRACE file '%s': %s\n", path, g_strerror(errno));
+        return NULL;
+    }
+
+    JkPdfTrace *trace = g_new0(JkPdfTrace, 1);
+    trace->fd = fd;
+    trace->tool = g_path_get_basename(argv0);
+
+    // whoever comes first starts the array
+    struct stat st;
+    (void)flock(fd, LOCK_EX);
+    if (fstat(fd, &st) == 0 && st.st_size == 0 && write(fd, "[\n", 2) != 2)
+        fprintf(stderr, "WARN: could not write to JKPDF_TRACE file '%s'\n", path);
+    (void)flock(fd, LOCK_UN);
+
+    g_autoptr(GString) event = g_string_new(NULL);
+    g_string_append_printf(event, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": ", (int)getpid());
+    jkpdf_json_append_string(event, trace->tool);
+    g_string_append(event, "}}");
+    _jkpdf_trace_write(trace, event);
+
+    return trace;
+}
+
+static inline void
+jkpdf_trace_free(JkPdfTrace *trace)
+{
+    if (!trace)
+        return;
+
+    close(trace->fd);
+    g_free(trace->tool);
+    g_free(trace);
+}
+
+// Appends a span from start until now. page is 0-based, or -1 for spans
+// which do not belong to a page. Does nothing without a trace.
+static inline void
+jkpdf_trace_span(JkPdfTrace *trace, const char *name, gint64 start, int page, double width, double height)
+{
+    if (!trace || g_atomic_int_get(&trace->failed))
+        return;
+
+    gint64 now = g_get_monotonic_time();
+
+    g_autoptr(GString) event = g_string_new(NULL);
+    g_string_append_printf(event, "{\"name\": \"%s\", \"cat\": \"jkpdf\", \"ph\": \"X\", \"ts\": %" G_GINT64_FORMAT ", \"dur\": %" G_GINT64_FORMAT ", ",
+                           name, start, now - start);
+    g_string_append_printf(event, "\"pid\": %d, \"tid\": %d, \"args\": {\"tool\": ",
+                           (int)getpid(), (int)gettid());
+    jkpdf_json_append_string(event, trace->tool);
+    if (page >= 0)
+        g_string_append_printf(event, ", \"page\": %d, \"width\": %.2f, \"height\": %.2f", page + 1, width, height);
+    g_string_append(event, "}}");
+
+    _jkpdf_trace_write(trace, event);
+}
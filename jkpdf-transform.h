@@ -63,6 +63,12 @@ jkpdf_transform_rect_into_bounds_3(const cairo_rectangle_t source, const cairo_r
     return m;
 }
 
+static inline gboolean
+jkpdf_matrix_is_identity(const cairo_matrix_t *m)
+{
+    return m->xx == 1.0 && m->yx == 0.0 && m->xy == 0.0 && m->yy == 1.0 && m->x0 == 0.0 && m->y0 == 0.0;
+}
+
 static inline cairo_matrix_t
 jkpdf_transform_rect_into_bounds_with_alignment(const cairo_rectangle_t source, const cairo_rectangle_t dest, JkPdfAlignment halign, JkPdfAlignment valign)
 {
@@ -0,0 +1,152 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+
+// libjkpdf: the jkpdftool operations as a library
+//
+// Every operation takes one or more PopplerDocuments and an options struct,
+// and writes the result either onto a cairo surface supplied by the caller or
+// as PDF through a write callback. Errors are reported in the JKPDF_ERROR
+// domain (see jkpdf-error.h), or in the domains of the option parsers from
+// jkpdf-parsesize.h. The code shared with the tools still calls exit() in
+// places the library never gets to (stdin, stdout, image input, --isolate)
+// and when something that worked before fails for no reason, like parsing a
+// document again that was closed to save memory.
+//
+// The library reads some of the environment variables of the tools, see
+// the README: JKPDF_THREADS, JKPDF_MEMORY_LIMIT, JKPDF_MAX_DOCUMENTS,
+// JKPDF_GEOMETRY_CACHE and JKPDF_VERBOSE (which also prints to stderr).
+//
+// Documents are not modified and can be reused for any number of calls.
+// Documents opened with jkpdf_open_pdf() can also be rendered with several
+// threads, see JKPDF_THREADS in the README. Calls must not share documents
+// with each other while running on different threads.
+
+#include <poppler.h>
+#include <cairo.h>
+
+#include "jkpdf-error.h"
+#include "jkpdf-parsesize.h"
+#include "jkpdf-transform.h"
+
+#define JKPDF_API __attribute__((visibility("default")))
+
+// Where the output goes. If surface is set, pages are drawn onto it (and
+// the page size is set for PDF surfaces). Otherwise, a PDF is written
+// through write_func. The surface is neither finished nor destroyed.
+typedef struct {
+    cairo_surface_t    *surface;
+    cairo_write_func_t  write_func;
+    void               *closure;
+} JkPdfOutput;
+
+typedef struct {
+    double   background[3]; // color to crop, RGB 0..1 (default: white)
+    double   resolution;    // to detect content (default: 72 DPI)
+    gboolean per_page;      // crop every page individually
+    int      allow_mismatch;// tolerated non-background pixels per row/column
+    int      fuzz;          // allowed color variation 0..255
+    gboolean no_top;
+    gboolean no_right;
+    gboolean no_bottom;
+    gboolean no_left;
+    double   margins[4];    // top, right, bottom, left in pt
+    double   target_width;  // scale result to this width, 0 to disable
+    double   target_height; // scale result to this height, 0 to disable
+} JkPdfCropOptions;
+
+typedef struct {
+    double   width;         // 0 for the size of the source page
+    double   height;
+    enum JkpdfOrientation orientation;
+    double   margins[4];    // top, right, bottom, left in pt
+    JkPdfAlignment halign;
+    JkPdfAlignment valign;
+    double   scale;         // JKPDF_SCALE_FIT, JKPDF_SCALE_COVER or a factor
+} JkPdfPagefitOptions;
+
+typedef struct {
+    int cols;               // 0x0 arranges two pages depending on orientation
+    int rows;
+} JkPdfNupOptions;
+
+typedef struct {
+    const char *pages;      // e.g. "1-2,5,7", counted over all inputs; NULL for all
+} JkPdfSpliceOptions;
+
+typedef struct {
+    double offset[2];       // x, y of the overlays in pt
+} JkPdfOverlayOptions;
+
+typedef struct {
+    double   resolution;    // default: 600 DPI
+    gboolean chop;          // chop image into opaque parts, implies transparent
+    gboolean transparent;   // make white pixels transparent
+    gboolean grayscale;
+    gboolean debug;         // mark chop regions with red rectangles
+} JkPdfRasterizeOptions;
+
+static inline void
+jkpdf_crop_options_init(JkPdfCropOptions *options)
+{
+    *options = (JkPdfCropOptions){ .background = { 1.0, 1.0, 1.0 }, .resolution = 72 };
+}
+
+static inline void
+jkpdf_pagefit_options_init(JkPdfPagefitOptions *options)
+{
+    *options = (JkPdfPagefitOptions){
+        .orientation = JKPDF_ORIENTATION_AUTO,
+        .halign = JKPDF_ALIGN_CENTER,
+        .valign = JKPDF_ALIGN_CENTER,
+        .scale = JKPDF_SCALE_FIT,
+    };
+}
+
+static inline void
+jkpdf_nup_options_init(JkPdfNupOptions *options)
+{
+    *options = (JkPdfNupOptions){ 0, 0 };
+}
+
+static inline void
+jkpdf_splice_options_init(JkPdfSpliceOptions *options)
+{
+    *options = (JkPdfSpliceOptions){ NULL };
+}
+
+static inline void
+jkpdf_overlay_options_init(JkPdfOverlayOptions *options)
+{
+    *options = (JkPdfOverlayOptions){ { 0.0, 0.0 } };
+}
+
+static inline void
+jkpdf_rasterize_options_init(JkPdfRasterizeOptions *options)
+{
+    *options = (JkPdfRasterizeOptions){ .resolution = 600 };
+}
+
+// Opens a PDF file. The bytes are kept alive as long as the document.
+JKPDF_API PopplerDocument *jkpdf_open_pdf(GBytes *bytes, GError **error);
+
+// Options may be NULL for the defaults.
+JKPDF_API gboolean jkpdf_crop(PopplerDocument *doc, const JkPdfCropOptions *options, const JkPdfOutput *output, GError **error);
+JKPDF_API gboolean jkpdf_pagefit(PopplerDocument *doc, const JkPdfPagefitOptions *options, const JkPdfOutput *output, GError **error);
+JKPDF_API gboolean jkpdf_nup(PopplerDocument *doc, const JkPdfNupOptions *options, const JkPdfOutput *output, GError **error);
+JKPDF_API gboolean jkpdf_splice(PopplerDocument **docs, int n_docs, const JkPdfSpliceOptions *options, const JkPdfOutput *output, GError **error);
+JKPDF_API gboolean jkpdf_overlay(PopplerDocument *base, PopplerDocument **overlays, int n_overlays, const JkPdfOverlayOptions *options, const JkPdfOutput *output, GError **error);
+JKPDF_API gboolean jkpdf_rasterize(PopplerDocument *doc, const JkPdfRasterizeOptions *options, const JkPdfOutput *output, GError **error);
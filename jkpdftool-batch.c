@@ -0,0 +1,607 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "jkpdf-server.h"
+
+#include <json-glib/json-glib.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+// Only part of the multicall binary, see jkpdftool.c
+//
+// Runs every job of a manifest as if it had been run on its own:
+//
+//   jkpdftool TOOL ARGS... <INPUT >OUTPUT
+//
+// Jobs run in forked processes, a fixed number at a time. The pending jobs
+// are sorted once by estimated cost (input size), and whenever a worker
+// becomes free, it picks up the next one, so the big ones start early and
+// the small ones fill the gaps at the end. There is no work stealing: a
+// job which turns out to take longer than estimated keeps its worker busy.
+//
+// That alone does not help when a single document takes longer than all the
+// others together. For tools that handle every page on its own, big
+// documents are therefore cut into page ranges, which are processed like
+// separate jobs (written as PDF to a temporary directory). Once all of them
+// are done, qpdf concatenates them into the output file, which copies PDF
+// objects instead of rendering the pages again. Without qpdf, documents are
+// not split.
+
+#define SPLIT_MIN_INPUT_SIZE (1024 * 1024) // smaller inputs are never split
+
+typedef struct {
+    guint    lineno;
+    gchar   *input;
+    gchar   *output;
+    GStrv    argv;         // "jkpdftool" TOOL ARGS...
+    goffset  input_size;
+
+    guint    n_parts;      // 0 if the job is not split
+    guint    parts_left;
+    gboolean failed;
+    GStrv    part_files;
+} Job;
+
+typedef enum {
+    TASK_JOB,   // the whole job
+    TASK_PART,  // one page range of a split job
+    TASK_MERGE, // splicing the page ranges into the output
+} TaskKind;
+
+typedef struct {
+    Job     *job;
+    TaskKind kind;
+    guint    part;
+    int      first_page;
+    int      last_page;
+    double   cost;
+} Task;
+
+static void
+job_free(Job *job)
+{
+    g_free(job->input);
+    g_free(job->output);
+    g_strfreev(job->argv);
+    g_strfreev(job->part_files);
+    g_free(job);
+}
+
+static const char *
+get_string_member(JsonObject *obj, const char *name, GError **error)
+{
+    JsonNode *node = json_object_get_member(obj, name);
+    if (!node || !JSON_NODE_HOLDS_VALUE(node) || json_node_get_value_type(node) != G_TYPE_STRING) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "'%s' must be a string", name);
+        return NULL;
+    }
+
+    return json_node_get_string(node);
+}
+
+// {"input": "in.pdf", "output": "out.pdf", "tool": "nup", "args": ["2x1"]}
+static Job *
+parse_job(const char *line, guint lineno, GError **error)
+{
+    g_autoptr(JsonParser) parser = json_parser_new();
+    if (!json_parser_load_from_data(parser, line, -1, error))
+        return NULL;
+
+    JsonNode *root = json_parser_get_root(parser);
+    if (!root || !JSON_NODE_HOLDS_OBJECT(root)) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "expected a JSON object");
+        return NULL;
+    }
+
+    JsonObject *obj = json_node_get_object(root);
+
+    const char *input = get_string_member(obj, "input", error);
+    if (!input)
+        return NULL;
+
+    const char *output = get_string_member(obj, "output", error);
+    if (!output)
+        return NULL;
+
+    const char *tool = get_string_member(obj, "tool", error);
+    if (!tool)
+        return NULL;
+
+    g_autoptr(GPtrArray) argv = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(argv, g_strdup("jkpdftool"));
+    g_ptr_array_add(argv, g_strdup(tool));
+
+    JsonNode *args = json_object_get_member(obj, "args");
+    if (args && !JSON_NODE_HOLDS_ARRAY(args)) {
+        g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "'args' must be an array of strings");
+        return NULL;
+    }
+
+    JsonArray *array = args ? json_node_get_array(args) : NULL;
+    for (guint i = 0; array && i < json_array_get_length(array); ++i) {
+        JsonNode *arg = json_array_get_element(array, i);
+        if (!JSON_NODE_HOLDS_VALUE(arg) || json_node_get_value_type(arg) != G_TYPE_STRING) {
+            g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_INVALID_INPUT, "'args' must be an array of strings");
+            return NULL;
+        }
+
+        g_ptr_array_add(argv, g_strdup(json_node_get_string(arg)));
+    }
+
+    g_ptr_array_add(argv, NULL);
+
+    Job *job = g_new0(Job, 1);
+    job->lineno = lineno;
+    job->input = g_strdup(input);
+    job->output = g_strdup(output);
+    job->argv = (GStrv)g_ptr_array_free(g_steal_pointer(&argv), FALSE);
+
+    return job;
+}
+
+static GPtrArray *
+read_manifest(const char *path)
+{
+    int fd = strcmp(path, "-") ? open(path, O_RDONLY | O_CLOEXEC) : 0;
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: while opening '%s': %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    g_autoptr(GBytes) bytes = jkpdf_read_fd(fd);
+    if (fd > 0)
+        close(fd);
+
+    gsize len = 0;
+    const char *data = g_bytes_get_data(bytes, &len);
+    g_autofree gchar *text = g_strndup(data, len);
+    g_auto(GStrv) lines = g_strsplit(text, "\n", -1);
+
+    GPtrArray *jobs = g_ptr_array_new_with_free_func((GDestroyNotify)job_free);
+    gboolean ok = TRUE;
+
+    for (guint i = 0; lines[i]; ++i) {
+        if (!*g_strstrip(lines[i]))
+            continue;
+
+        g_autoptr(GError) error = NULL;
+        Job *job = parse_job(lines[i], i + 1, &error);
+        if (!job) {
+            fprintf(stderr, "ERROR: %s:%u: %s\n", path, i + 1, error->message);
+            ok = FALSE;
+            continue;
+        }
+
+        g_ptr_array_add(jobs, job);
+    }
+
+    if (!ok)
+        exit(1);
+
+    return jobs;
+}
+
+static gboolean
+stage_is_page_wise(char **stage, guint len)
+{
+    static const char *const page_wise_tools[] = { "mirror", "pagefit", "rasterize", "rotate" };
+
+    if (len == 0)
+        return FALSE;
+
+    for (size_t i = 0; i < G_N_ELEMENTS(page_wise_tools); ++i) {
+        if (!strcmp(stage[0], page_wise_tools[i]))
+            return TRUE;
+    }
+
+    // crop only looks at one page at a time with --per-page
+    if (!strcmp(stage[0], "crop")) {
+        for (guint i = 1; i < len; ++i) {
+            if (!strcmp(stage[i], "--per-page") || !strcmp(stage[i], "-p"))
+                return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// Whether every stage of the command line handles its pages one by one, so
+// that running it on page ranges and splicing the results gives the same
+// pages as running it on the whole document.
+static gboolean
+job_can_split(Job *job)
+{
+    char **stage = job->argv + 1;
+
+    for (;;) {
+        guint len = 0;
+        while (stage[len] && strcmp(stage[len], "!"))
+            ++len;
+
+        if (!stage_is_page_wise(stage, len))
+            return FALSE;
+
+        if (!stage[len])
+            return TRUE;
+
+        stage += len + 1;
+    }
+}
+
+static int
+count_pages(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    g_autoptr(GMappedFile) map = _jkpdf_map_fd(fd);
+    close(fd);
+
+    if (!map)
+        return 0;
+
+    g_autoptr(GBytes) bytes = g_mapped_file_get_bytes(map);
+    PopplerDocument *doc = jkpdf_poppler_document_new_from_bytes(bytes, NULL);
+    if (!doc)
+        return 0; // not our business, the job will complain
+
+    int n_pages = poppler_document_get_n_pages(doc);
+    g_object_unref(doc);
+
+    return n_pages;
+}
+
+static Task *
+task_new(Job *job, TaskKind kind, double cost)
+{
+    Task *task = g_new0(Task, 1);
+    task->job = job;
+    task->kind = kind;
+    task->cost = cost;
+
+    return task;
+}
+
+static void
+plan_job(Job *job, int chunk_pages, gchar **tmpdir, GPtrArray *tasks)
+{
+    struct stat st;
+    job->input_size = stat(job->input, &st) == 0 ? st.st_size : 0;
+
+    int n_pages = 0;
+    if (chunk_pages > 0 && job->input_size >= SPLIT_MIN_INPUT_SIZE && job_can_split(job))
+        n_pages = count_pages(job->input);
+
+    if (n_pages <= chunk_pages) {
+        g_ptr_array_add(tasks, task_new(job, TASK_JOB, (double)job->input_size));
+        return;
+    }
+
+    if (!*tmpdir) {
+        g_autoptr(GError) error = NULL;
+        *tmpdir = g_dir_make_tmp("jkpdftool-batch-XXXXXX", &error);
+        if (!*tmpdir) {
+            fprintf(stderr, "ERROR: could not create temporary directory: %s\n", error->message);
+            exit(1);
+        }
+    }
+
+    job->n_parts = (guint)((n_pages + chunk_pages - 1) / chunk_pages);
+    job->parts_left = job->n_parts;
+    job->part_files = g_new0(gchar *, job->n_parts + 1);
+
+    if (jkpdf_verbose())
+        fprintf(stderr, "INFO: splitting '%s' (%d pages) into %u parts\n", job->input, n_pages, job->n_parts);
+
+    for (guint i = 0; i < job->n_parts; ++i) {
+        g_autofree gchar *name = g_strdup_printf("%u-%u.pdf", job->lineno, i);
+        job->part_files[i] = g_build_filename(*tmpdir, name, NULL);
+
+        int first = (int)i * chunk_pages + 1;
+        int last = MIN(first + chunk_pages - 1, n_pages);
+
+        Task *task = task_new(job, TASK_PART, (double)job->input_size * (last - first + 1) / n_pages);
+        task->part = i;
+        task->first_page = first;
+        task->last_page = last;
+        g_ptr_array_add(tasks, task);
+    }
+}
+
+static gint
+compare_tasks(gconstpointer a, gconstpointer b)
+{
+    const Task *ta = *(const Task *const *)a;
+    const Task *tb = *(const Task *const *)b;
+
+    // most expensive first, otherwise in manifest order
+    if (ta->cost != tb->cost)
+        return ta->cost > tb->cost ? -1 : 1;
+    if (ta->job->lineno != tb->job->lineno)
+        return ta->job->lineno < tb->job->lineno ? -1 : 1;
+
+    return ta->part < tb->part ? -1 : ta->part > tb->part;
+}
+
+static void
+redirect(int target, const char *path, int flags)
+{
+    int fd = open(path, flags | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: while opening '%s': %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    if (dup2(fd, target) < 0) {
+        perror("WTF: dup2(2)");
+        exit(1);
+    }
+
+    close(fd);
+}
+
+static void G_GNUC_NORETURN
+run_task(Task *task)
+{
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    Job *job = task->job;
+    const char *input = job->input;
+    const char *output = job->output;
+
+    g_autoptr(GPtrArray) argv = g_ptr_array_new_with_free_func(g_free);
+
+    switch (task->kind) {
+    case TASK_JOB:
+        for (guint i = 0; job->argv[i]; ++i)
+            g_ptr_array_add(argv, g_strdup(job->argv[i]));
+        break;
+    case TASK_PART:
+        g_ptr_array_add(argv, g_strdup("jkpdftool"));
+        g_ptr_array_add(argv, g_strdup("splice"));
+        g_ptr_array_add(argv, g_strdup("--pages"));
+        g_ptr_array_add(argv, g_strdup_printf("%d-%d", task->first_page, task->last_page));
+        g_ptr_array_add(argv, g_strdup("--"));
+        g_ptr_array_add(argv, g_strdup(job->input));
+        g_ptr_array_add(argv, g_strdup("!"));
+        for (guint i = 1; job->argv[i]; ++i)
+            g_ptr_array_add(argv, g_strdup(job->argv[i]));
+
+        input = "/dev/null";
+        output = job->part_files[task->part];
+        break;
+    case TASK_MERGE:
+        // like jkpdftool-splice-qpdf
+        g_ptr_array_add(argv, g_strdup("qpdf"));
+        g_ptr_array_add(argv, g_strdup("--pages"));
+        for (guint i = 0; i < job->n_parts; ++i)
+            g_ptr_array_add(argv, g_strdup(job->part_files[i]));
+        g_ptr_array_add(argv, g_strdup("--"));
+        g_ptr_array_add(argv, g_strdup("--empty"));
+        g_ptr_array_add(argv, g_strdup("-"));
+
+        input = "/dev/null";
+        break;
+    }
+
+    g_ptr_array_add(argv, NULL);
+
+    redirect(0, input, O_RDONLY);
+    redirect(1, output, O_WRONLY | O_CREAT | O_TRUNC);
+
+    if (task->kind == TASK_MERGE) {
+        execvp("qpdf", (char **)argv->pdata);
+        fprintf(stderr, "ERROR: could not run qpdf: %s\n", strerror(errno));
+        exit(127);
+    }
+
+    exit(jkpdftool_run((int)argv->len - 1, (char **)argv->pdata));
+}
+
+static void
+remove_part_files(Job *job)
+{
+    for (guint i = 0; i < job->n_parts; ++i)
+        (void)unlink(job->part_files[i]);
+}
+
+// Queues a task behind the pending tasks which are more expensive
+static void
+insert_task(GPtrArray *tasks, guint next_task, Task *task)
+{
+    guint i = next_task;
+    while (i < tasks->len && compare_tasks(&g_ptr_array_index(tasks, i), &task) < 0)
+        i++;
+
+    g_ptr_array_insert(tasks, (gint)i, task);
+}
+
+// The merge copies the objects of all parts
+static double
+merge_cost(Job *job)
+{
+    double cost = 0;
+    for (guint i = 0; i < job->n_parts; ++i) {
+        struct stat st;
+        if (stat(job->part_files[i], &st) == 0)
+            cost += (double)st.st_size;
+    }
+
+    return cost;
+}
+
+static void
+finish_task(const char *manifest, Task *task, int status, GPtrArray *tasks, guint next_task)
+{
+    Job *job = task->job;
+
+    if (status) {
+        job->failed = TRUE;
+
+        if (task->kind == TASK_PART)
+            fprintf(stderr, "ERROR: %s:%u: pages %d-%d of '%s' failed with status %d\n",
+                    manifest, job->lineno, task->first_page, task->last_page, job->input, status);
+        else
+            fprintf(stderr, "ERROR: %s:%u: '%s' failed with status %d\n",
+                    manifest, job->lineno, job->input, status);
+    }
+
+    if (task->kind == TASK_PART && --job->parts_left == 0) {
+        if (job->failed)
+            remove_part_files(job);
+        else
+            insert_task(tasks, next_task, task_new(job, TASK_MERGE, merge_cost(job)));
+    }
+
+    if (task->kind == TASK_MERGE)
+        remove_part_files(job);
+}
+
+int
+main(int argc, char **argv)
+{
+    gint arg_workers = 0;
+    gint arg_chunk   = 200;
+
+    GOptionEntry option_entries[] = {
+        { "workers",     'w', 0, G_OPTION_ARG_INT, &arg_workers, "Number of jobs to run at the same time (default: one per CPU)", "N" },
+        { "chunk-pages", 'c', 0, G_OPTION_ARG_INT, &arg_chunk, "Split bigger documents into ranges of N pages, 0 to never split; needs qpdf (default: 200)", "N" },
+        { NULL }
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) context = g_option_context_new("MANIFEST");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    g_option_context_set_description(context, "Run all jobs of a manifest.\n"
+        "\n"
+        "Manifest:\n"
+        "  One job per line, as JSON object with the members \"input\", \"output\",\n"
+        "  \"tool\" and \"args\" (optional array of strings), e.g.\n"
+        "\n"
+        "    {\"input\": \"in.pdf\", \"output\": \"out.pdf\", \"tool\": \"nup\", \"args\": [\"2x1\"]}\n"
+        "\n"
+        "  Every job produces the same output as 'jkpdftool TOOL ARGS... <INPUT >OUTPUT'.\n"
+        "  Tools can be chained with \"!\" in args. Use '-' to read the manifest from\n"
+        "  the standard input.\n"
+    );
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "ERROR: option parsing failed: %s\n", error->message);
+        return 1;
+    }
+
+    if (argc != 2) {
+        fprintf(stderr, "ERROR: expected exactly one manifest, see '%s --help'\n", argv[0]);
+        return 1;
+    }
+
+    if (arg_workers < 0 || arg_chunk < 0) {
+        fprintf(stderr, "ERROR: invalid number of workers or pages\n");
+        return 1;
+    }
+
+    if (arg_workers == 0)
+        arg_workers = (gint)g_get_num_processors();
+
+    const char *manifest = argv[1];
+    g_autoptr(GPtrArray) jobs = read_manifest(manifest);
+
+    // the page ranges are concatenated by qpdf, see above
+    g_autofree gchar *qpdf = g_find_program_in_path("qpdf");
+    if (arg_chunk > 0 && (!qpdf || jkpdf_want_script_output())) {
+        if (jkpdf_verbose())
+            fprintf(stderr, "INFO: not splitting documents, %s\n", qpdf ? "the output is CairoScript" : "qpdf not found");
+        arg_chunk = 0;
+    }
+
+    g_autofree gchar *tmpdir = NULL;
+    g_autoptr(GPtrArray) tasks = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i < jobs->len; ++i)
+        plan_job(g_ptr_array_index(jobs, i), arg_chunk, &tmpdir, tasks);
+
+    g_ptr_array_sort(tasks, compare_tasks);
+
+    g_autofree pid_t *pids = g_new0(pid_t, arg_workers);
+    g_autofree Task **running = g_new0(Task *, arg_workers);
+    int n_running = 0;
+    guint next_task = 0;
+
+    for (;;) {
+        for (int i = 0; i < arg_workers && next_task < tasks->len; ++i) {
+            if (running[i])
+                continue;
+
+            Task *task = g_ptr_array_index(tasks, next_task++);
+
+            fflush(NULL);
+
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("ERROR: fork(2)");
+                exit(1);
+            } else if (pid == 0) {
+                run_task(task);
+            }
+
+            pids[i] = pid;
+            running[i] = task;
+            n_running++;
+        }
+
+        if (n_running == 0)
+            break;
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+
+            perror("WTF: waitpid(2)");
+            exit(1);
+        }
+
+        for (int i = 0; i < arg_workers; ++i) {
+            if (!running[i] || pids[i] != pid)
+                continue;
+
+            int retval = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            finish_task(manifest, g_steal_pointer(&running[i]), retval, tasks, next_task);
+            n_running--;
+        }
+    }
+
+    if (tmpdir)
+        (void)rmdir(tmpdir);
+
+    guint n_failed = 0;
+    for (guint i = 0; i < jobs->len; ++i) {
+        Job *job = g_ptr_array_index(jobs, i);
+        if (job->failed)
+            n_failed++;
+    }
+
+    if (n_failed) {
+        fprintf(stderr, "ERROR: %u of %u jobs failed\n", n_failed, jobs->len);
+        return 1;
+    }
+
+    if (jkpdf_verbose())
+        fprintf(stderr, "INFO: %u jobs done\n", jobs->len);
+
+    return 0;
+}
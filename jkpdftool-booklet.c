@@ -16,6 +16,7 @@
 
 #include "jkpdf-io.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-pool.h"
 #include "jkpdf-transform.h"
 
 static void
@@ -28,145 +29,128 @@ print_help(const char *argv0)
     printf("\n");
     printf("The resulting PDF is made in such a way that if you print it duplex\n");
     printf("and then fold it in the middle, you have a booklet\n");
+    printf("\n");
+    printf("%s", JKPDF_BUDGET_HELP);
 }
 
-int
-main(int argc, char **argv)
-{
-    if (argc >= 2 && (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-?"))) {
-        print_help(argv[0]);
-        return 0;
-    }
-
-    if (argc > 1) {
-        fprintf(stderr, "ERROR: expected no arguments, see '%s --help'\n", argv[0]);
-        return 1;
-    }
-
-
-    g_autoptr(JKPdfPopplerDocument) doc = jkpdf_create_poppler_document_for_stdin();
-    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
-
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
-
-    int n_input_pages = poppler_document_get_n_pages(doc);
-    int n_output_sheets = (n_input_pages + 3) / 4;
+struct booklet_params {
+    int n_input_pages;
+    int n_output_sheets;
+    double output_w;
+    double output_h;
+};
 
-    double output_w = 1.0, output_h = 1.0;
-
-    {
-        g_autoptr(JKPdfPopplerPage) page1 = poppler_document_get_page(doc, 0);
-        if (page1) {
-            double page_w, page_h;
-            poppler_page_get_size(page1, &page_w, &page_h);
-
-            output_w = page_h;
-            output_h = page_w * 2;
-        }
-    }
-
-    cairo_pdf_surface_set_size(surf, output_w, output_h);
-
-    for (int i = 0; i < n_output_sheets; ++i) {
-        int pageno1 = i * 2;
-        int pageno2 = i * 2 + 1;
-        int pageno3 = (n_output_sheets * 4 - i * 2 - 1);
-        int pageno4 = (n_output_sheets * 4 - i * 2 - 2);
-
-        if (pageno1 >= 0 && pageno1 < n_input_pages) {
-            cairo_save(cr);
-
-            g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno1);
-
-            double page_w, page_h;
-            poppler_page_get_size(page, &page_w, &page_h);
+static void
+booklet_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    (void)docs; (void)pageno;
+    const struct booklet_params *params = user_data;
 
-            cairo_rectangle_t source_r = { 0, -page_w, page_h, page_w };
-            cairo_rectangle_t page_r = { 0, 0, output_w, output_h / 2 };
+    *width = params->output_w;
+    *height = params->output_h;
+}
 
-            cairo_matrix_t m = jkpdf_transform_rect_into_bounds(source_r, page_r);
-            cairo_transform(cr, &m);
-            cairo_rotate(cr, -M_PI_2);
+// Renders the input page rotated by 90° into one half of the output page
+static void
+booklet_render_half(cairo_t *cr, JkPdfDocument *doc, int pageno, const struct booklet_params *params, gboolean bottom_half, gboolean clockwise)
+{
+    if (pageno < 0 || pageno >= params->n_input_pages)
+        return;
 
-            poppler_page_render_for_printing(page, cr);
+    cairo_save(cr);
 
-            cairo_restore(cr);
-        }
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(doc, pageno);
 
-        if (pageno3 >= 0 && pageno3 < n_input_pages) {
-            cairo_save(cr);
+    double page_w, page_h;
+    jkpdf_page_get_size(page, &page_w, &page_h);
 
-            g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno3);
+    cairo_rectangle_t source_r;
+    if (clockwise)
+        source_r = (cairo_rectangle_t){ -page_h, 0, page_h, page_w };
+    else
+        source_r = (cairo_rectangle_t){ 0, -page_w, page_h, page_w };
 
-            double page_w, page_h;
-            poppler_page_get_size(page, &page_w, &page_h);
+    cairo_rectangle_t page_r = { 0, bottom_half ? params->output_h / 2 : 0, params->output_w, params->output_h / 2 };
 
-            cairo_rectangle_t source_r = { 0, -page_w, page_h, page_w };
-            cairo_rectangle_t page_r = { 0, output_h / 2, output_w, output_h / 2 };
+    cairo_matrix_t m = jkpdf_transform_rect_into_bounds(source_r, page_r);
+    cairo_transform(cr, &m);
+    cairo_rotate(cr, clockwise ? M_PI_2 : -M_PI_2);
 
-            cairo_matrix_t m = jkpdf_transform_rect_into_bounds(source_r, page_r);
-            cairo_transform(cr, &m);
-            cairo_rotate(cr, -M_PI_2);
+    jkpdf_page_render(page, cr);
 
-            poppler_page_render_for_printing(page, cr);
+    cairo_restore(cr);
+}
 
-            cairo_restore(cr);
-        }
+static void
+booklet_render_page(cairo_t *cr, JkPdfDocument **docs, int outpageno, gpointer user_data)
+{
+    const struct booklet_params *params = user_data;
 
-        cairo_surface_show_page(surf);
+    int i = outpageno / 2;
 
-        if (pageno2 >= 0 && pageno2 < n_input_pages) {
-            cairo_save(cr);
+    if (outpageno % 2 == 0) {
+        // front side
+        int pageno1 = i * 2;
+        int pageno3 = (params->n_output_sheets * 4 - i * 2 - 1);
 
-            g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno2);
+        booklet_render_half(cr, docs[0], pageno1, params, FALSE, FALSE);
+        booklet_render_half(cr, docs[0], pageno3, params, TRUE, FALSE);
+    } else {
+        // back side
+        int pageno2 = i * 2 + 1;
+        int pageno4 = (params->n_output_sheets * 4 - i * 2 - 2);
 
-            double page_w, page_h;
-            poppler_page_get_size(page, &page_w, &page_h);
+        booklet_render_half(cr, docs[0], pageno2, params, FALSE, TRUE);
+        booklet_render_half(cr, docs[0], pageno4, params, TRUE, TRUE);
+    }
+}
 
-            cairo_rectangle_t source_r = { -page_h, 0, page_h, page_w };
-            cairo_rectangle_t page_r = { 0, 0, output_w, output_h / 2 };
+int
+main(int argc, char **argv)
+{
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
 
-            cairo_matrix_t m = jkpdf_transform_rect_into_bounds(source_r, page_r);
-            cairo_transform(cr, &m);
-            cairo_rotate(cr, M_PI_2);
+    if (argc >= 2 && (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-?"))) {
+        print_help(argv[0]);
+        return 0;
+    }
 
-            poppler_page_render_for_printing(page, cr);
+    if (argc > 1) {
+        fprintf(stderr, "ERROR: expected no arguments, see '%s --help'\n", argv[0]);
+        return 1;
+    }
 
-            cairo_restore(cr);
-        }
 
-        if (pageno4 >= 0 && pageno4 < n_input_pages) {
-            cairo_save(cr);
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_for_stdin();
+    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
 
-            g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno4);
+    struct booklet_params params = { 0, 0, 1.0, 1.0 };
+    params.n_input_pages = jkpdf_document_get_n_pages(doc);
+    params.n_output_sheets = (params.n_input_pages + 3) / 4;
 
+    {
+        if (params.n_input_pages > 0) {
             double page_w, page_h;
-            poppler_page_get_size(page, &page_w, &page_h);
-
-            cairo_rectangle_t source_r = { -page_h, 0, page_h, page_w };
-            cairo_rectangle_t page_r = { 0, output_h / 2, output_w, output_h / 2 };
+            jkpdf_document_get_page_size(doc, 0, &page_w, &page_h);
 
-            cairo_matrix_t m = jkpdf_transform_rect_into_bounds(source_r, page_r);
-            cairo_transform(cr, &m);
-            cairo_rotate(cr, M_PI_2);
-
-            poppler_page_render_for_printing(page, cr);
-
-            cairo_restore(cr);
+            params.output_w = page_h;
+            params.output_h = page_w * 2;
         }
-
-        cairo_surface_show_page(surf);
     }
 
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    static const JkPdfPageFuncs funcs = { booklet_page_size, booklet_render_page, NULL };
+    jkpdf_render_pages(surf, &doc, 1, params.n_output_sheets * 2, &funcs, &params);
+
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
     return 0;
 }
-
@@ -0,0 +1,104 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "jkpdf-server.h"
+
+// Only part of the multicall binary, see jkpdftool.c
+//
+// Takes the same arguments as jkpdftool, but lets jkpdftool-server do the
+// work. stdin, stdout and stderr are handed to the server, so apart from
+// being faster, this is no different from running jkpdftool directly.
+// Without a server, the job just runs in this process.
+
+static int
+connect_to_server(void)
+{
+    g_autofree gchar *path = jkpdf_server_socket_path();
+
+    struct sockaddr_un addr;
+    if (!jkpdf_server_address(path, &addr))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        if (jkpdf_verbose())
+            fprintf(stderr, "INFO: could not connect to %s: %s\n", path, strerror(errno));
+
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void
+append_string(GByteArray *payload, const char *s)
+{
+    g_byte_array_append(payload, (const guint8 *)s, (guint)strlen(s) + 1);
+}
+
+int
+main(int argc, char **argv)
+{
+    // run like jkpdftool itself, no matter how we were called
+    argv[0] = "jkpdftool";
+
+    int sock = connect_to_server();
+    if (sock < 0) {
+        if (jkpdf_verbose())
+            fprintf(stderr, "INFO: no jkpdftool-server, running the job locally\n");
+
+        return jkpdftool_run(argc, argv);
+    }
+
+    g_autoptr(GByteArray) payload = g_byte_array_new();
+    JkPdfJobHeader header = { JKPDF_SERVER_MAGIC, (uint32_t)argc, 0, 0 };
+
+    g_autofree gchar *cwd = g_get_current_dir();
+    append_string(payload, cwd);
+
+    for (int i = 0; i < argc; ++i)
+        append_string(payload, argv[i]);
+
+    g_auto(GStrv) env = g_get_environ();
+    for (guint i = 0; env[i]; ++i) {
+        if (!g_str_has_prefix(env[i], "JKPDF_"))
+            continue;
+
+        append_string(payload, env[i]);
+        header.n_env++;
+    }
+
+    header.payload_len = payload->len;
+
+    int fds[3] = { 0, 1, 2 };
+    if (!jkpdf_send_with_fds(sock, &header, sizeof(header), fds, 3)
+            || !jkpdf_write_full(sock, payload->data, payload->len)) {
+        perror("ERROR: could not send job to jkpdftool-server");
+        return 1;
+    }
+
+    int32_t retval = 0;
+    if (!jkpdf_read_full(sock, &retval, sizeof(retval))) {
+        fprintf(stderr, "ERROR: lost connection to jkpdftool-server\n");
+        return 1;
+    }
+
+    close(sock);
+
+    return (int)retval;
+}
@@ -15,6 +15,7 @@
 #include "jkpdf-io.h"
 #include "jkpdf-transform.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-crop.h"
 
 #include <stdbool.h>
 #include <inttypes.h>
@@ -66,154 +67,15 @@ parse_color_spec(const char *color, float *r, float *g, float *b)
     return color[6] == 0;
 }
 
-struct crop_bounds {
-    double left;
-    double right;
-    double top;
-    double bottom;
-};
-
-static inline bool color_equal_with_fuzz(const void *a, const void *b, int fuzz) {
-    unsigned char rgba[4];
-    unsigned char rgbb[4];
-
-    memcpy(rgba, a, 4);
-    memcpy(rgbb, b, 4);
-
-    for (int i = 0; i < 4; ++i) {
-        if (abs((int)rgba[i] - (int)rgbb[i]) > fuzz)
-            return false;
-    }
-
-    return true;
-}
-
-static inline struct crop_bounds
-calc_crop_bounds(PopplerPage *page, double dpi, int pxl_limit, int color_fuzz, float bg_r, float bg_g, float bg_b)
-{
-    struct crop_bounds retval = { 0.0, 0.0, 0.0, 0.0 };
-
-    double pagewidth, pageheight;
-    poppler_page_get_size(page, &pagewidth, &pageheight);
-
-    int surfwidth  = (int)(pagewidth / 72.0 * dpi);
-    int surfheight = (int)(pageheight / 72.0 * dpi);
-
-    uint32_t bgcolor = (0xffu << 24) | (uint32_t)(bg_r * 0xff) << 16 | (uint32_t)(bg_g * 0xff) << 8 | (uint32_t)(bg_b * 0xff);
-
-    g_autoptr(JKPdfCairoSurfaceT) img = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, surfwidth, surfheight);
-
-    g_autoptr(JKPdfCairoT) cr = cairo_create(img);
-    cairo_set_source_rgb(cr, bg_r, bg_g, bg_b);
-    cairo_rectangle(cr, 0, 0, surfwidth, surfheight);
-    cairo_fill(cr);
-
-    cairo_scale(cr, surfwidth / pagewidth, surfheight / pageheight);
-    poppler_page_render_for_printing(page, cr);
-
-    cairo_surface_flush(img);
-
-    int stride = cairo_image_surface_get_stride(img);
-    unsigned char *data = cairo_image_surface_get_data(img);
-
-    // top
-    int min_top = 0;
-    for (int y = 0; y < surfheight; ++y) {
-        unsigned char *row = data + y * stride;
-
-        int num_mismatch = 0;
-        for (int x = 0; x < surfwidth; ++x) {
-            if (!color_equal_with_fuzz(&row[4*x], &bgcolor, color_fuzz))
-                num_mismatch++;
-        }
-
-        if (num_mismatch > pxl_limit)
-            break;
-
-        min_top++;
-    }
-
-    // bottom
-    int min_bottom = 0;
-    for (int y = surfheight-1; y >= min_top; --y) {
-        unsigned char *row = data + y * stride;
-
-        int num_mismatch = 0;
-        for (int x = 0; x < surfwidth; ++x) {
-            if (!color_equal_with_fuzz(&row[4*x], &bgcolor, color_fuzz))
-                num_mismatch++;
-        }
-
-        if (num_mismatch > pxl_limit)
-            break;
-
-        min_bottom++;
-    }
-
-    // left
-    int min_left = 0;
-    for (int x = 0; x < surfwidth; ++x) {
-        int num_mismatch = 0;
-
-        for (int y = 0; y < surfheight; ++y) {
-            unsigned char *row = data + y * stride;
-            if (!color_equal_with_fuzz(&row[4*x], &bgcolor, color_fuzz))
-                num_mismatch++;
-        }
-
-        if (num_mismatch > pxl_limit)
-            break;
-
-        min_left++;
-    }
-
-    // right
-    int min_right = 0;
-    for (int x = surfwidth-1; x > min_left; --x) {
-        int num_mismatch = 0;
-
-        for (int y = 0; y < surfheight; ++y) {
-            unsigned char *row = data + y * stride;
-            if (!color_equal_with_fuzz(&row[4*x], &bgcolor, color_fuzz))
-                num_mismatch++;
-        }
-
-        if (num_mismatch > pxl_limit)
-            break;
-
-        min_right++;
-    }
-
-    retval.left   = (double)min_left   * (pagewidth / surfwidth);
-    retval.right  = (double)min_right  * (pagewidth / surfwidth);
-    retval.top    = (double)min_top    * (pageheight / surfheight);
-    retval.bottom = (double)min_bottom * (pageheight / surfheight);
-
-    return retval;
-}
-
-static inline struct crop_bounds
-calc_crop_bounds_for_all(PopplerDocument *doc, double dpi, int pxl_limit, int color_fuzz, float bg_r, float bg_g, float bg_b)
-{
-    struct crop_bounds retval = { INFINITY, INFINITY, INFINITY, INFINITY };
-
-    for (int i = 0; i < poppler_document_get_n_pages(doc); ++i) {
-        g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, i);
-
-        struct crop_bounds b = calc_crop_bounds(page, dpi, pxl_limit, color_fuzz, bg_r, bg_b, bg_g);
-
-        retval.left   = MIN(retval.left, b.left);
-        retval.right  = MIN(retval.right, b.right);
-        retval.top    = MIN(retval.top, b.top);
-        retval.bottom = MIN(retval.bottom, b.bottom);
-    }
-
-    return retval;
-}
-
 int
 main(int argc, char **argv)
 {
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
+
     g_autofree gchar *arg_bgcolor = NULL;
     double arg_resolution = 72;
     gboolean arg_per_page = FALSE;
@@ -226,6 +88,7 @@ main(int argc, char **argv)
     int arg_color_fuzz = 0;
     g_autofree gchar *arg_target_w = NULL;
     g_autofree gchar *arg_target_h = NULL;
+    g_autofree gchar *arg_pages = NULL;
 
     GOptionEntry option_entries[] = {
         { "background-color", 'c', 0, G_OPTION_ARG_STRING, &arg_bgcolor,    "Background color to crop (default: white)", "RRGGBB" },
@@ -246,6 +109,7 @@ main(int argc, char **argv)
     g_autoptr(GError) error = NULL;
     g_autoptr(GOptionContext) context = g_option_context_new("<INPUT >OUTPUT");
     g_option_context_add_main_entries(context, option_entries, NULL);
+    jkpdf_add_pages_option(context, &arg_pages);
 
     g_option_context_set_description(context, "Remove empty borders around PDF content.\n"
         "\n"
@@ -265,6 +129,9 @@ main(int argc, char **argv)
         "  With the --per-page option, this can be changed so that every page is\n"
         "  cropped individually. With per page cropping, pages will end up having\n"
         "  different sizes.\n"
+        "  Without --per-page, the bounds depend on all pages, so even a preview\n"
+        "  (--preview-page) rasters every selected page once at --resolution. With\n"
+        "  --per-page, a preview only rasters the page shown.\n"
         "\n"
         "Fuzzy content detection:\n"
         "  The --fuzz option allows you to specify how closely a color needs to match\n"
@@ -275,6 +142,7 @@ main(int argc, char **argv)
         "  row or column empty. This is useful for ignoring tiny dust particles\n"
         "  on scanned images.\n"
         "\n"
+        JKPDF_BUDGET_HELP
     );
 
     if (!g_option_context_parse(context, &argc, &argv, &error)) {
@@ -288,124 +156,69 @@ main(int argc, char **argv)
     }
 
     float r = 1.0f, g = 1.0f, b = 1.0f;
-    struct crop_bounds global_bounds;
 
     if (arg_bgcolor && !parse_color_spec(arg_bgcolor, &r, &g, &b)) {
         fprintf(stderr, "ERROR: not a valid color: %s\n", arg_bgcolor);
         return 1;
     }
 
-    double margins[4] = { 0.0, 0.0, 0.0, 0.0 };
-    if (arg_margin && !jkpdf_parse_margin_spec(arg_margin, margins, &error)) {
+    JkPdfCropOptions options;
+    jkpdf_crop_options_init(&options);
+
+    options.background[0] = r;
+    options.background[1] = g;
+    options.background[2] = b;
+    options.resolution = arg_resolution;
+    options.per_page = arg_per_page;
+    options.allow_mismatch = arg_pxl_limit;
+    options.fuzz = arg_color_fuzz;
+    options.no_top = arg_no_top;
+    options.no_right = arg_no_right;
+    options.no_bottom = arg_no_bottom;
+    options.no_left = arg_no_left;
+
+    if (arg_margin && !jkpdf_parse_margin_spec(arg_margin, options.margins, &error)) {
         fprintf(stderr, "ERROR: invalid margin specification '%s': %s\n", arg_margin, error->message);
         return 1;
     }
 
-    double target_w = 0.0;
-    if (arg_target_w && !jkpdf_parse_single_length(arg_target_w, &target_w, &error)) {
+    if (arg_target_w && !jkpdf_parse_single_length(arg_target_w, &options.target_width, &error)) {
         fprintf(stderr, "ERROR: invalid target width '%s': %s\n", arg_target_w, error->message);
         return 1;
     }
 
-    double target_h = 0.0;
-    if (arg_target_h && !jkpdf_parse_single_length(arg_target_h, &target_h, &error)) {
+    if (arg_target_h && !jkpdf_parse_single_length(arg_target_h, &options.target_height, &error)) {
         fprintf(stderr, "ERROR: invalid target width '%s': %s\n", arg_target_h, error->message);
         return 1;
     }
 
-    if ((target_w > 0.0) && (margins[1] + margins[3] >= target_w)) {
-        fprintf(stderr, "ERROR: margins greater than target width\n");
-        return 1;
-    }
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_for_stdin();
+    g_autoptr(JkPdfPageSelection) selection = jkpdf_parse_pages_option(arg_pages, doc);
 
-    if ((target_h > 0.0) && (margins[0] + margins[2] >= target_h)) {
-        fprintf(stderr, "ERROR: margins greater than target height\n");
+    // finding the borders means rendering, so estimates go by the uncropped pages
+    g_autofree struct jkpdf_crop_bounds *bounds = jkpdf_estimate
+        ? g_new0(struct jkpdf_crop_bounds, jkpdf_document_get_n_pages(doc))
+        : jkpdf_crop_find_bounds(doc, &options, selection, &error);
+    if (!bounds) {
+        fprintf(stderr, "ERROR: %s\n", error->message);
         return 1;
     }
 
-    g_autoptr(JKPdfPopplerDocument) doc = jkpdf_create_poppler_document_for_stdin();
-    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
-
-    if (!arg_per_page) {
-        global_bounds = calc_crop_bounds_for_all(doc, arg_resolution, arg_pxl_limit, arg_color_fuzz, r, g, b);
-    }
-
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
+    if (jkpdf_crop_is_identity(doc, &options, bounds) && jkpdf_passthrough(doc))
+        return 0;
 
-    for (int pageno = 0; pageno < poppler_document_get_n_pages(doc); ++pageno) {
-        g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno);
-
-        double pagewidth, pageheight;
-        poppler_page_get_size(page, &pagewidth, &pageheight);
-
-        struct crop_bounds bounds;
-        if (arg_per_page) {
-            bounds = calc_crop_bounds(page, arg_resolution, arg_pxl_limit, arg_color_fuzz, r, g, b);
-        } else {
-            bounds = global_bounds;
-        }
-
-        if (arg_no_left)
-            bounds.left = 0.0;
-        if (arg_no_top)
-            bounds.top = 0.0;
-        if (arg_no_right)
-            bounds.right = 0.0;
-        if (arg_no_bottom)
-            bounds.bottom = 0.0;
-
-        cairo_save(cr);
-
-        if (target_w > 0.0 || target_h > 0.0) {
-            // scaled version
-
-            double cropped_w = pagewidth - bounds.left - bounds.right;
-            double cropped_h = pageheight - bounds.top - bounds.bottom;
-            double zoom_w = 0.0;
-            double zoom_h = 0.0;
-            double zoom = 0.0;
-
-            if (target_w > 0.0)
-                zoom_w = (target_w - margins[1] - margins[3]) / cropped_w;
-            if (target_h > 0.0)
-                zoom_h = (target_h - margins[0] - margins[2]) / cropped_h;
-
-            if (zoom_w > 0.0 && zoom_h > 0.0)
-                zoom = MIN(zoom_w, zoom_h);
-            else
-                zoom = MAX(zoom_w, zoom_h);
-
-            double target_page_w = cropped_w * zoom + margins[1] + margins[3];
-            double target_page_h = cropped_h * zoom + margins[0] + margins[2];
-
-            cairo_pdf_surface_set_size(surf, target_page_w, target_page_h);
-            cairo_translate(cr, margins[3], margins[0]);
-            cairo_scale(cr, zoom, zoom);
-            cairo_translate(cr, -bounds.left, -bounds.top);
-        } else {
-            // classic non-scaled version
-
-            bounds.top    = MAX(0.0, bounds.top - margins[0]);
-            bounds.right  = MAX(0.0, bounds.right - margins[1]);
-            bounds.bottom = MAX(0.0, bounds.bottom - margins[2]);
-            bounds.left   = MAX(0.0, bounds.left - margins[3]);
-
-
-            cairo_pdf_surface_set_size(surf, pagewidth - bounds.left - bounds.right, pageheight - bounds.top - bounds.bottom);
-            cairo_translate(cr, -bounds.left, -bounds.top);
-        }
+    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
+    jkpdf_surface_set_page_selection(surf, g_steal_pointer(&selection));
 
-        poppler_page_render_for_printing(page, cr);
-        cairo_restore(cr);
-        cairo_surface_show_page(surf);
+    if (!jkpdf_crop_render_document(doc, &options, bounds, surf, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error->message);
+        return 1;
     }
 
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
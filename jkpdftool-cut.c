@@ -15,14 +15,52 @@
 #include "jkpdf-io.h"
 #include "jkpdf-transform.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-pool.h"
 
 #include <stdbool.h>
 #include <inttypes.h>
 #include <limits.h>
 
+struct cut_params {
+    int pageno;
+    double x;
+    double y;
+    double w;
+    double h;
+};
+
+static void
+cut_page_size(JkPdfDocument **docs, int outpageno, double *width, double *height, gpointer user_data)
+{
+    (void)docs; (void)outpageno;
+    const struct cut_params *params = user_data;
+
+    *width = params->w;
+    *height = params->h;
+}
+
+static void
+cut_render_page(cairo_t *cr, JkPdfDocument **docs, int outpageno, gpointer user_data)
+{
+    (void)outpageno;
+    const struct cut_params *params = user_data;
+
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], params->pageno - 1);
+
+    cairo_translate(cr, -params->x, -params->y);
+
+    jkpdf_page_render(page, cr);
+}
+
 int
 main(int argc, char **argv)
 {
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
+
     g_autofree gchar *arg_left = NULL;
     g_autofree gchar *arg_top = NULL;
     g_autofree gchar *arg_width = NULL;
@@ -47,6 +85,7 @@ main(int argc, char **argv)
         "The PDF file is read from standard input, and the transformed PDF file is\n"
         "written onto the standard output.\n"
         "\n"
+        JKPDF_BUDGET_HELP
     );
 
     if (!g_option_context_parse(context, &argc, &argv, &error)) {
@@ -81,22 +120,21 @@ main(int argc, char **argv)
         return 1;
     }
 
-    g_autoptr(JKPdfPopplerDocument) doc = jkpdf_create_poppler_document_for_stdin();
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_for_stdin();
 
-    if (pageno < 1 || pageno > poppler_document_get_n_pages(doc)) {
+    if (pageno < 1 || pageno > jkpdf_document_get_n_pages(doc)) {
         fprintf(stderr, "ERROR: invalid page number %d\n", pageno);
         return 1;
     }
 
-    g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno-1);
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(doc, pageno-1);
 
 
     g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
 
 
     double pw, ph;
-    poppler_page_get_size(page, &pw, &ph);
+    jkpdf_page_get_size(page, &pw, &ph);
 
     if (x < 0.0)
         x = 0;
@@ -107,22 +145,15 @@ main(int argc, char **argv)
     if (h <= 0.0)
         h = ph - y;
 
-    cairo_save(cr);
-
-    cairo_pdf_surface_set_size(surf, w, h);
-    cairo_translate(cr, -x, -y);
+    struct cut_params params = { pageno, x, y, w, h };
 
-    poppler_page_render_for_printing(page, cr);
+    static const JkPdfPageFuncs funcs = { cut_page_size, cut_render_page, NULL };
+    jkpdf_render_pages(surf, &doc, 1, 1, &funcs, &params);
 
-    cairo_restore(cr);
-    cairo_surface_show_page(surf);
-
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
@@ -15,18 +15,58 @@
 #include "jkpdf-io.h"
 #include "jkpdf-transform.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-pool.h"
 
 #include <stdbool.h>
 #include <inttypes.h>
 #include <limits.h>
 
+struct duplexify_params {
+    double move_x;
+    double move_y;
+    double correct_x;
+    double correct_y;
+};
+
+static void
+duplexify_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    (void)user_data;
+
+    jkpdf_document_get_page_size(docs[0], pageno, width, height);
+}
+
+static void
+duplexify_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const struct duplexify_params *params = user_data;
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], pageno);
+
+    if (pageno % 2 == 0) {
+        // odd page
+        cairo_translate(cr, params->move_x + params->correct_x, params->move_y + params->correct_y);
+    } else {
+        // even page
+        cairo_translate(cr, -params->move_x, -params->move_y);
+    }
+
+    jkpdf_page_render(page, cr);
+}
+
 int
 main(int argc, char **argv)
 {
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
+
     g_autofree gchar *arg_move_x = NULL;
     g_autofree gchar *arg_move_y = NULL;
     g_autofree gchar *arg_correct_x = NULL;
     g_autofree gchar *arg_correct_y = NULL;
+    g_autofree gchar *arg_pages = NULL;
 
     GOptionEntry option_entries[] = {
         { "move-x",        'x', 0, G_OPTION_ARG_STRING, &arg_move_x,   "distance in X direction", "0" },
@@ -39,12 +79,14 @@ main(int argc, char **argv)
     g_autoptr(GError) error = NULL;
     g_autoptr(GOptionContext) context = g_option_context_new("<INPUT >OUTPUT");
     g_option_context_add_main_entries(context, option_entries, NULL);
+    jkpdf_add_pages_option(context, &arg_pages);
 
     g_option_context_set_description(context, "Move page content for duplex printing\n"
         "\n"
         "The PDF file is read from standard input, and the transformed PDF file is\n"
         "written onto the standard output.\n"
         "\n"
+        JKPDF_BUDGET_HELP
     );
 
     if (!g_option_context_parse(context, &argc, &argv, &error)) {
@@ -79,41 +121,24 @@ main(int argc, char **argv)
         return 1;
     }
 
-    g_autoptr(JKPdfPopplerDocument) doc = jkpdf_create_poppler_document_for_stdin();
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_for_stdin();
+    g_autoptr(JkPdfPageSelection) selection = jkpdf_parse_pages_option(arg_pages, doc);
 
-    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
-
-    for (int i = 0; i < poppler_document_get_n_pages(doc); ++i) {
-        g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, i);
-
-        double pw, ph;
-        poppler_page_get_size(page, &pw, &ph);
-
-        cairo_save(cr);
-
-        cairo_pdf_surface_set_size(surf, pw, ph);
+    if (move_x == 0.0 && move_y == 0.0 && correct_x == 0.0 && correct_y == 0.0 && jkpdf_passthrough(doc))
+        return 0;
 
-        if (i % 2 == 0) {
-            // odd page
-            cairo_translate(cr, move_x + correct_x, move_y + correct_y);
-        } else {
-            // even page
-            cairo_translate(cr, -move_x, -move_y);
-        }
+    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
+    jkpdf_surface_set_page_selection(surf, g_steal_pointer(&selection));
 
-        poppler_page_render_for_printing(page, cr);
+    struct duplexify_params params = { move_x, move_y, correct_x, correct_y };
 
-        cairo_restore(cr);
-        cairo_surface_show_page(surf);
-    }
+    static const JkPdfPageFuncs funcs = { duplexify_page_size, duplexify_render_page, NULL };
+    jkpdf_render_pages(surf, &doc, 1, JKPDF_EACH_INPUT_PAGE, &funcs, &params);
 
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
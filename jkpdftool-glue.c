@@ -16,12 +16,61 @@
 
 #include "jkpdf-io.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-pool.h"
 #include "jkpdf-transform.h"
 
+struct glue_params {
+    double margin;
+    double output_w;
+    double output_h;
+};
+
+static void
+glue_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    (void)docs; (void)pageno;
+    const struct glue_params *params = user_data;
+
+    *width = params->output_w;
+    *height = params->output_h;
+}
+
+static void
+glue_render_page(cairo_t *cr, JkPdfDocument **docs, int outpageno, gpointer user_data)
+{
+    (void)outpageno;
+    const struct glue_params *params = user_data;
+
+    int n_pages = jkpdf_document_get_n_pages(docs[0]);
+
+    double y = 0.0;
+    for (int i = 0; i < n_pages; ++i) {
+        cairo_save(cr);
+
+        g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], i);
+
+        double page_w, page_h;
+        jkpdf_page_get_size(page, &page_w, &page_h);
+
+        cairo_translate(cr, 0, y);
+
+        jkpdf_page_render(page, cr);
+
+        cairo_restore(cr);
+
+        y += page_h + params->margin;
+    }
+}
 
 int
 main(int argc, char **argv)
 {
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
+
     g_autofree gchar *arg_margin = NULL;
 
     GOptionEntry option_entries[] = {
@@ -39,6 +88,7 @@ main(int argc, char **argv)
         "written onto the standard output.\n"
         "\n"
         "\n"
+        JKPDF_BUDGET_HELP
     );
 
     if (!g_option_context_parse(context, &argc, &argv, &error)) {
@@ -58,52 +108,28 @@ main(int argc, char **argv)
     }
 
 
-    g_autoptr(JKPdfPopplerDocument) doc = jkpdf_create_poppler_document_for_stdin();
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_for_stdin();
     g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
 
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
-
-    int n_pages = poppler_document_get_n_pages(doc);
+    int n_pages = jkpdf_document_get_n_pages(doc);
 
-    double output_w = 1.0, output_h = -margin;
+    struct glue_params params = { margin, 1.0, -margin };
 
     for (int i = 0; i < n_pages; ++i) {
-        g_autoptr(JKPdfPopplerPage) p = poppler_document_get_page(doc, i);
         double page_w, page_h;
-        poppler_page_get_size(p, &page_w, &page_h);
+        jkpdf_document_get_page_size(doc, i, &page_w, &page_h);
 
-        output_w = output_w < page_w ? page_w : output_w;
-        output_h += page_h + margin;
+        params.output_w = params.output_w < page_w ? page_w : params.output_w;
+        params.output_h += page_h + margin;
     }
 
-    cairo_pdf_surface_set_size(surf, output_w, output_h);
+    static const JkPdfPageFuncs funcs = { glue_page_size, glue_render_page, NULL };
+    jkpdf_render_pages(surf, &doc, 1, 1, &funcs, &params);
 
-    double y = 0.0;
-    for (int i = 0; i < n_pages; ++i) {
-        cairo_save(cr);
-
-        g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, i);
-
-        double page_w, page_h;
-        poppler_page_get_size(page, &page_w, &page_h);
-
-        cairo_translate(cr, 0, y);
-
-        poppler_page_render_for_printing(page, cr);
-
-        cairo_restore(cr);
-
-        y += page_h + margin;
-    }
-
-    cairo_surface_show_page(surf);
-
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
@@ -16,54 +16,74 @@
 
 #include "jkpdf-io.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-pool.h"
 #include "jkpdf-transform.h"
 
 static void
 print_help(const char *argv0)
 {
     printf("Usage:\n");
-    printf("  %s <INPUT-PDF  >OUTPUT-PDF\n", argv0);
+    printf("  %s [--pages PAGESPEC] <INPUT-PDF  >OUTPUT-PDF\n", argv0);
     printf("\n");
     printf("Mirror the PDF\n");
+    printf("\n");
+    printf("With --pages (e.g. '1-2,5,7'), only these pages are mirrored.\n");
+    printf("\n");
+    printf("%s", JKPDF_BUDGET_HELP);
 }
 
-int
-main(int argc, char **argv)
+static void
+mirror_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
 {
-    if (argc != 1) {
-        print_help(argv[0]);
-        return 1;
-    }
+    (void)user_data;
 
-    g_autoptr(JKPdfPopplerDocument) doc = jkpdf_create_poppler_document_for_stdin();
-    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
+    jkpdf_document_get_page_size(docs[0], pageno, width, height);
+}
 
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
+static void
+mirror_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    (void)user_data;
 
-    for (int pageno = 0; pageno < poppler_document_get_n_pages(doc); ++pageno) {
-        g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno);
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], pageno);
 
-        cairo_rectangle_t source_r = { 0, 0, 0, 0 };
-        poppler_page_get_size(page, &source_r.width, &source_r.height);
+    double w, h;
+    jkpdf_page_get_size(page, &w, &h);
 
-        cairo_pdf_surface_set_size(surf, source_r.width, source_r.height);
+    cairo_translate(cr, w, 0);
+    cairo_scale(cr, -1, 1);
+    jkpdf_page_render(page, cr);
+}
 
-        cairo_save(cr);
+int
+main(int argc, char **argv)
+{
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
 
-        cairo_translate(cr, source_r.width, 0);
-        cairo_scale(cr, -1, 1);
-        poppler_page_render_for_printing(page, cr);
+    g_autofree gchar *arg_pages = jkpdf_take_pages_arg(&argc, argv);
 
-        cairo_restore(cr);
-        cairo_surface_show_page(surf);
+    if (argc != 1) {
+        print_help(argv[0]);
+        return 1;
     }
 
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_for_stdin();
+    g_autoptr(JkPdfPageSelection) selection = jkpdf_parse_pages_option(arg_pages, doc);
+
+    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
+    jkpdf_surface_set_page_selection(surf, g_steal_pointer(&selection));
+
+    static const JkPdfPageFuncs funcs = { mirror_page_size, mirror_render_page, NULL };
+    jkpdf_render_pages(surf, &doc, 1, JKPDF_EACH_INPUT_PAGE, &funcs, NULL);
+
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
@@ -16,11 +16,76 @@
 
 #include "jkpdf-io.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-pool.h"
 #include "jkpdf-transform.h"
 
+struct ndown_tile {
+    int pageno;
+    int x;
+    int y;
+    int cols;
+    int rows;
+};
+
+struct ndown_params {
+    GArray *tiles;
+    double overlap_pt;
+};
+
+static void
+ndown_page_size(JkPdfDocument **docs, int tileno, double *width, double *height, gpointer user_data)
+{
+    const struct ndown_params *params = user_data;
+    const struct ndown_tile *tile = &g_array_index(params->tiles, struct ndown_tile, tileno);
+
+    double w, h;
+    jkpdf_document_get_page_size(docs[0], tile->pageno, &w, &h);
+
+    *width = round(w/tile->cols);
+    *height = round(h/tile->rows);
+}
+
+static void
+ndown_render_page(cairo_t *cr, JkPdfDocument **docs, int tileno, gpointer user_data)
+{
+    const struct ndown_params *params = user_data;
+    const struct ndown_tile *tile = &g_array_index(params->tiles, struct ndown_tile, tileno);
+    double overlap_pt = params->overlap_pt;
+
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], tile->pageno);
+
+    double w, h;
+    jkpdf_page_get_size(page, &w, &h);
+
+    int x = tile->x;
+    int y = tile->y;
+    int cols = tile->cols;
+    int rows = tile->rows;
+
+    double pagewidth = round(w/cols);
+    double pageheight = round(h/rows);
+
+    cairo_rectangle_t source_r = { x * w / cols, y * h / rows, w/cols, h/rows };
+    cairo_rectangle_t page_r = { overlap_pt, overlap_pt, pagewidth - 2*overlap_pt, pageheight - 2*overlap_pt };
+
+    cairo_rectangle(cr, 0, 0, pagewidth, pageheight);
+    cairo_clip(cr);
+
+    cairo_matrix_t m = jkpdf_transform_rect_into_bounds(source_r, page_r);
+    cairo_transform(cr, &m);
+
+    jkpdf_page_render(page, cr);
+}
+
 int
 main(int argc, char **argv)
 {
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
+
     g_autofree gchar *arg_overlap = NULL;
 
     GOptionEntry option_entries[] = {
@@ -37,7 +102,10 @@ main(int argc, char **argv)
         "To 'n-down' a PDF is the reverse of 'n-up'ing it, i.e. split every page\n"
         "into multiple pages. For example, calling 'jkpdftool-ndown 3x2' will split\n"
         "each page into six pages. Each output page will be 1/3 as wide and 1/2 as\n"
-        "high as the originating input page.\n");
+        "high as the originating input page.\n"
+        "\n"
+        JKPDF_BUDGET_HELP
+    );
 
     if (!g_option_context_parse(context, &argc, &argv, &error)) {
         fprintf(stderr, "ERROR: option parsing failed: %s\n", error->message);
@@ -67,16 +135,14 @@ main(int argc, char **argv)
         }
     }
 
-    g_autoptr(JKPdfPopplerDocument) doc = jkpdf_create_poppler_document_for_stdin();
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_for_stdin();
     g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
 
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
-
-    for (int pageno = 0; pageno < poppler_document_get_n_pages(doc); ++pageno) {
-        g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno);
+    g_autoptr(GArray) tiles = g_array_new(FALSE, TRUE, sizeof(struct ndown_tile));
 
+    for (int pageno = 0; pageno < jkpdf_document_get_n_pages(doc); ++pageno) {
         double w, h;
-        poppler_page_get_size(page, &w, &h);
+        jkpdf_document_get_page_size(doc, pageno, &w, &h);
 
         int rows = arg_rows;
         int cols = arg_cols;
@@ -92,36 +158,21 @@ main(int argc, char **argv)
 
         for (int y = 0; y < rows; ++y) {
             for (int x = 0; x < cols; ++x) {
-                double pagewidth = round(w/cols);
-                double pageheight = round(h/rows);
-                cairo_pdf_surface_set_size(surf, pagewidth, pageheight);
-
-                cairo_save(cr);
-
-                cairo_rectangle_t source_r = { x * w / cols, y * h / rows, w/cols, h/rows };
-                cairo_rectangle_t page_r = { overlap_pt, overlap_pt, pagewidth - 2*overlap_pt, pageheight - 2*overlap_pt };
-
-                cairo_rectangle(cr, 0, 0, pagewidth, pageheight);
-                cairo_clip(cr);
-
-                cairo_matrix_t m = jkpdf_transform_rect_into_bounds(source_r, page_r);
-                cairo_transform(cr, &m);
-
-                poppler_page_render_for_printing(page, cr);
-
-                cairo_restore(cr);
-
-                cairo_surface_show_page(surf);
+                struct ndown_tile tile = { pageno, x, y, cols, rows };
+                g_array_append_val(tiles, tile);
             }
         }
     }
 
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    struct ndown_params params = { tiles, overlap_pt };
+
+    static const JkPdfPageFuncs funcs = { ndown_page_size, ndown_render_page, NULL };
+    jkpdf_render_pages(surf, &doc, 1, (int)tiles->len, &funcs, &params);
+
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
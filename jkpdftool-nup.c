@@ -16,6 +16,7 @@
 
 #include "jkpdf-io.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-nup.h"
 #include "jkpdf-transform.h"
 
 static void
@@ -32,11 +33,19 @@ print_help(const char *argv0)
     printf("three times as wide and two times as high as the first input page.\n");
     printf("\n");
     printf("If not specified, two input pages will be printed per output page.\n");
+    printf("\n");
+    printf("%s", JKPDF_BUDGET_HELP);
 }
 
 int
 main(int argc, char **argv)
 {
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
+
     if (argc > 2) {
         fprintf(stderr, "ERROR: expected at most one argument, see '%s --help'\n", argv[0]);
         return 1;
@@ -57,68 +66,21 @@ main(int argc, char **argv)
         }
     }
 
-    g_autoptr(JKPdfPopplerDocument) doc = jkpdf_create_poppler_document_for_stdin();
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_for_stdin();
     g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
 
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
-
-    int pageno = 0;
-    g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno);
-    while (pageno < poppler_document_get_n_pages(doc)) {
-        double w, h;
-        poppler_page_get_size(page, &w, &h);
-
-        int rows = arg_rows;
-        int cols = arg_cols;
-        if (rows == 0 || cols == 0) {
-            if (w > h) {
-                rows = 2;
-                cols = 1;
-            } else {
-                rows = 1;
-                cols = 2;
-            }
-        }
-
-        cairo_pdf_surface_set_size(surf, w * cols, h * rows);
-
-        for (int y = 0; y < rows; ++y) {
-            for (int x = 0; x < cols; ++x) {
-                if (page) {
-                    cairo_save(cr);
-
-                    cairo_rectangle_t page_r = { x * w, y * h, w, h };
-                    cairo_rectangle_t source_r = { 0, 0, 0, 0 };
-                    poppler_page_get_size(page, &source_r.width, &source_r.height);
-
-                    cairo_rectangle(cr, page_r.x, page_r.y, page_r.width, page_r.height);
-                    cairo_clip(cr);
+    JkPdfNupOptions options = { arg_cols, arg_rows };
 
-                    cairo_matrix_t m = jkpdf_transform_rect_into_bounds(source_r, page_r);
-                    cairo_transform(cr, &m);
-
-                    poppler_page_render_for_printing(page, cr);
-
-                    cairo_restore(cr);
-                }
-
-                g_clear_object(&page);
-                pageno++;
-                if (pageno < poppler_document_get_n_pages(doc)) {
-                    page = poppler_document_get_page(doc, pageno);
-                }
-            }
-        }
-
-        cairo_surface_show_page(surf);
+    g_autoptr(GError) error = NULL;
+    if (!jkpdf_nup_document(doc, &options, surf, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error->message);
+        return 1;
     }
 
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
@@ -15,6 +15,8 @@
 #include "jkpdf-io.h"
 #include "jkpdf-parsesize.h"
 #include "jkpdf-detect-bug104864.h"
+#include "jkpdf-isolate.h"
+#include "jkpdf-overlay.h"
 #include <stdbool.h>
 
 static inline bool
@@ -61,20 +63,33 @@ jkpdf_parse_offset_spec(const char *spec, double offsets[2], GError **error)
 
 int main(int argc, char **argv)
 {
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
+
     g_autoptr(GError) error = NULL;
     g_autofree gchar *arg_offset  = NULL;
     g_auto(GStrv)     arg_overlays = NULL;
+    gboolean          arg_isolate = FALSE;
+    g_autofree gchar *arg_pages   = NULL;
 
     GOptionEntry option_entries[] = {
-        { "offset", 'o', 0, G_OPTION_ARG_STRING, &arg_offset, "Offset", "X,Y" },
+        { "offset",  'o', 0, G_OPTION_ARG_STRING, &arg_offset, "Offset", "X,Y" },
+        { "isolate", 'i', 0, G_OPTION_ARG_NONE,   &arg_isolate, "Render every input in a separate process (avoids poppler bug 104864)", NULL },
         { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &arg_overlays, "Overlay files", "OVERLAY.PDF..." },
         { NULL }
     };
 
     g_autoptr(GOptionContext) context = g_option_context_new("<BASE.PDF >OUTPUT.PDF");
     g_option_context_add_main_entries(context, option_entries, NULL);
+    jkpdf_add_pages_option(context, &arg_pages);
 
-    g_option_context_set_description(context, "Overlay PDF files onto another");
+    g_option_context_set_description(context, "Overlay PDF files onto another\n"
+        "\n"
+        JKPDF_BUDGET_HELP
+    );
 
     if (!g_option_context_parse(context, &argc, &argv, &error)) {
         fprintf(stderr, "ERROR: option parsing failed: %s\n", error->message);
@@ -94,59 +109,50 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    // create inputs and output
-    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
-    g_autoptr(JKPdfPopplerDocument) main_doc = jkpdf_create_poppler_document_for_stdin();
+    // create inputs
+    g_autoptr(JkPdfDocument) main_doc = jkpdf_create_document_for_stdin();
+    g_autoptr(JkPdfPageSelection) selection = jkpdf_parse_pages_option(arg_pages, main_doc);
 
     unsigned overlay_count = g_strv_length(arg_overlays);
-    g_autoptr(GPtrArray) docarr = g_ptr_array_new_full(overlay_count + 1, g_object_unref);
-    g_ptr_array_add(docarr, g_object_ref(main_doc));
+    g_autoptr(GPtrArray) docarr = g_ptr_array_new_full(overlay_count + 1, (GDestroyNotify)jkpdf_document_unref);
+    g_ptr_array_add(docarr, jkpdf_document_ref(main_doc));
     for (unsigned i = 0; i < overlay_count; ++i) {
-        PopplerDocument *doc = jkpdf_create_poppler_document_for_commandline_arg(arg_overlays[i]);
+        JkPdfDocument *doc = jkpdf_create_document_for_commandline_arg(arg_overlays[i]);
 
         g_ptr_array_add(docarr, doc);
     }
 
-    // HACK!
-    jkpdf_warn_bug104864(docarr->len, (PopplerDocument**)docarr->pdata);
-
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
-
-    for (int i = 0; i < poppler_document_get_n_pages(main_doc); ++i) {
-        g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(main_doc, i);
-
-        double w, h;
-        poppler_page_get_size(page, &w, &h);
+    // before the output, whose writer thread must not be running while
+    // forking. Unselected pages are copied, but need no overlay.
+    if (arg_isolate) {
+        g_autofree JkPdfPageSelection **selections = g_new0(JkPdfPageSelection *, docarr->len);
+        for (guint i = 1; i < docarr->len; ++i)
+            selections[i] = selection;
 
-        cairo_pdf_surface_set_size(surf, w, h);
-
-        cairo_save(cr);
-        cairo_rectangle(cr, 0, 0, w, h);
-        cairo_clip(cr);
-
-        poppler_page_render_for_printing(page, cr);
-
-        cairo_translate(cr, offset[0], offset[1]);
-
-        for (unsigned k = 1; k <= overlay_count; ++k) {
-            if (i >= poppler_document_get_n_pages(docarr->pdata[k]))
-                continue;
+        if (!jkpdf_isolate_documents((JkPdfDocument **)docarr->pdata, (int)docarr->len, selections, &error)) {
+            fprintf(stderr, "ERROR: %s\n", error->message);
+            return 1;
+        }
+    } else {
+        jkpdf_warn_bug104864(docarr->len, (JkPdfDocument**)docarr->pdata); // HACK!
+    }
 
-            g_autoptr(JKPdfPopplerPage) overlay_page = poppler_document_get_page(docarr->pdata[k], i);
+    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
+    jkpdf_surface_set_page_selection(surf, g_steal_pointer(&selection));
 
-            poppler_page_render_for_printing(overlay_page, cr);
-        }
+    JkPdfOverlayOptions options = { { offset[0], offset[1] } };
 
-        cairo_restore(cr);
-        cairo_surface_show_page(surf);
+    if (!jkpdf_overlay_documents((JkPdfDocument **)docarr->pdata, (int)docarr->len, &options, surf, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error->message);
+        return 1;
     }
 
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+
+    return 0;
 }
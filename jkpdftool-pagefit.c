@@ -14,25 +14,25 @@
 
 #include "jkpdf-io.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-pagefit.h"
 #include "jkpdf-transform.h"
 
-static inline void
-swap_doubles(double *a, double *b)
-{
-    double tmp = *a;
-    *a = *b;
-    *b = tmp;
-}
-
 int
 main(int argc, char **argv)
 {
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
+
     g_autofree gchar *arg_size = NULL;
     g_autofree gchar *arg_orientation = NULL;
     g_autofree gchar *arg_margin = NULL;
     g_autofree gchar *arg_halign = NULL;
     g_autofree gchar *arg_valign = NULL;
     g_autofree gchar *arg_scale = NULL;
+    g_autofree gchar *arg_pages = NULL;
 
     GOptionEntry option_entries[] = {
         { "size",        's', 0, G_OPTION_ARG_STRING, &arg_size, "Page size", "WIDTHxHEIGHT" },
@@ -47,6 +47,7 @@ main(int argc, char **argv)
     g_autoptr(GError) error = NULL;
     g_autoptr(GOptionContext) context = g_option_context_new("<INPUT >OUTPUT");
     g_option_context_add_main_entries(context, option_entries, NULL);
+    jkpdf_add_pages_option(context, &arg_pages);
 
     g_option_context_set_description(context, "Scale a PDF to fit onto a given page format.\n"
         "\n"
@@ -83,6 +84,7 @@ main(int argc, char **argv)
         "  You can choose where to place the scaled content on the page using the\n"
         "  --halign and --valign options. By default, the content is centered.\n"
         "\n"
+        JKPDF_BUDGET_HELP
     );
 
     if (!g_option_context_parse(context, &argc, &argv, &error)) {
@@ -154,65 +156,34 @@ main(int argc, char **argv)
         }
     }
 
-    g_autoptr(JKPdfPopplerDocument) doc = jkpdf_create_poppler_document_for_stdin();
-    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
-
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
-
-    for (int pageno = 0; pageno < poppler_document_get_n_pages(doc); ++pageno) {
-        g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno);
-
-        cairo_rectangle_t source_r = { 0, 0, 0, 0 };
-        cairo_rectangle_t page_r = { 0, 0, arg_width, arg_height };
-        poppler_page_get_size(page, &source_r.width, &source_r.height);
-
-        if (arg_width == 0.0 || arg_height == 0.0) {
-            page_r.width = source_r.width;
-            page_r.height = source_r.height;
-        }
-
-        if (orientation == JKPDF_ORIENTATION_AUTO) {
-            if ((source_r.width > source_r.height && page_r.width < page_r.height) ||
-                (source_r.width < source_r.height && page_r.width > page_r.height)) {
-                swap_doubles(&page_r.width, &page_r.height);
-            }
-        } else if (orientation == JKPDF_ORIENTATION_LANDSCAPE) {
-            if (page_r.width < page_r.height) {
-                swap_doubles(&page_r.width, &page_r.height);
-            }
-        } else if (orientation == JKPDF_ORIENTATION_PORTRAIT) {
-            if (page_r.width > page_r.height) {
-                swap_doubles(&page_r.width, &page_r.height);
-            }
-        }
-
-        cairo_pdf_surface_set_size(surf, page_r.width, page_r.height);
-        cairo_save(cr);
-
-        if (margins[0] + margins[2] >= page_r.height || margins[1] + margins[3] >= page_r.width) {
-            fprintf(stderr, "ERROR: while processing page %d: margins greater than the page\n", pageno+1);
-            return 1;
-        }
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_for_stdin();
+    g_autoptr(JkPdfPageSelection) selection = jkpdf_parse_pages_option(arg_pages, doc);
+
+    JkPdfPagefitOptions options = {
+        .width = arg_width,
+        .height = arg_height,
+        .orientation = orientation,
+        .margins = { margins[0], margins[1], margins[2], margins[3] },
+        .halign = halign,
+        .valign = valign,
+        .scale = scale,
+    };
 
-        page_r.x += margins[3];
-        page_r.y += margins[0];
-        page_r.width -= margins[3] + margins[1];
-        page_r.height -= margins[0] + margins[2];
+    if (jkpdf_pagefit_is_identity(doc, &options) && jkpdf_passthrough(doc))
+        return 0;
 
-        cairo_matrix_t m = jkpdf_transform_rect_into_bounds_3(source_r, page_r, halign, valign, scale);
-        cairo_transform(cr, &m);
-        poppler_page_render_for_printing(page, cr);
+    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
+    jkpdf_surface_set_page_selection(surf, g_steal_pointer(&selection));
 
-        cairo_restore(cr);
-        cairo_surface_show_page(surf);
+    if (!jkpdf_pagefit_document(doc, &options, surf, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error->message);
+        return 1;
     }
 
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
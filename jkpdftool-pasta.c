@@ -14,18 +14,19 @@
 
 #include "jkpdf-io.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-pool.h"
 #include <stdbool.h>
 
 // Rendering, via a scene graph-like tree structure
 struct JkpdfPastaNode {
-    void (*render)(cairo_t * /*cr*/, struct JkpdfPastaNode * /*closure*/);
+    void (*render)(cairo_t * /*cr*/, JkPdfDocument * /*doc*/, struct JkpdfPastaNode * /*closure*/);
     double width;
     double height;
 };
 
 struct JkpdfPastaSourceNode {
     struct JkpdfPastaNode node;
-    PopplerPage *page;
+    int pageno;
 };
 
 struct JkpdfPastaDeleteNode {
@@ -53,9 +54,9 @@ struct JkpdfPastaPasteNode {
 };
 
 static void
-jkpdf_pasta_null_node_render_func(cairo_t *cr, struct JkpdfPastaNode *closure)
+jkpdf_pasta_null_node_render_func(cairo_t *cr, JkPdfDocument *doc, struct JkpdfPastaNode *closure)
 {
-    (void)cr; (void)closure;
+    (void)cr; (void)doc; (void)closure;
 }
 
 static struct JkpdfPastaNode *
@@ -71,33 +72,35 @@ jkpdf_pasta_create_null_node(void)
 
 
 static void
-jkpdf_pasta_source_node_render_func(cairo_t *cr, struct JkpdfPastaNode *closure)
+jkpdf_pasta_source_node_render_func(cairo_t *cr, JkPdfDocument *doc, struct JkpdfPastaNode *closure)
 {
     struct JkpdfPastaSourceNode *source = (struct JkpdfPastaSourceNode *)closure;
 
     cairo_save(cr);
     cairo_rectangle(cr, 0, 0, source->node.width, source->node.height);
     cairo_clip(cr);
-    poppler_page_render_for_printing(source->page, cr);
+
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(doc, source->pageno);
+    jkpdf_page_render(page, cr);
     cairo_restore(cr);
 }
 
 static struct JkpdfPastaNode *
-jkpdf_pasta_create_source_node(PopplerPage *page)
+jkpdf_pasta_create_source_node(JkPdfDocument *doc, int pageno)
 {
     double w = 0, h = 0;
-    poppler_page_get_size(page, &w, &h);
+    jkpdf_document_get_page_size(doc, pageno, &w, &h);
 
     struct JkpdfPastaSourceNode *node = g_new0(struct JkpdfPastaSourceNode, 1);
     node->node.render = jkpdf_pasta_source_node_render_func;
     node->node.width = w;
     node->node.height = h;
-    node->page = page;
+    node->pageno = pageno;
     return &node->node;
 }
 
 static void
-jkpdf_pasta_delete_node_render_func(cairo_t *cr, struct JkpdfPastaNode *closure)
+jkpdf_pasta_delete_node_render_func(cairo_t *cr, JkPdfDocument *doc, struct JkpdfPastaNode *closure)
 {
     struct JkpdfPastaDeleteNode *node = (struct JkpdfPastaDeleteNode *)closure;
 
@@ -117,7 +120,7 @@ jkpdf_pasta_delete_node_render_func(cairo_t *cr, struct JkpdfPastaNode *closure)
     cairo_close_path(cr);
     cairo_clip(cr);
 
-    node->source->render(cr, node->source);
+    node->source->render(cr, doc, node->source);
 
     cairo_restore(cr);
 }
@@ -139,7 +142,7 @@ jkpdf_pasta_create_delete_node(struct JkpdfPastaNode *source, double x, double y
 }
 
 static void
-jkpdf_pasta_copy_node_render_func(cairo_t *cr, struct JkpdfPastaNode *closure)
+jkpdf_pasta_copy_node_render_func(cairo_t *cr, JkPdfDocument *doc, struct JkpdfPastaNode *closure)
 {
     struct JkpdfPastaCopyNode *node = (struct JkpdfPastaCopyNode *)closure;
 
@@ -147,7 +150,7 @@ jkpdf_pasta_copy_node_render_func(cairo_t *cr, struct JkpdfPastaNode *closure)
     cairo_translate(cr, -node->x, -node->y);
     cairo_rectangle(cr, node->x, node->y, node->node.width, node->node.height);
     cairo_clip(cr);
-    node->source->render(cr, node->source);
+    node->source->render(cr, doc, node->source);
     cairo_restore(cr);
 }
 
@@ -166,15 +169,15 @@ jkpdf_pasta_create_copy_node(struct JkpdfPastaNode *source, double x, double y,
 }
 
 static void
-jkpdf_pasta_paste_node_render_func(cairo_t *cr, struct JkpdfPastaNode *closure)
+jkpdf_pasta_paste_node_render_func(cairo_t *cr, JkPdfDocument *doc, struct JkpdfPastaNode *closure)
 {
     struct JkpdfPastaPasteNode *node = (struct JkpdfPastaPasteNode *)closure;
 
-    node->source->render(cr, node->source);
+    node->source->render(cr, doc, node->source);
 
     cairo_save(cr);
     cairo_translate(cr, node->x, node->y);
-    node->clipboard->render(cr, node->clipboard);
+    node->clipboard->render(cr, doc, node->clipboard);
     cairo_restore(cr);
 }
 
@@ -193,6 +196,32 @@ jkpdf_pasta_create_paste_node(struct JkpdfPastaNode *source, struct JkpdfPastaNo
     return &node->node;
 }
 
+struct pasta_params {
+    struct JkpdfPastaNode **page_nodes;
+};
+
+static void
+pasta_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    (void)docs;
+    const struct pasta_params *params = user_data;
+
+    *width = params->page_nodes[pageno]->width;
+    *height = params->page_nodes[pageno]->height;
+}
+
+static void
+pasta_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const struct pasta_params *params = user_data;
+    struct JkpdfPastaNode *node = params->page_nodes[pageno];
+
+    cairo_rectangle(cr, 0, 0, node->width, node->height);
+    cairo_clip(cr);
+
+    node->render(cr, docs[0], node);
+}
+
 // command line spec parsing
 
 enum JkpdfCopyPasteSpecType {
@@ -322,6 +351,12 @@ jkpdf_parse_copy_paste_spec(const char *spec, enum JkpdfCopyPasteSpecType *type,
 
 int main(int argc, char **argv)
 {
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
+
     g_autoptr(GError) error = NULL;
     g_auto(GStrv)     arg_commands = NULL;
     double            arg_dpi = 72;
@@ -341,6 +376,8 @@ int main(int argc, char **argv)
         "   cut:    x,PAGENO,X,Y,WIDTH,HEIGHT\n"
         "   copy:   c,PAGENO,X,Y,WIDTH,HEIGHT\n"
         "   paste:  v,PAGENO,X,Y\n"
+        "\n"
+        JKPDF_BUDGET_HELP
     );
 
     if (!g_option_context_parse(context, &argc, &argv, &error)) {
@@ -355,14 +392,14 @@ int main(int argc, char **argv)
 
     // create inputs and output
     g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
-    g_autoptr(JKPdfPopplerDocument) main_doc = jkpdf_create_poppler_document_for_stdin();
+    g_autoptr(JkPdfDocument) main_doc = jkpdf_create_document_for_stdin();
 
     // FIXME! memory handling, we currently just leak the render node stuff
-    int npages = poppler_document_get_n_pages(main_doc);
+    int npages = jkpdf_document_get_n_pages(main_doc);
     struct JkpdfPastaNode **pageNodes = g_new0(struct JkpdfPastaNode *, npages);
     struct JkpdfPastaNode *clipboard = jkpdf_pasta_create_null_node();
     for (int i = 0; i < npages; ++i) {
-        pageNodes[i] = jkpdf_pasta_create_source_node(poppler_document_get_page(main_doc, i));
+        pageNodes[i] = jkpdf_pasta_create_source_node(main_doc, i);
     }
 
     for (unsigned i = 0; i < g_strv_length(arg_commands); ++i) {
@@ -394,27 +431,17 @@ int main(int argc, char **argv)
         }
     }
 
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
-    for (int i = 0; i < npages; ++i) {
-        cairo_pdf_surface_set_size(surf, pageNodes[i]->width, pageNodes[i]->height);
-
-        cairo_save(cr);
-        cairo_rectangle(cr, 0, 0, pageNodes[i]->width, pageNodes[i]->height);
-        cairo_clip(cr);
+    struct pasta_params params = { pageNodes };
 
-        pageNodes[i]->render(cr, pageNodes[i]);
+    static const JkPdfPageFuncs funcs = { pasta_page_size, pasta_render_page, NULL };
+    jkpdf_render_pages(surf, &main_doc, 1, npages, &funcs, &params);
 
-        cairo_restore(cr);
-        cairo_surface_show_page(surf);
-    }
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_status_t status = cairo_status(cr);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    return 0;
 }
-
@@ -16,21 +16,66 @@
 
 #include "jkpdf-io.h"
 #include "jkpdf-parsesize.h"
+#include "jkpdf-pool.h"
 #include "jkpdf-transform.h"
 
 static void
 print_help(const char *argv0)
 {
     printf("Usage:\n");
-    printf("  %s DEGREES  <INPUT-PDF  >OUTPUT-PDF\n", argv0);
+    printf("  %s [--pages PAGESPEC] DEGREES  <INPUT-PDF  >OUTPUT-PDF\n", argv0);
     printf("\n");
     printf("Rotate the content of the PDF file read via standard input by the given number\n");
     printf("of degrees in counter-clockwise direction, write the result onto standard output\n");
+    printf("\n");
+    printf("With --pages (e.g. '1-2,5,7'), only these pages are rotated.\n");
+    printf("\n");
+    printf("%s", JKPDF_BUDGET_HELP);
+}
+
+static cairo_rectangle_t
+rotated_page_bounds(JkPdfDocument *doc, int pageno, const cairo_matrix_t *rotm)
+{
+    cairo_rectangle_t source_r = { 0, 0, 0, 0 };
+    jkpdf_document_get_page_size(doc, pageno, &source_r.width, &source_r.height);
+
+    return jkpdf_transform_bounding_rect(&source_r, rotm);
+}
+
+static void
+rotate_page_size(JkPdfDocument **docs, int pageno, double *width, double *height, gpointer user_data)
+{
+    const cairo_matrix_t *rotm = user_data;
+
+    cairo_rectangle_t rotated_bounds = rotated_page_bounds(docs[0], pageno, rotm);
+    *width = rotated_bounds.width;
+    *height = rotated_bounds.height;
+}
+
+static void
+rotate_render_page(cairo_t *cr, JkPdfDocument **docs, int pageno, gpointer user_data)
+{
+    const cairo_matrix_t *rotm = user_data;
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(docs[0], pageno);
+
+    cairo_rectangle_t rotated_bounds = rotated_page_bounds(docs[0], pageno, rotm);
+
+    cairo_translate(cr, -rotated_bounds.x, -rotated_bounds.y);
+    cairo_transform(cr, rotm);
+    jkpdf_page_render(page, cr);
 }
 
 int
 main(int argc, char **argv)
 {
+    jkpdf_take_stats_arg(&argc, argv);
+    jkpdf_take_preview_args(&argc, argv);
+    jkpdf_take_checkpoint_args(&argc, argv);
+    jkpdf_take_estimate_arg(&argc, argv);
+    jkpdf_take_budget_args(&argc, argv);
+
+    g_autofree gchar *arg_pages = jkpdf_take_pages_arg(&argc, argv);
+
     if (argc != 2) {
         fprintf(stderr, "ERROR: expected exactly one argument, see '%s --help'\n", argv[0]);
         return 1;
@@ -48,37 +93,22 @@ main(int argc, char **argv)
     cairo_matrix_init_rotate(&rotm, -angle / 180.0 * M_PI);
 
 
-    g_autoptr(JKPdfPopplerDocument) doc = jkpdf_create_poppler_document_for_stdin();
-    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
-
-    g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
-
-    for (int pageno = 0; pageno < poppler_document_get_n_pages(doc); ++pageno) {
-        g_autoptr(JKPdfPopplerPage) page = poppler_document_get_page(doc, pageno);
-
-        cairo_rectangle_t source_r = { 0, 0, 0, 0 };
-        poppler_page_get_size(page, &source_r.width, &source_r.height);
-
-        cairo_rectangle_t rotated_bounds = jkpdf_transform_bounding_rect(&source_r, &rotm);
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_for_stdin();
+    g_autoptr(JkPdfPageSelection) selection = jkpdf_parse_pages_option(arg_pages, doc);
 
-        cairo_pdf_surface_set_size(surf, rotated_bounds.width, rotated_bounds.height);
-
-        cairo_save(cr);
+    if (fmod(angle, 360.0) == 0.0 && jkpdf_passthrough(doc))
+        return 0;
 
-        cairo_translate(cr, -rotated_bounds.x, -rotated_bounds.y);
-        cairo_transform(cr, &rotm);
-        poppler_page_render_for_printing(page, cr);
+    g_autoptr(JKPdfCairoSurfaceT) surf = jkpdf_create_surface_for_stdout();
+    jkpdf_surface_set_page_selection(surf, g_steal_pointer(&selection));
 
-        cairo_restore(cr);
-        cairo_surface_show_page(surf);
-    }
+    static const JkPdfPageFuncs funcs = { rotate_page_size, rotate_render_page, NULL };
+    jkpdf_render_pages(surf, &doc, 1, JKPDF_EACH_INPUT_PAGE, &funcs, &rotm);
 
-    cairo_status_t status = cairo_status(cr);
-    if (status)
-        fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
+    if (!jkpdf_surface_finish(surf))
+        return 1;
 
-    cairo_surface_finish(surf);
-    status = cairo_surface_status(surf);
+    cairo_status_t status = cairo_surface_status(surf);
     if (status)
         fprintf(stderr, "WTF: cairo status: %s\n", cairo_status_to_string(status));
 
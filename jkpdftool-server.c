@@ -0,0 +1,572 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "jkpdf-document.h"
+#include "jkpdf-server.h"
+
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+// Only part of the multicall binary, see jkpdftool.c
+//
+// The server forks a number of worker processes which have already loaded
+// fonts and initialized cairo and poppler. Every worker accepts one job at a
+// time and forks again to run it, so a job crashing or calling exit() does
+// no harm and the next job starts from the same warm state.
+//
+// Every worker keeps a cache of recently opened documents. The job process
+// inherits it with fork(), and reports documents it had to open itself back
+// to the worker, as a memfd over a datagram socket.
+
+#define CACHE_MAX_DOCUMENT_SIZE (64 * 1024 * 1024)
+#define CACHE_KEY_SIZE          65 // SHA-256 as hex string, with terminating NUL
+
+#define JOB_MAX_PAYLOAD_SIZE    (1024 * 1024)
+
+typedef struct {
+    gchar *key;
+    JkPdfDocument *doc;
+    GList *link; // in cache_lru
+} CacheEntry;
+
+static GHashTable *cache;     // key -> CacheEntry
+static GQueue      cache_lru; // most recently used first
+static guint       cache_size = 16;
+
+static int cache_sock = -1; // job process end of the cache socket
+
+static volatile sig_atomic_t quit;
+
+static void
+cache_entry_free(gpointer data)
+{
+    CacheEntry *entry = data;
+
+    jkpdf_document_unref(entry->doc);
+    g_free(entry->key);
+    g_free(entry);
+}
+
+static void
+cache_touch(const char *key)
+{
+    CacheEntry *entry = g_hash_table_lookup(cache, key);
+    if (!entry)
+        return;
+
+    g_queue_unlink(&cache_lru, entry->link);
+    g_queue_push_head_link(&cache_lru, entry->link);
+}
+
+static void
+cache_insert(const char *key, JkPdfDocument *doc)
+{
+    if (g_hash_table_contains(cache, key)) {
+        jkpdf_document_unref(doc);
+        cache_touch(key);
+        return;
+    }
+
+    CacheEntry *entry = g_new0(CacheEntry, 1);
+    entry->key = g_strdup(key);
+    entry->doc = doc;
+    g_queue_push_head(&cache_lru, entry);
+    entry->link = cache_lru.head;
+    g_hash_table_insert(cache, entry->key, entry);
+
+    while (g_queue_get_length(&cache_lru) > cache_size) {
+        CacheEntry *old = g_queue_pop_tail(&cache_lru);
+        g_hash_table_remove(cache, old->key);
+    }
+}
+
+// Overrides the weak symbol in jkpdf-document.h, runs in the job process
+JkPdfDocument *
+jkpdf_document_cache_open(GBytes *bytes)
+{
+    if (cache_sock < 0 || g_bytes_get_size(bytes) > CACHE_MAX_DOCUMENT_SIZE)
+        return NULL;
+
+    g_autofree gchar *key = g_compute_checksum_for_bytes(G_CHECKSUM_SHA256, bytes);
+
+    CacheEntry *entry = g_hash_table_lookup(cache, key);
+    if (entry) {
+        // tell the worker, so it can keep the entry around
+        (void)send(cache_sock, key, CACHE_KEY_SIZE, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (jkpdf_verbose())
+            fprintf(stderr, "INFO: using cached document %.16s\n", key);
+
+        return jkpdf_document_ref(entry->doc);
+    }
+
+    // Parse it here first, so invalid documents never reach the worker
+    JkPdfDocument *doc = jkpdf_document_new_from_bytes(bytes, NULL);
+    if (!doc)
+        return NULL; // let jkpdf_create_document_from_bytes() complain
+
+    gsize len = 0;
+    const guint8 *data = g_bytes_get_data(bytes, &len);
+
+    int memfd = memfd_create("jkpdf-cache", MFD_CLOEXEC);
+    if (memfd < 0 || !jkpdf_write_full(memfd, data, len)) {
+        perror("WARN: could not copy document for caching");
+    } else if (!jkpdf_send_with_fds(cache_sock, key, CACHE_KEY_SIZE, &memfd, 1)) {
+        // the socket is non-blocking, the worker will just miss this one
+        if (jkpdf_verbose())
+            perror("INFO: could not pass document to the cache");
+    }
+
+    if (memfd >= 0)
+        close(memfd);
+
+    return doc;
+}
+
+// Picks up documents reported by the job process
+static void
+cache_receive(int sock)
+{
+    for (;;) {
+        char key[CACHE_KEY_SIZE];
+        int fd = -1;
+
+        int n_fds = jkpdf_recv_with_fds(sock, key, sizeof(key), &fd, 1);
+        if (n_fds < 0)
+            break;
+
+        key[sizeof(key) - 1] = 0;
+
+        if (n_fds == 0) {
+            cache_touch(key);
+            continue;
+        }
+
+        g_autoptr(GMappedFile) map = _jkpdf_map_fd(fd);
+        close(fd);
+
+        if (!map || g_hash_table_contains(cache, key)) {
+            cache_touch(key);
+            continue;
+        }
+
+        g_autoptr(GBytes) bytes = g_mapped_file_get_bytes(map);
+        JkPdfDocument *doc = jkpdf_document_new_from_bytes(bytes, NULL);
+        if (doc)
+            cache_insert(key, doc);
+    }
+}
+
+static cairo_status_t
+append_to_byte_array(void *closure, const unsigned char *data, unsigned int length)
+{
+    g_byte_array_append(closure, data, length);
+    return CAIRO_STATUS_SUCCESS;
+}
+
+// Loads fonts and everything else cairo and poppler initialize lazily,
+// before forking the workers
+static void
+warm_up(void)
+{
+    g_autoptr(GByteArray) pdf = g_byte_array_new();
+
+    {
+        g_autoptr(JKPdfCairoSurfaceT) surf = cairo_pdf_surface_create_for_stream(append_to_byte_array, pdf, 100, 100);
+        g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
+
+        cairo_move_to(cr, 10, 50);
+        cairo_show_text(cr, "jkpdftool");
+        cairo_show_page(cr);
+        cairo_surface_finish(surf);
+    }
+
+    g_autoptr(GBytes) bytes = g_byte_array_free_to_bytes(g_steal_pointer(&pdf));
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_from_bytes(bytes);
+    g_autoptr(JkPdfPage) page = jkpdf_document_get_page(doc, 0);
+
+    g_autoptr(JKPdfCairoSurfaceT) image = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 100, 100);
+    g_autoptr(JKPdfCairoT) cr = cairo_create(image);
+    jkpdf_page_render(page, cr);
+}
+
+static char **
+split_payload(const char *payload, gsize len, guint n)
+{
+    g_autoptr(GPtrArray) strings = g_ptr_array_new();
+    const char *p = payload;
+
+    while (strings->len < n && p < payload + len) {
+        const char *end = memchr(p, 0, (size_t)(payload + len - p));
+        if (!end)
+            return NULL;
+
+        g_ptr_array_add(strings, (char *)p);
+        p = end + 1;
+    }
+
+    if (strings->len != n || p != payload + len)
+        return NULL;
+
+    g_ptr_array_add(strings, NULL);
+    return (char **)g_ptr_array_free(g_steal_pointer(&strings), FALSE);
+}
+
+static void G_GNUC_NORETURN
+run_job(int listen_fd, int conn, int fds[3], char **strings, guint n_args, guint n_env)
+{
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    signal(SIGPIPE, SIG_DFL);
+
+    close(listen_fd);
+    close(conn);
+
+    for (int i = 0; i < 3; ++i) {
+        if (dup2(fds[i], i) < 0)
+            _exit(1);
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (fds[i] > 2)
+            close(fds[i]);
+    }
+
+    const char *cwd = strings[0];
+    char **args = strings + 1;
+    char **env = strings + 1 + n_args;
+
+    if (chdir(cwd) < 0) {
+        fprintf(stderr, "ERROR: could not change into directory '%s': %s\n", cwd, strerror(errno));
+        exit(1);
+    }
+
+    // The JKPDF_* environment is the client's, not ours
+    g_auto(GStrv) names = g_listenv();
+    for (guint i = 0; names[i]; ++i) {
+        if (g_str_has_prefix(names[i], "JKPDF_"))
+            g_unsetenv(names[i]);
+    }
+
+    for (guint i = 0; i < n_env; ++i) {
+        char *eq = strchr(env[i], '=');
+        if (!eq || !g_str_has_prefix(env[i], "JKPDF_"))
+            continue;
+
+        *eq = 0;
+        g_setenv(env[i], eq + 1, TRUE);
+    }
+
+    exit(jkpdftool_run((int)n_args, args));
+}
+
+static int
+wait_for_job(pid_t pid, int conn)
+{
+#ifdef SYS_pidfd_open
+    int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    int pidfd = -1;
+#endif
+
+    for (;;) {
+        int status = 0;
+        pid_t r = waitpid(pid, &status, pidfd >= 0 ? WNOHANG : 0);
+        if (r == pid) {
+            if (pidfd >= 0)
+                close(pidfd);
+
+            if (WIFEXITED(status))
+                return WEXITSTATUS(status);
+            else
+                return 128 + WTERMSIG(status);
+        }
+
+        if (r < 0 && errno != EINTR) {
+            perror("WTF: waitpid(2)");
+            return 1;
+        }
+
+        if (pidfd < 0)
+            continue;
+
+        // The client never sends anything after the job, so the
+        // connection becoming readable means it went away.
+        struct pollfd pfd[2] = { { pidfd, POLLIN, 0 }, { conn, POLLIN, 0 } };
+        if (poll(pfd, 2, -1) < 0 && errno != EINTR) {
+            perror("WTF: poll(2)");
+            return 1;
+        }
+
+        if (pfd[1].revents)
+            kill(pid, SIGKILL);
+    }
+}
+
+static void
+handle_connection(int listen_fd, int conn)
+{
+    JkPdfJobHeader header;
+    int fds[3] = { -1, -1, -1 };
+
+    int n_fds = jkpdf_recv_with_fds(conn, &header, sizeof(header), fds, 3);
+    if (n_fds < 0)
+        return;
+
+    g_autofree char *payload = NULL;
+    g_autofree char **strings = NULL;
+
+    if (n_fds != 3 || header.magic != JKPDF_SERVER_MAGIC || header.payload_len > JOB_MAX_PAYLOAD_SIZE
+            || header.n_args < 1 || header.n_args > header.payload_len || header.n_env > header.payload_len) {
+        fprintf(stderr, "WARN: ignoring invalid job request\n");
+        goto out;
+    }
+
+    payload = g_malloc(header.payload_len);
+    if (!jkpdf_read_full(conn, payload, header.payload_len))
+        goto out;
+
+    strings = split_payload(payload, header.payload_len, 1 + header.n_args + header.n_env);
+    if (!strings) {
+        fprintf(stderr, "WARN: ignoring malformed job request\n");
+        goto out;
+    }
+
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, sockets) < 0) {
+        perror("ERROR: socketpair(2)");
+        goto out;
+    }
+
+    gint64 start = g_get_monotonic_time();
+
+    // don't pass on anything buffered to the job's output
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("ERROR: fork(2)");
+        close(sockets[0]);
+        close(sockets[1]);
+        goto out;
+    }
+
+    if (pid == 0) {
+        close(sockets[0]);
+        cache_sock = sockets[1];
+        run_job(listen_fd, conn, fds, strings, header.n_args, header.n_env);
+    }
+
+    close(sockets[1]);
+    for (int i = 0; i < 3; ++i) {
+        close(fds[i]);
+        fds[i] = -1;
+    }
+
+    int32_t retval = wait_for_job(pid, conn);
+    (void)jkpdf_write_full(conn, &retval, sizeof(retval));
+
+    if (jkpdf_verbose()) {
+        g_autofree gchar *cmdline = g_strjoinv(" ", strings + 1);
+        fprintf(stderr, "INFO: [%d] '%s' exited with %d after %.3f s\n",
+                (int)getpid(), cmdline, (int)retval, (double)(g_get_monotonic_time() - start) / G_USEC_PER_SEC);
+    }
+
+    // the client has its answer, now we have time to fill the cache
+    cache_receive(sockets[0]);
+    close(sockets[0]);
+
+out:
+    for (int i = 0; i < 3; ++i) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+}
+
+static void G_GNUC_NORETURN
+run_worker(int listen_fd)
+{
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN); // clients may go away any time
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+    for (;;) {
+        int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            perror("ERROR: accept(2)");
+            _exit(1);
+        }
+
+        handle_connection(listen_fd, conn);
+        close(conn);
+    }
+}
+
+static pid_t
+spawn_worker(int listen_fd)
+{
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("ERROR: fork(2)");
+        exit(1);
+    }
+
+    if (pid == 0)
+        run_worker(listen_fd);
+
+    return pid;
+}
+
+static void
+handle_quit_signal(int sig)
+{
+    (void)sig;
+    quit = 1;
+}
+
+static int
+create_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    if (!jkpdf_server_address(path, &addr)) {
+        fprintf(stderr, "ERROR: socket path too long: %s\n", path);
+        exit(1);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("ERROR: socket(2)");
+        exit(1);
+    }
+
+    // a socket nobody listens on is left over from a crashed server
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "ERROR: a server is already listening on %s\n", path);
+        exit(1);
+    }
+    if (errno == ECONNREFUSED)
+        unlink(path);
+
+    mode_t old_umask = umask(0077);
+    int r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_umask);
+
+    if (r < 0) {
+        fprintf(stderr, "ERROR: could not bind to %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    if (listen(fd, 64) < 0) {
+        perror("ERROR: listen(2)");
+        exit(1);
+    }
+
+    return fd;
+}
+
+int
+main(int argc, char **argv)
+{
+    g_autofree gchar *arg_socket  = NULL;
+    gint              arg_workers = 0;
+    gint              arg_cache   = 16;
+
+    GOptionEntry option_entries[] = {
+        { "socket",     's', 0, G_OPTION_ARG_FILENAME, &arg_socket, "Socket to listen on (default: $JKPDF_SERVER_SOCKET or $XDG_RUNTIME_DIR/jkpdftool.sock)", "PATH" },
+        { "workers",    'w', 0, G_OPTION_ARG_INT, &arg_workers, "Number of worker processes (default: one per CPU)", "N" },
+        { "cache-size", 'c', 0, G_OPTION_ARG_INT, &arg_cache, "Number of documents cached per worker (default: 16)", "N" },
+        { NULL }
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) context = g_option_context_new(NULL);
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    g_option_context_set_description(context, "Run jobs sent by jkpdftool-client in warm worker processes.\n");
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "ERROR: option parsing failed: %s\n", error->message);
+        return 1;
+    }
+
+    if (argc > 1) {
+        fprintf(stderr, "ERROR: unexpected positional argument '%s'\n", argv[1]);
+        return 1;
+    }
+
+    if (arg_workers < 0 || arg_cache < 0) {
+        fprintf(stderr, "ERROR: invalid number of workers or cache size\n");
+        return 1;
+    }
+
+    if (arg_workers == 0)
+        arg_workers = (gint)g_get_num_processors();
+
+    if (!arg_socket)
+        arg_socket = jkpdf_server_socket_path();
+
+    cache_size = (guint)arg_cache;
+    cache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, cache_entry_free);
+    g_queue_init(&cache_lru);
+
+    int listen_fd = create_socket(arg_socket);
+
+    warm_up();
+
+    struct sigaction sa = { 0 };
+    sa.sa_handler = handle_quit_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    g_autofree pid_t *workers = g_new0(pid_t, arg_workers);
+    for (int i = 0; i < arg_workers; ++i)
+        workers[i] = spawn_worker(listen_fd);
+
+    fprintf(stderr, "INFO: listening on %s with %d workers\n", arg_socket, arg_workers);
+
+    while (!quit) {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+
+            perror("WTF: waitpid(2)");
+            break;
+        }
+
+        for (int i = 0; i < arg_workers; ++i) {
+            if (workers[i] != pid || quit)
+                continue;
+
+            fprintf(stderr, "WARN: worker %d died, starting a new one\n", (int)pid);
+            workers[i] = spawn_worker(listen_fd);
+        }
+    }
+
+    for (int i = 0; i < arg_workers; ++i)
+        kill(workers[i], SIGTERM);
+    for (int i = 0; i < arg_workers; ++i)
+        waitpid(workers[i], NULL, 0);
+
+    unlink(arg_socket);
+    close(listen_fd);
+
+    return 0;
+}
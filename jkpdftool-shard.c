@@ -0,0 +1,270 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "jkpdf-document.h"
+#include "jkpdf-server.h"
+
+#include <math.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+// Only part of the multicall binary, see jkpdftool.c
+//
+// Runs a tool which handles every page on its own on page ranges (shards) of
+// the input at the same time, and splices the results together:
+//
+//   <IN.pdf jkpdftool-shard -j 8 -- jkpdftool-reencode >OUT.pdf
+//
+// Tools built into jkpdftool run in-process on 'splice --pages A-B' and
+// write CairoScript. Anything else is executed with the shard as PDF on its
+// stdin, so the GhostScript based tools work, too.
+//
+// Shards are balanced by an estimated cost per page rather than by page
+// count: one scanned page is a lot more work than one page of text.
+
+// Returns the first page of every shard, followed by n_pages
+static int *
+plan_shards(const double *costs, int n_pages, int n_shards)
+{
+    double total = 0;
+    for (int i = 0; i < n_pages; ++i)
+        total += costs[i];
+
+    int *starts = g_new0(int, n_shards + 1);
+    starts[n_shards] = n_pages;
+
+    int page = 0;
+    double before = 0; // cost of the pages before page
+
+    for (int s = 1; s < n_shards; ++s) {
+        double target = total * s / n_shards;
+
+        // a page goes to the shard which holds most of it
+        while (page < n_pages && before + costs[page] / 2 < target)
+            before += costs[page++];
+
+        // at least one page per shard
+        int first = CLAMP(page, starts[s - 1] + 1, n_pages - (n_shards - s));
+        while (page < first)
+            before += costs[page++];
+        while (page > first)
+            before -= costs[--page];
+
+        starts[s] = page;
+    }
+
+    return starts;
+}
+
+static void G_GNUC_NORETURN
+run_shard(int first, int last, int out_fd, gboolean builtin, char **tool_argv)
+{
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    g_autofree gchar *range = g_strdup_printf("%d-%d", first, last);
+
+    if (builtin) {
+        g_autoptr(GPtrArray) argv = g_ptr_array_new();
+        g_ptr_array_add(argv, "jkpdftool");
+        g_ptr_array_add(argv, "splice");
+        g_ptr_array_add(argv, "--pages");
+        g_ptr_array_add(argv, range);
+        g_ptr_array_add(argv, "!");
+        for (guint i = 0; tool_argv[i]; ++i)
+            g_ptr_array_add(argv, tool_argv[i]);
+        g_ptr_array_add(argv, NULL);
+
+        // only read back by the final splice
+        g_setenv("JKPDF_OUTPUT_FORMAT", "script", TRUE);
+
+        if (dup2(out_fd, 1) < 0) {
+            perror("WTF: dup2(2)");
+            exit(1);
+        }
+
+        exit(jkpdftool_run((int)argv->len - 1, (char **)argv->pdata));
+    }
+
+    // external tools want PDF on stdin
+    int shard_fd = memfd_create("jkpdf-shard", MFD_CLOEXEC);
+    if (shard_fd < 0 || dup2(shard_fd, 1) < 0) {
+        perror("ERROR: while creating shard");
+        exit(1);
+    }
+
+    g_unsetenv("JKPDF_OUTPUT_FORMAT");
+
+    char *splice_argv[] = { "jkpdftool", "splice", "--pages", range, NULL };
+    int retval = jkpdftool_run(4, splice_argv);
+    if (retval)
+        exit(retval);
+
+    if (lseek(shard_fd, 0, SEEK_SET) < 0 || dup2(shard_fd, 0) < 0 || dup2(out_fd, 1) < 0) {
+        perror("WTF: while redirecting shard");
+        exit(1);
+    }
+
+    execvp(tool_argv[0], tool_argv);
+
+    fprintf(stderr, "ERROR: could not run '%s': %s\n", tool_argv[0], strerror(errno));
+    _exit(127);
+}
+
+int
+main(int argc, char **argv)
+{
+    gint arg_jobs = 0;
+
+    GOptionEntry option_entries[] = {
+        { "jobs", 'j', 0, G_OPTION_ARG_INT, &arg_jobs, "Number of shards to run at the same time (default: one per CPU)", "N" },
+        { NULL }
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) context = g_option_context_new("[--] TOOL [ARGS...] <INPUT >OUTPUT");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    // everything after TOOL belongs to the tool
+    g_option_context_set_strict_posix(context, TRUE);
+
+    g_option_context_set_description(context, "Run a tool on page ranges of the input in parallel.\n"
+        "\n"
+        "The input is split into N page ranges of about the same estimated cost, the\n"
+        "tool runs on every range at the same time, and the results are spliced\n"
+        "together in order. Only useful for tools which handle every page on its\n"
+        "own, like rotate, mirror, pagefit, crop --per-page, rasterize or\n"
+        "jkpdftool-reencode. TOOL is either one of the tools built into jkpdftool or\n"
+        "an external program reading PDF on stdin and writing PDF to stdout.\n"
+    );
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "ERROR: option parsing failed: %s\n", error->message);
+        return 1;
+    }
+
+    char **tool_argv = argv + 1;
+    if (tool_argv[0] && !strcmp(tool_argv[0], "--"))
+        tool_argv++;
+
+    if (!tool_argv[0]) {
+        fprintf(stderr, "ERROR: expected a tool, see '%s --help'\n", argv[0]);
+        return 1;
+    }
+
+    if (arg_jobs < 0) {
+        fprintf(stderr, "ERROR: invalid number of jobs\n");
+        return 1;
+    }
+
+    if (arg_jobs == 0)
+        arg_jobs = (gint)g_get_num_processors();
+
+    if (isatty(1)) {
+        fprintf(stderr, "ERROR: refusing to write PDF to terminal\n");
+        return 1;
+    }
+
+    jkpdf_check_stdin();
+
+    // Every shard reads the input through its own mapping, which needs a
+    // file rather than a pipe
+    g_autoptr(GMappedFile) map = _jkpdf_map_fd(0);
+    if (!map) {
+        int memfd = _jkpdf_spool_to_memfd(0, NULL, 0);
+        if (dup2(memfd, 0) < 0) {
+            perror("WTF: dup2(2)");
+            return 1;
+        }
+        close(memfd);
+
+        map = _jkpdf_map_fd(0);
+        if (!map) {
+            perror("ERROR: while mapping spooled input");
+            return 1;
+        }
+    }
+
+    g_autoptr(GBytes) bytes = g_mapped_file_get_bytes(map);
+    g_autoptr(JkPdfDocument) doc = jkpdf_create_document_from_bytes(bytes);
+
+    int n_pages = jkpdf_document_get_n_pages(doc);
+    if (n_pages == 0) {
+        fprintf(stderr, "ERROR: the input has no pages\n");
+        return 1;
+    }
+
+    int n_shards = MIN(arg_jobs, n_pages);
+
+    // cheap enough to run before forking: a pass over the page sizes and
+    // one over the raw bytes, see jkpdf_document_estimate_page_cost()
+    g_autofree double *costs = g_new0(double, n_pages);
+    for (int i = 0; i < n_pages; ++i)
+        costs[i] = jkpdf_document_estimate_page_cost(doc, i);
+
+    g_autofree int *starts = plan_shards(costs, n_pages, n_shards);
+    gboolean builtin = jkpdftool_is_tool(tool_argv[0]);
+
+    g_autofree int *out_fds = g_new0(int, n_shards);
+    g_autofree pid_t *pids = g_new0(pid_t, n_shards);
+
+    for (int s = 0; s < n_shards; ++s) {
+        if (jkpdf_verbose())
+            fprintf(stderr, "INFO: shard %d: pages %d-%d\n", s + 1, starts[s] + 1, starts[s + 1]);
+
+        out_fds[s] = memfd_create("jkpdf-shard-output", MFD_CLOEXEC);
+        if (out_fds[s] < 0) {
+            perror("ERROR: memfd_create(2)");
+            return 1;
+        }
+
+        fflush(NULL);
+
+        pids[s] = fork();
+        if (pids[s] < 0) {
+            perror("ERROR: fork(2)");
+            return 1;
+        } else if (pids[s] == 0) {
+            run_shard(starts[s] + 1, starts[s + 1], out_fds[s], builtin, tool_argv);
+        }
+    }
+
+    int retval = 0;
+    for (int s = 0; s < n_shards; ++s) {
+        int status = 0;
+        while (waitpid(pids[s], &status, 0) < 0) {
+            if (errno != EINTR) {
+                perror("WTF: waitpid(2)");
+                return 1;
+            }
+        }
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            fprintf(stderr, "ERROR: shard %d (pages %d-%d) failed\n", s + 1, starts[s] + 1, starts[s + 1]);
+            retval = 1;
+        }
+    }
+
+    if (retval)
+        return retval;
+
+    g_autoptr(GPtrArray) merge_argv = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(merge_argv, g_strdup("jkpdftool"));
+    g_ptr_array_add(merge_argv, g_strdup("splice"));
+    for (int s = 0; s < n_shards; ++s)
+        g_ptr_array_add(merge_argv, g_strdup_printf("/proc/self/fd/%d", out_fds[s]));
+    g_ptr_array_add(merge_argv, NULL);
+
+    return jkpdftool_run((int)merge_argv->len - 1, (char **)merge_argv->pdata);
+}
@@ -0,0 +1,438 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+#include "jkpdf-document.h"
+#include "jkpdf-server.h"
+
+// All tools in one binary. The tool sources are compiled with main renamed
+// to jkpdftool_<name>_main, see the Makefile.
+
+typedef int (*JkPdfToolMain)(int argc, char **argv);
+
+int jkpdftool_booklet_main(int argc, char **argv);
+int jkpdftool_crop_main(int argc, char **argv);
+int jkpdftool_cut_main(int argc, char **argv);
+int jkpdftool_duplexify_margins_main(int argc, char **argv);
+int jkpdftool_glue_main(int argc, char **argv);
+int jkpdftool_mirror_main(int argc, char **argv);
+int jkpdftool_ndown_main(int argc, char **argv);
+int jkpdftool_nup_main(int argc, char **argv);
+int jkpdftool_overlay_main(int argc, char **argv);
+int jkpdftool_pagefit_main(int argc, char **argv);
+int jkpdftool_pasta_main(int argc, char **argv);
+int jkpdftool_rasterize_main(int argc, char **argv);
+int jkpdftool_rotate_main(int argc, char **argv);
+int jkpdftool_splice_main(int argc, char **argv);
+
+int jkpdftool_server_main(int argc, char **argv);
+int jkpdftool_client_main(int argc, char **argv);
+int jkpdftool_batch_main(int argc, char **argv);
+int jkpdftool_shard_main(int argc, char **argv);
+
+static const struct {
+    const char *name;
+    JkPdfToolMain main;
+} tools[] = {
+    { "booklet",           jkpdftool_booklet_main },
+    { "crop",              jkpdftool_crop_main },
+    { "cut",               jkpdftool_cut_main },
+    { "duplexify-margins", jkpdftool_duplexify_margins_main },
+    { "glue",              jkpdftool_glue_main },
+    { "mirror",            jkpdftool_mirror_main },
+    { "ndown",             jkpdftool_ndown_main },
+    { "nup",               jkpdftool_nup_main },
+    { "overlay",           jkpdftool_overlay_main },
+    { "pagefit",           jkpdftool_pagefit_main },
+    { "pasta",             jkpdftool_pasta_main },
+    { "rasterize",         jkpdftool_rasterize_main },
+    { "rotate",            jkpdftool_rotate_main },
+    { "splice",            jkpdftool_splice_main },
+};
+
+// Not tools in the sense that they could be part of a pipeline
+static const struct {
+    const char *name;
+    JkPdfToolMain main;
+} services[] = {
+    { "server", jkpdftool_server_main },
+    { "client", jkpdftool_client_main },
+    { "batch",  jkpdftool_batch_main },
+    { "shard",  jkpdftool_shard_main },
+};
+
+static JkPdfToolMain
+find_tool(const char *name)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS(tools); ++i) {
+        if (!strcmp(tools[i].name, name))
+            return tools[i].main;
+    }
+
+    return NULL;
+}
+
+gboolean
+jkpdftool_is_tool(const char *name)
+{
+    if (g_str_has_prefix(name, "jkpdftool-"))
+        name += strlen("jkpdftool-");
+
+    return find_tool(name) != NULL;
+}
+
+static JkPdfToolMain
+find_service(const char *name)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS(services); ++i) {
+        if (!strcmp(services[i].name, name))
+            return services[i].main;
+    }
+
+    return NULL;
+}
+
+static void
+print_help(const char *argv0)
+{
+    printf("Usage:\n");
+    printf("  %s [--timing] TOOL [ARGS...] [! TOOL [ARGS...]]...  <INPUT-PDF  >OUTPUT-PDF\n", argv0);
+    printf("\n");
+    printf("Run one or more jkpdftool tools. Tools separated by '!' are chained like\n");
+    printf("a shell pipe, but the pages are passed on in memory instead of being\n");
+    printf("written and parsed as PDF in between.\n");
+    printf("\n");
+    printf("With --timing, the time taken by every stage is printed, along with the\n");
+    printf("time a shell pipe would have spent on writing, parsing and interpreting\n");
+    printf("PDF, less the time it takes to replay the pages passed in memory.\n");
+    printf("\n");
+    printf("With JKPDF_MEMORY_LIMIT, the pages of a stage are passed on as PDF after\n");
+    printf("all once the limit is exceeded, freeing the memory of earlier stages.\n");
+    printf("\n");
+    printf("Tools:\n");
+    for (size_t i = 0; i < G_N_ELEMENTS(tools); ++i)
+        printf("  %s\n", tools[i].name);
+    printf("\n");
+    printf("Besides that, '%s server' keeps warm worker processes around to run\n", argv0);
+    printf("jobs sent by '%s client [--timing] TOOL [ARGS...]...', see README.\n", argv0);
+    printf("'%s batch MANIFEST' runs all jobs listed in a manifest, and\n", argv0);
+    printf("'%s shard [-j N] TOOL [ARGS...]' runs a tool on page ranges in parallel.\n", argv0);
+}
+
+// Pipeline state, see jkpdf-document.h
+
+static JkPdfDocument   *pipeline_input_doc;   // pages produced by the previous stage
+static JkPdfDocument   *pipeline_output_doc;  // pages produced by the current stage
+static cairo_surface_t *pipeline_output_surf; // stands in for stdout
+static JkPdfDocument   *pipeline_passthrough_doc; // replaces the output, see jkpdf_passthrough()
+
+JkPdfDocument *
+jkpdf_pipeline_input(void)
+{
+    if (!pipeline_input_doc)
+        return NULL;
+
+    return jkpdf_document_ref(pipeline_input_doc);
+}
+
+cairo_surface_t *
+jkpdf_pipeline_output(void)
+{
+    if (!pipeline_output_doc)
+        return NULL;
+
+    if (!pipeline_output_surf) {
+        // never drawn to, jkpdf_render_pages() records into pipeline_output_doc
+        cairo_rectangle_t extents = { 0, 0, 1, 1 };
+        pipeline_output_surf = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+    }
+
+    return cairo_surface_reference(pipeline_output_surf);
+}
+
+JkPdfDocument *
+jkpdf_pipeline_sink(cairo_surface_t *surf)
+{
+    if (surf && surf == pipeline_output_surf)
+        return pipeline_output_doc;
+
+    return NULL;
+}
+
+gboolean
+jkpdf_pipeline_passthrough(JkPdfDocument *doc)
+{
+    if (!pipeline_output_doc)
+        return FALSE;
+
+    g_clear_pointer(&pipeline_passthrough_doc, jkpdf_document_unref);
+    pipeline_passthrough_doc = jkpdf_document_ref(doc);
+
+    return TRUE;
+}
+
+static cairo_status_t
+append_to_byte_array(void *closure, const unsigned char *data, unsigned int length)
+{
+    g_byte_array_append(closure, data, length);
+    return CAIRO_STATUS_SUCCESS;
+}
+
+// Writes all pages of doc as PDF, like a stage writing to a shell pipe would
+static GBytes *
+write_pages_as_pdf(JkPdfDocument *doc)
+{
+    g_autoptr(GByteArray) pdf = g_byte_array_new();
+
+    {
+        g_autoptr(JKPdfCairoSurfaceT) surf = cairo_pdf_surface_create_for_stream(append_to_byte_array, pdf, 100, 100);
+        g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
+
+        for (int i = 0; i < jkpdf_document_get_n_pages(doc); ++i) {
+            g_autoptr(JkPdfPage) page = jkpdf_document_get_page(doc, i);
+
+            double w, h;
+            jkpdf_page_get_size(page, &w, &h);
+            cairo_pdf_surface_set_size(surf, w, h);
+            jkpdf_page_render(page, cr);
+            cairo_surface_show_page(surf);
+        }
+
+        cairo_surface_finish(surf);
+    }
+
+    return g_byte_array_free_to_bytes(g_steal_pointer(&pdf));
+}
+
+// Time taken to draw every page of doc, the way the next stage draws them
+static gint64
+time_page_renders(JkPdfDocument *doc)
+{
+    gint64 start = g_get_monotonic_time();
+
+    for (int i = 0; i < jkpdf_document_get_n_pages(doc); ++i) {
+        g_autoptr(JkPdfPage) page = jkpdf_document_get_page(doc, i);
+
+        double w, h;
+        jkpdf_page_get_size(page, &w, &h);
+
+        cairo_rectangle_t extents = { 0, 0, w, h };
+        g_autoptr(JKPdfCairoSurfaceT) surf = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, &extents);
+        g_autoptr(JKPdfCairoT) cr = cairo_create(surf);
+        jkpdf_page_render(page, cr);
+    }
+
+    return g_get_monotonic_time() - start;
+}
+
+// Measures what the shell pipe would have spent between two stages: writing
+// the pages as PDF, then parsing that PDF and interpreting every page, less
+// the time needed to replay the recorded pages instead.
+static void
+measure_pdf_roundtrip(JkPdfDocument *doc, double *write_secs, double *parse_secs, gsize *pdf_size)
+{
+    gint64 start = g_get_monotonic_time();
+    g_autoptr(GBytes) bytes = write_pages_as_pdf(doc);
+    gint64 written = g_get_monotonic_time();
+
+    *pdf_size = g_bytes_get_size(bytes);
+
+    gint64 parse_start = g_get_monotonic_time();
+    g_autoptr(JkPdfDocument) parsed = jkpdf_document_new_from_bytes(bytes, NULL);
+    gint64 parse_usec = g_get_monotonic_time() - parse_start;
+    if (parsed)
+        parse_usec += time_page_renders(parsed);
+
+    gint64 replay_usec = time_page_renders(doc);
+
+    *write_secs = (double)(written - start) / G_USEC_PER_SEC;
+    *parse_secs = (double)MAX(parse_usec - replay_usec, 0) / G_USEC_PER_SEC;
+}
+
+// Replaces the recorded pages of the last stage by PDF once the memory limit
+// is exceeded. The PDF does not refer to anything of the earlier stages, so
+// their documents are released along with the recordings.
+static void
+spill_stage_output(GPtrArray *outputs, int stage)
+{
+    guint64 limit = jkpdf_memory_limit();
+    if (!limit || jkpdf_memory_rss() <= limit)
+        return;
+
+    JkPdfDocument *doc = g_ptr_array_index(outputs, outputs->len - 1);
+    if (!doc->recorded_pages)
+        return;
+
+    g_autoptr(GBytes) bytes = write_pages_as_pdf(doc);
+
+    g_autoptr(GError) error = NULL;
+    JkPdfDocument *pdf = jkpdf_document_new_from_bytes(bytes, &error);
+    if (!pdf) {
+        fprintf(stderr, "WARN: stage %d: could not read back its pages as PDF: %s\n", stage, error->message);
+        return;
+    }
+
+    fprintf(stderr, "INFO: stage %d: above the memory limit, passing %d pages on as %" G_GSIZE_FORMAT " KiB of PDF\n",
+            stage, jkpdf_document_get_n_pages(pdf), g_bytes_get_size(bytes) / 1024);
+
+    g_ptr_array_set_size(outputs, 0);
+    g_ptr_array_add(outputs, pdf);
+}
+
+static int
+run_pipeline(char **stages[], int n_stages, gboolean timing)
+{
+    // Pages recorded by one stage may refer to fonts and images owned by
+    // documents of earlier stages, so all stage outputs live until the end,
+    // unless spill_stage_output() turns them into PDF.
+    g_autoptr(GPtrArray) outputs = g_ptr_array_new_with_free_func((GDestroyNotify)jkpdf_document_unref);
+
+    double total_saved = 0;
+
+    for (int i = 0; i < n_stages; ++i) {
+        char **stage_argv = stages[i];
+        int stage_argc = (int)g_strv_length(stage_argv);
+        const char *name = stage_argv[0];
+
+        JkPdfToolMain tool_main = find_tool(name);
+        if (!tool_main) {
+            fprintf(stderr, "ERROR: unknown tool '%s'\n", name);
+            return 1;
+        }
+
+        g_autofree char *argv0 = g_strdup_printf("jkpdftool-%s", name);
+        stage_argv[0] = argv0;
+
+        pipeline_input_doc = i > 0 ? g_ptr_array_index(outputs, outputs->len - 1) : NULL;
+        pipeline_output_doc = i < n_stages - 1 ? jkpdf_document_new_recorded() : NULL;
+        if (pipeline_output_doc)
+            g_ptr_array_add(outputs, pipeline_output_doc);
+
+        gint64 start = g_get_monotonic_time();
+        int retval = tool_main(stage_argc, stage_argv);
+        gint64 end = g_get_monotonic_time();
+
+        stage_argv[0] = (char *)name;
+        g_clear_pointer(&pipeline_output_surf, cairo_surface_destroy);
+
+        if (pipeline_passthrough_doc) {
+            // the stage passed its input on instead of recording any pages
+            gpointer *slot = &g_ptr_array_index(outputs, outputs->len - 1);
+            jkpdf_document_unref(*slot);
+            *slot = pipeline_output_doc = g_steal_pointer(&pipeline_passthrough_doc);
+        }
+
+        if (retval != 0) {
+            fprintf(stderr, "ERROR: pipeline stage %d (%s) failed\n", i + 1, name);
+            return retval;
+        }
+
+        if (timing) {
+            fprintf(stderr, "INFO: stage %d (%s): %.3f s\n", i + 1, name, (double)(end - start) / G_USEC_PER_SEC);
+
+            if (pipeline_output_doc) {
+                double write_secs = 0, parse_secs = 0;
+                gsize pdf_size = 0;
+                measure_pdf_roundtrip(pipeline_output_doc, &write_secs, &parse_secs, &pdf_size);
+
+                fprintf(stderr, "INFO: stage %d -> %d: passed %d pages in memory, saved %.3f s writing and %.3f s parsing and interpreting %" G_GSIZE_FORMAT " KiB of PDF\n",
+                        i + 1, i + 2, jkpdf_document_get_n_pages(pipeline_output_doc), write_secs, parse_secs, pdf_size / 1024);
+
+                total_saved += write_secs + parse_secs;
+            }
+        }
+
+        if (pipeline_output_doc)
+            spill_stage_output(outputs, i + 1);
+    }
+
+    if (timing && n_stages > 1)
+        fprintf(stderr, "INFO: saved %.3f s in total compared to a shell pipe\n", total_saved);
+
+    pipeline_input_doc = NULL;
+    pipeline_output_doc = NULL;
+
+    return 0;
+}
+
+int
+jkpdftool_run(int argc, char **argv)
+{
+    // called via a jkpdftool-TOOL symlink
+    g_autofree gchar *basename = g_path_get_basename(argv[0]);
+    if (g_str_has_prefix(basename, "jkpdftool-")) {
+        JkPdfToolMain tool_main = find_tool(basename + strlen("jkpdftool-"));
+        if (!tool_main) {
+            fprintf(stderr, "ERROR: unknown tool '%s'\n", basename);
+            return 1;
+        }
+
+        return tool_main(argc, argv);
+    }
+
+    int first = 1;
+    gboolean timing = FALSE;
+
+    if (argc >= 2 && (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-?"))) {
+        print_help(argv[0]);
+        return 0;
+    }
+
+    if (argc >= 2 && (!strcmp(argv[1], "--timing") || !strcmp(argv[1], "-t"))) {
+        timing = TRUE;
+        first++;
+    }
+
+    if (first >= argc) {
+        fprintf(stderr, "ERROR: expected a tool name, see '%s --help'\n", argv[0]);
+        return 1;
+    }
+
+    // split the command line into stages at every '!'
+    g_autoptr(GPtrArray) stages = g_ptr_array_new_with_free_func(g_free);
+    g_autoptr(GPtrArray) current = g_ptr_array_new();
+
+    for (int i = first; i <= argc; ++i) {
+        if (i == argc || !strcmp(argv[i], "!")) {
+            if (current->len == 0) {
+                fprintf(stderr, "ERROR: empty pipeline stage, see '%s --help'\n", argv[0]);
+                return 1;
+            }
+
+            g_ptr_array_add(current, NULL);
+            g_ptr_array_add(stages, g_ptr_array_free(g_steal_pointer(&current), FALSE));
+            current = g_ptr_array_new();
+        } else {
+            g_ptr_array_add(current, argv[i]);
+        }
+    }
+
+    return run_pipeline((char ***)stages->pdata, (int)stages->len, timing);
+}
+
+int
+main(int argc, char **argv)
+{
+    g_autofree gchar *basename = g_path_get_basename(argv[0]);
+    if (g_str_has_prefix(basename, "jkpdftool-")) {
+        JkPdfToolMain service_main = find_service(basename + strlen("jkpdftool-"));
+        if (service_main)
+            return service_main(argc, argv);
+    } else if (argc >= 2) {
+        JkPdfToolMain service_main = find_service(argv[1]);
+        if (service_main)
+            return service_main(argc - 1, argv + 1);
+    }
+
+    return jkpdftool_run(argc, argv);
+}
@@ -0,0 +1,186 @@
+// Copyright © 2026 Jonas Kümmerlin <jonas@kuemmerlin.eu>
+//
+// Permission to use, copy, modify, and distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+// ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+// ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+
+// libjkpdf, see jkpdf.h
+//
+// Thin wrappers around the same code the tools use. The tools get their
+// documents from stdin and write to stdout, here both come from the caller.
+
+#include "jkpdf-io.h"
+#include "jkpdf.h"
+#include "jkpdf-crop.h"
+#include "jkpdf-pagefit.h"
+#include "jkpdf-nup.h"
+#include "jkpdf-splice.h"
+#include "jkpdf-overlay.h"
+#include "jkpdf-rasterize.h"
+
+typedef gboolean (*JkPdfOperation)(JkPdfDocument **docs, int n_docs, const void *options, cairo_surface_t *surf, GError **error);
+
+PopplerDocument *
+jkpdf_open_pdf(GBytes *bytes, GError **error)
+{
+    return jkpdf_poppler_document_new_from_bytes(bytes, error);
+}
+
+static gboolean
+run_operation(JkPdfOperation op, PopplerDocument **poppler_docs, int n_docs, const void *options, const JkPdfOutput *output, GError **error)
+{
+    g_return_val_if_fail(output != NULL, FALSE);
+    g_return_val_if_fail(output->surface || output->write_func, FALSE);
+
+    g_autoptr(GPtrArray) docs = g_ptr_array_new_full((guint)n_docs, (GDestroyNotify)jkpdf_document_unref);
+    for (int i = 0; i < n_docs; ++i) {
+        g_return_val_if_fail(POPPLER_IS_DOCUMENT(poppler_docs[i]), FALSE);
+
+        if (poppler_document_get_n_pages(poppler_docs[i]) < 1) {
+            g_set_error(error, JKPDF_ERROR, JKPDF_ERROR_NO_PAGES, "input PDF has no pages");
+            return FALSE;
+        }
+
+        g_ptr_array_add(docs, jkpdf_document_new_for_poppler(g_object_ref(poppler_docs[i])));
+    }
+
+    if (output->surface)
+        return op((JkPdfDocument **)docs->pdata, n_docs, options, output->surface, error);
+
+    g_autoptr(JKPdfCairoSurfaceT) surf = cairo_pdf_surface_create_for_stream(output->write_func, output->closure, 100, 100);
+    if (!op((JkPdfDocument **)docs->pdata, n_docs, options, surf, error))
+        return FALSE;
+
+    cairo_surface_finish(surf);
+    return jkpdf_check_surface_status(surf, error);
+}
+
+static gboolean
+crop_operation(JkPdfDocument **docs, int n_docs, const void *options, cairo_surface_t *surf, GError **error)
+{
+    (void)n_docs;
+    return jkpdf_crop_document(docs[0], options, surf, error);
+}
+
+gboolean
+jkpdf_crop(PopplerDocument *doc, const JkPdfCropOptions *options, const JkPdfOutput *output, GError **error)
+{
+    JkPdfCropOptions defaults;
+    if (!options) {
+        jkpdf_crop_options_init(&defaults);
+        options = &defaults;
+    }
+
+    return run_operation(crop_operation, &doc, 1, options, output, error);
+}
+
+static gboolean
+pagefit_operation(JkPdfDocument **docs, int n_docs, const void *options, cairo_surface_t *surf, GError **error)
+{
+    (void)n_docs;
+    return jkpdf_pagefit_document(docs[0], options, surf, error);
+}
+
+gboolean
+jkpdf_pagefit(PopplerDocument *doc, const JkPdfPagefitOptions *options, const JkPdfOutput *output, GError **error)
+{
+    JkPdfPagefitOptions defaults;
+    if (!options) {
+        jkpdf_pagefit_options_init(&defaults);
+        options = &defaults;
+    }
+
+    return run_operation(pagefit_operation, &doc, 1, options, output, error);
+}
+
+static gboolean
+nup_operation(JkPdfDocument **docs, int n_docs, const void *options, cairo_surface_t *surf, GError **error)
+{
+    (void)n_docs;
+    return jkpdf_nup_document(docs[0], options, surf, error);
+}
+
+gboolean
+jkpdf_nup(PopplerDocument *doc, const JkPdfNupOptions *options, const JkPdfOutput *output, GError **error)
+{
+    JkPdfNupOptions defaults;
+    if (!options) {
+        jkpdf_nup_options_init(&defaults);
+        options = &defaults;
+    }
+
+    return run_operation(nup_operation, &doc, 1, options, output, error);
+}
+
+static gboolean
+splice_operation(JkPdfDocument **docs, int n_docs, const void *options, cairo_surface_t *surf, GError **error)
+{
+    return jkpdf_splice_documents(docs, n_docs, options, surf, error);
+}
+
+gboolean
+jkpdf_splice(PopplerDocument **docs, int n_docs, const JkPdfSpliceOptions *options, const JkPdfOutput *output, GError **error)
+{
+    g_return_val_if_fail(n_docs >= 1, FALSE);
+
+    JkPdfSpliceOptions defaults;
+    if (!options) {
+        jkpdf_splice_options_init(&defaults);
+        options = &defaults;
+    }
+
+    return run_operation(splice_operation, docs, n_docs, options, output, error);
+}
+
+static gboolean
+overlay_operation(JkPdfDocument **docs, int n_docs, const void *options, cairo_surface_t *surf, GError **error)
+{
+    return jkpdf_overlay_documents(docs, n_docs, options, surf, error);
+}
+
+gboolean
+jkpdf_overlay(PopplerDocument *base, PopplerDocument **overlays, int n_overlays, const JkPdfOverlayOptions *options, const JkPdfOutput *output, GError **error)
+{
+    g_return_val_if_fail(n_overlays >= 0, FALSE);
+
+    JkPdfOverlayOptions defaults;
+    if (!options) {
+        jkpdf_overlay_options_init(&defaults);
+        options = &defaults;
+    }
+
+    g_autofree PopplerDocument **docs = g_new0(PopplerDocument *, n_overlays + 1);
+    docs[0] = base;
+    for (int i = 0; i < n_overlays; ++i)
+        docs[i + 1] = overlays[i];
+
+    return run_operation(overlay_operation, docs, n_overlays + 1, options, output, error);
+}
+
+static gboolean
+rasterize_operation(JkPdfDocument **docs, int n_docs, const void *options, cairo_surface_t *surf, GError **error)
+{
+    (void)n_docs;
+    return jkpdf_rasterize_document(docs[0], options, surf, error);
+}
+
+gboolean
+jkpdf_rasterize(PopplerDocument *doc, const JkPdfRasterizeOptions *options, const JkPdfOutput *output, GError **error)
+{
+    JkPdfRasterizeOptions defaults;
+    if (!options) {
+        jkpdf_rasterize_options_init(&defaults);
+        options = &defaults;
+    }
+
+    return run_operation(rasterize_operation, &doc, 1, options, output, error);
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Runs the tools with several render threads on a document with a Type 3
+# font. Type 3 glyphs are only written when the output is finished, so
+# this catches fonts that are freed together with their document too
+# early. Called by `make check', see the README.
+#
+# CHECK_RUNNER   prefix for every tool, e.g. "valgrind --error-exitcode=1 -q"
+
+set -u
+
+dir=out/check
+runner=${CHECK_RUNNER:-}
+failed=0
+
+mkdir -p "$dir"
+out/bench/jkpdf-gencorpus --profile type3 --pages 24 >"$dir/type3.pdf" || exit 1
+
+check() {
+    name=$1
+    shift
+
+    if ! JKPDF_THREADS=4 sh -c "$*" <"$dir/type3.pdf" >"$dir/output.pdf" 2>"$dir/stderr" ||
+       ! out/jkpdftool-rotate 0 <"$dir/output.pdf" >/dev/null 2>>"$dir/stderr"; then
+        printf 'FAIL: %s\n' "$name" 1>&2
+        sed 's/^/    /' "$dir/stderr" 1>&2
+        failed=1
+        return
+    fi
+
+    # poppler-utils are optional
+    if command -v pdffonts >/dev/null 2>&1 && ! pdffonts "$dir/output.pdf" | grep -q 'Type 3'; then
+        printf 'FAIL: %s lost its Type 3 font\n' "$name" 1>&2
+        failed=1
+        return
+    fi
+
+    printf 'PASS: %s\n' "$name" 1>&2
+}
+
+check rotate    "$runner out/jkpdftool-rotate 90"
+check pagefit   "$runner out/jkpdftool-pagefit -s A5"
+check nup       "$runner out/jkpdftool-nup 2x1"
+check booklet   "$runner out/jkpdftool-booklet"
+check pipeline  "$runner out/jkpdftool rotate 90 ! nup 2x1"
+
+rm -f "$dir/output.pdf" "$dir/stderr"
+exit $failed